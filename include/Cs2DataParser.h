@@ -46,8 +46,81 @@ public:
 		uint8_t buttonType;
 	};
 
+	// part of the parsed data, nothing is copied
+	struct Text
+	{
+		const char *data;
+		size_t length;
+
+		bool equals(const char *text) const;
+		std::string toString() const { return std::string(data, length); }
+	};
+
+	// one line of a cs2 file like " ..nr=3". depth is the number of dots in front of the key,
+	// section names like "lokomotive" have depth 0 and lines without '=' have an empty value
+	struct Token
+	{
+		uint8_t depth;
+		bool hasValue;
+		Text key;
+		Text value;
+	};
+
+	// splits the data into tokens line by line without going back
+	class Tokenizer
+	{
+	public:
+		Tokenizer(const char *data, size_t length) : m_current(data), m_end(data + length) {}
+		explicit Tokenizer(const std::string &data) : Tokenizer(data.data(), data.size()) {}
+
+		// returns false at the end of the data
+		bool next(Token &token);
+
+	private:
+		const char *m_current;
+		const char *m_end;
+	};
+
+	// accepts a leading 0x for base 16 and stops at the first character that is no digit like stoul,
+	// but returns false instead of throwing if there is no number
+	static bool parseNumber(const Text &text, uint16_t &result, uint8_t base = 10);
+
+	// position of one loco in a lokomotive.cs2, starting with its "lokomotive" line
+	struct LocoRange
+	{
+		std::string name;
+		size_t offset;
+		size_t length;
+	};
+
+	// indexes a file that is read part by part, e.g. from SPIFFS, so only the current line is kept in memory
+	class LocoIndexer
+	{
+	public:
+		explicit LocoIndexer(std::vector<LocoRange> &locos);
+
+		// parts may end anywhere, even within a line
+		void add(const char *data, size_t length);
+
+		// locos without name are left out
+		void finish();
+
+	private:
+		void addLine(const char *line, size_t length, size_t offset);
+
+		std::vector<LocoRange> &m_locos;
+		// start of a line that goes on in the next part
+		std::string m_line;
+		size_t m_lineOffset{0};
+		size_t m_position{0};
+		bool m_inLoco{false};
+	};
+
+	// one pass over the file, locos without name are left out
+	static void indexLocos(const char *data, size_t length, std::vector<LocoRange> &locos);
+
 	static bool parseCs2ToLocoData(std::string *data, LocoData &locoData);
-	static std::string::size_type getParameterHex(std::string *data, std::string parameter, uint16_t &result, std::string::size_type startpos = 0);
-	static std::string::size_type getParameter(std::string *data, std::string parameter, uint16_t &result, std::string::size_type startpos = 0);
-	static std::string::size_type getParameter(std::string *data, std::string parameter, std::string &result, std::string::size_type startpos = 0);
+	static std::string::size_type getParameterHex(std::string *data, const std::string &parameter, uint16_t &result, std::string::size_type startpos = 0);
+	static std::string::size_type getParameter(std::string *data, const std::string &parameter, uint16_t &result, std::string::size_type startpos = 0);
+	static std::string::size_type getParameter(std::string *data, const std::string &parameter, std::string &result, std::string::size_type startpos = 0);
 };
\ No newline at end of file
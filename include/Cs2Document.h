@@ -0,0 +1,134 @@
+/*********************************************************************
+ * TrainBox Maerklin CS2 Document
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include "Cs2DataParser.h"
+#include "Helper/Arena.h"
+
+// whole cs2 file as tree of lines. Lines without dots like "[lokomotive]" or "lokomotive" are children of the root,
+// " .key" lines are children of the line before with less dots and so on
+// text and nodes live in the arena of the document, nodes stay valid until parse() or clear()
+class Cs2Document
+{
+public:
+    struct Node
+    {
+        uint8_t depth;
+        // "key" and "key=" are kept apart
+        bool hasValue;
+        Cs2DataParser::Text key;
+        Cs2DataParser::Text value;
+        Node *parent;
+        Node *firstChild;
+        Node *lastChild;
+        Node *next;
+    };
+
+    static constexpr size_t serializeBufferSize{256};
+
+public:
+    explicit Cs2Document(size_t arenaBlockSize = 1024);
+    virtual ~Cs2Document();
+
+    // replaces the content, the data is copied
+    bool parse(const char *data, size_t length);
+    bool parse(const std::string &data) { return parse(data.data(), data.size()); }
+
+    void clear();
+
+    Node *getRoot() { return m_root; }
+
+    // first child with key behind after, nullptr if there is none
+    static Node *findChild(Node *parent, const char *key, Node *after = nullptr);
+
+    // value nullptr adds a line without '='
+    Node *addChild(Node *parent, const char *key, const char *value = nullptr);
+
+    // memory of the old value is released with the document
+    void setValue(Node *node, const char *value, size_t length);
+    void setValue(Node *node, const std::string &value) { setValue(node, value.data(), value.size()); }
+
+    // node is only unlinked, its memory is released with the document
+    static bool removeChild(Node *parent, Node *child);
+
+    // calls flush(data, length) with parts of at most serializeBufferSize bytes
+    template <typename Flush>
+    void serialize(Flush flush) const;
+
+    size_t getSerializedLength() const;
+
+    std::string toString() const;
+
+    size_t getUsedMemory() const { return m_arena.getUsedBytes(); }
+
+private:
+    Node *createNode(Node *parent, uint8_t depth, bool hasValue, Cs2DataParser::Text key, Cs2DataParser::Text value);
+
+    // next node in file order
+    static const Node *nextNode(const Node *node);
+
+    Arena m_arena;
+
+    Node *m_root{nullptr};
+};
+
+template <typename Flush>
+void Cs2Document::serialize(Flush flush) const
+{
+    char buffer[serializeBufferSize];
+    size_t used = 0;
+    auto write = [&](const char *text, size_t length)
+    {
+        while (length > 0)
+        {
+            size_t part = (length < (serializeBufferSize - used)) ? length : (serializeBufferSize - used);
+            memcpy(buffer + used, text, part);
+            used += part;
+            text += part;
+            length -= part;
+            if (serializeBufferSize == used)
+            {
+                flush(buffer, used);
+                used = 0;
+            }
+        }
+    };
+    for (const Node *node = nextNode(m_root); nullptr != node; node = nextNode(node))
+    {
+        if (node->depth > 0)
+        {
+            write(" ", 1);
+            for (uint8_t i = 0; i < node->depth; i++)
+            {
+                write(".", 1);
+            }
+        }
+        write(node->key.data, node->key.length);
+        if (node->hasValue)
+        {
+            write("=", 1);
+            write(node->value.data, node->value.length);
+        }
+        write("\n", 1);
+    }
+    if (used > 0)
+    {
+        flush(buffer, used);
+    }
+}
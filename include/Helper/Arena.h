@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Arena
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <memory>
+#include <new>
+#include <vector>
+
+// hands out memory from blocks of blockSize bytes, everything is freed at once with clear()
+// destructors are not called, so only trivially destructible objects may be created
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize)
+        : m_blockSize(blockSize)
+    {
+    }
+
+    void *allocate(size_t size, size_t alignment = alignof(max_align_t))
+    {
+        size_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+        if (m_blocks.empty() || ((offset + size) > m_capacity))
+        {
+            // larger requests get a block of their own
+            m_capacity = (size > m_blockSize) ? size : m_blockSize;
+            m_blocks.emplace_back(new uint8_t[m_capacity]);
+            offset = 0;
+        }
+        m_used = offset + size;
+        m_usedBytes += size;
+        return m_blocks.back().get() + offset;
+    }
+
+    template <typename T>
+    T *create()
+    {
+        return new (allocate(sizeof(T), alignof(T))) T();
+    }
+
+    // copy is not null terminated
+    const char *copy(const char *text, size_t length)
+    {
+        char *destination = static_cast<char *>(allocate(length, 1));
+        memcpy(destination, text, length);
+        return destination;
+    }
+
+    void clear()
+    {
+        m_blocks.clear();
+        m_used = 0;
+        m_capacity = 0;
+        m_usedBytes = 0;
+    }
+
+    size_t getUsedBytes() const { return m_usedBytes; }
+
+private:
+    const size_t m_blockSize;
+    std::vector<std::unique_ptr<uint8_t[]>> m_blocks;
+    size_t m_used{0};
+    size_t m_capacity{0};
+    size_t m_usedBytes{0};
+};
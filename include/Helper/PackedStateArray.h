@@ -0,0 +1,86 @@
+/*********************************************************************
+ * PackedStateArray
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// N states of two bit each, e.g. turnout positions (0 = unknown, 1 = straight, 2 = diverging)
+template <size_t N>
+class PackedStateArray
+{
+public:
+    static constexpr size_t statesPerWord{16};
+    static constexpr size_t numberOfWords{(N + statesPerWord - 1) / statesPerWord};
+
+    PackedStateArray() { clear(); }
+
+    static constexpr size_t size() { return N; }
+
+    // out of range reads as 0
+    uint8_t get(size_t index) const
+    {
+        if (index >= N)
+        {
+            return 0;
+        }
+        return (m_words[index / statesPerWord] >> shift(index)) & 0x03;
+    }
+
+    // returns false if index is out of range
+    bool set(size_t index, uint8_t state)
+    {
+        if (index >= N)
+        {
+            return false;
+        }
+        uint32_t &word = m_words[index / statesPerWord];
+        word = (word & ~(static_cast<uint32_t>(0x03) << shift(index))) | (static_cast<uint32_t>(state & 0x03) << shift(index));
+        return true;
+    }
+
+    void clear() { memset(m_words, 0, sizeof(m_words)); }
+
+    // calls function(index, state) for every state != 0 in ascending order, empty words are skipped as a whole
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        for (size_t w = 0; w < numberOfWords; w++)
+        {
+            uint32_t word = m_words[w];
+            for (size_t index = w * statesPerWord; 0 != word; index++)
+            {
+                if (0 != (word & 0x03))
+                {
+                    function(index, static_cast<uint8_t>(word & 0x03));
+                }
+                word >>= 2;
+            }
+        }
+    }
+
+    // raw image for persistence
+    const uint8_t *data() const { return reinterpret_cast<const uint8_t *>(m_words); }
+    uint8_t *data() { return reinterpret_cast<uint8_t *>(m_words); }
+    static constexpr size_t byteSize() { return sizeof(uint32_t) * numberOfWords; }
+
+private:
+    static constexpr uint8_t shift(size_t index) { return static_cast<uint8_t>((index % statesPerWord) * 2); }
+
+    uint32_t m_words[numberOfWords];
+};
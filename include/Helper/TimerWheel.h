@@ -0,0 +1,105 @@
+/*********************************************************************
+ * TimerWheel
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <vector>
+
+// hashed timer wheel with Slots slots of tickINms each
+// deadlines further away than one turn stay in their slot until the wheel passed them often enough
+// there is no cancel, expired values have to be checked by the user if they are still of interest
+template <typename T, size_t Slots>
+class TimerWheel
+{
+public:
+    explicit TimerWheel(unsigned long tickINms)
+        : m_tickINms(tickINms)
+    {
+    }
+
+    void schedule(const T &value, unsigned long deadlineINms)
+    {
+        unsigned long tick = deadlineINms / m_tickINms;
+        // deadlines in the past are handled with the next advance
+        if (m_started && (static_cast<long>(tick - m_lastTick) < 0))
+        {
+            tick = m_lastTick;
+        }
+        m_slots[tick % Slots].push_back(Entry{deadlineINms, value});
+        m_size++;
+    }
+
+    bool empty() const { return 0 == m_size; }
+
+    // calls expired(value) for every value whose deadline is reached
+    template <typename Function>
+    void advance(unsigned long currentTimeINms, Function expired)
+    {
+        if (!m_started)
+        {
+            m_started = true;
+            m_lastTick = currentTimeINms / m_tickINms;
+        }
+        unsigned long tick = currentTimeINms / m_tickINms;
+        if (0 == m_size)
+        {
+            m_lastTick = tick;
+            return;
+        }
+        // every slot is visited at most once per call
+        unsigned long numberOfTicks = tick - m_lastTick + 1;
+        if (numberOfTicks > Slots)
+        {
+            numberOfTicks = Slots;
+        }
+        for (unsigned long i = 0; i < numberOfTicks; i++)
+        {
+            std::vector<Entry> &slot = m_slots[(tick - i) % Slots];
+            for (size_t index = 0; index < slot.size();)
+            {
+                if (static_cast<long>(currentTimeINms - slot[index].deadlineINms) >= 0)
+                {
+                    T value = slot[index].value;
+                    slot[index] = slot.back();
+                    slot.pop_back();
+                    m_size--;
+                    expired(value);
+                }
+                else
+                {
+                    index++;
+                }
+            }
+        }
+        m_lastTick = tick;
+    }
+
+private:
+    struct Entry
+    {
+        unsigned long deadlineINms;
+        T value;
+    };
+
+    const unsigned long m_tickINms;
+    std::array<std::vector<Entry>, Slots> m_slots;
+    size_t m_size{0};
+    bool m_started{false};
+    unsigned long m_lastTick{0};
+};
@@ -6,6 +6,8 @@
 #include <functional>
 #include <string>
 #include <memory>
+#include <map>
+#include "Cs2DataParser.h"
 
 //#define DEBUG
 
@@ -19,7 +21,7 @@ public:
     void cyclic();
 
     void begin(AutoConnectConfig &autoConnectConfig, std::function<void(void)> deleteLocoConfigFkt, std::function<void(void)> defaultLocoListFkt,
-               std::function<void(bool)> programmingFkt, std::function<void(void)> readingFkt, std::function<void(void)> searchMotorolaFkt,
+               std::function<void(bool)> programmingFkt, std::function<void(bool, bool)> readingFkt, std::function<void(void)> searchMotorolaFkt,
                std::function<void(void)> searchDccShortFkt, std::function<void(void)> searchDccLongFkt, std::string* foundLocoString);
 
     void setLokomotiveAvailable(bool isAvailable);
@@ -36,10 +38,19 @@ private:
     static String postUpload(AutoConnectAux &aux, PageArgument &args);
     String getContentType(const String &filename);
 
+    void addDocument(const std::string &path, const char *content);
+    void sendDocument(const std::string &path);
+
+    // finds all locos in lokomotive.cs2 if this was not done since the file changed
+    bool updateLocoIndex();
+    void invalidateLocoIndex();
+    void sendLoco(const String &name);
+
     std::function<void(void)> m_deleteLocoConfigFkt;
     std::function<void(void)> m_defaultLocoListFkt;
     std::function<void(bool)> m_programmingFkt;
-    std::function<void(void)> m_readingFkt;
+    // parameters are true if the compressed lokomotive.cs2 shall be read and if all locos shall be read again
+    std::function<void(bool, bool)> m_readingFkt;
 
     bool m_lokomotiveAvailable{true};
     bool m_transmissionFinished{true};
@@ -52,6 +63,13 @@ private:
 
     std::string* m_foundLocoString{nullptr};
 
+    // fixed config files, content stays in flash
+    std::map<std::string, const char *> m_documents;
+
+    // only offsets are kept, locos are read from the file when they are sent
+    std::vector<Cs2DataParser::LocoRange> m_locoIndex;
+    bool m_locoIndexValid{false};
+
     WebServer m_WebServer;
     AutoConnect m_AutoConnect;
     AutoConnectAux m_auxZ60Config;
@@ -59,6 +77,8 @@ private:
     AutoConnectCheckbox m_defaultLocoCs2;
     AutoConnectCheckbox m_progActive;
     AutoConnectCheckbox m_readingLoco;
+    AutoConnectCheckbox m_compressedLocoFile;
+    AutoConnectCheckbox m_fullLocoSync;
     AutoConnectSubmit m_saveButton;
     AutoConnectSubmit m_getZ21DbButton;
 
@@ -22,7 +22,10 @@
 #include <Printable.h>
 #include <String>
 #include <array>
-#include <queue>
+#include <deque>
+#include <vector>
+#include <functional>
+#include "Helper/TimerWheel.h"
 
 class TrackMessage : public Printable
 {
@@ -187,12 +190,19 @@ public:
         MfxMainDetection = 96
     };
 
+    // called with the response of a programming command or query or with nullptr after its timeout
+    typedef std::function<void(const TrackMessage *response)> ProgrammingCallback;
+
     typedef struct
     {
         TrackMessage message;
         uint32_t timeoutINms;
+        ProgrammingCallback callback;
     } ProgrammingCmd;
 
+    // handling time histogram of received messages: <10us, <50us, <100us, <500us, <1ms, >=1ms
+    static constexpr uint8_t numberOfTimeBuckets{6};
+
 protected:
     MaerklinCanInterface(word hash, bool debug);
 
@@ -202,16 +212,47 @@ protected:
 
     bool m_debug;
 
-    std::queue<ProgrammingCmd> m_programmingCmdQueue;
+    typedef struct
+    {
+        uint16_t handle;
+        ProgrammingCmd cmd;
+    } ActiveProgrammingCmd;
+
+    // commands waiting until their device is free
+    std::deque<ProgrammingCmd> m_programmingCmdQueue;
 
-    ProgrammingCmd m_currentProgrammingCmd;
+    // commands sent and waiting for response, at most one per device
+    std::vector<ActiveProgrammingCmd> m_activeProgrammingCmds;
 
-    bool m_programmingCmdActive;
+    const size_t m_maxActiveProgrammingCmds{4};
+
+    uint16_t m_nextProgrammingHandle{0};
+
+    TimerWheel<uint16_t, 64> m_programmingTimeouts{100};
 
     virtual void begin();
 
+    // handles hash negotiation and timeouts of programming commands
+    void cyclic();
+
+    enum class HashState : uint8_t
+    {
+        Valid = 0,
+        Probing
+    };
+
+    HashState m_hashState{HashState::Valid};
+
+    unsigned long m_hashProbeStartTimeINms{0};
+
+    const unsigned long m_hashProbeTimeINms{2000};
+
+    // sends a ping with a new random hash, it is negotiated by cyclic without blocking
     void generateHash();
 
+    // called once a generated hash was not used by any other device
+    virtual void notifyHashNegotiated() {};
+
     uint16_t getHash();
 
     bool isDebug();
@@ -228,6 +269,92 @@ protected:
 
     bool sendNextProgrammingCmd();
 
+    void handleProgrammingResponse(TrackMessage &message);
+
+    void handleProgrammingTimeout(uint16_t handle);
+
+    static uint32_t programmingDevice(const TrackMessage &message);
+
+    static bool isProgrammingResponse(const TrackMessage &request, const TrackMessage &response);
+
+    // received messages are dispatched by command or, for system commands, by sub command
+    typedef bool (MaerklinCanInterface::*MessageHandler)(uint32_t uid, const TrackMessage &message);
+
+    typedef struct
+    {
+        uint8_t command;
+        uint8_t subCmd;
+        bool responseOnly;
+        MessageHandler handler;
+    } MessageDispatch;
+
+    typedef struct
+    {
+        uint8_t slot[256];
+    } DispatchIndex;
+
+    static constexpr uint8_t noDispatch{0xFF};
+    static constexpr uint8_t noSubCmd{0xFF};
+    static constexpr size_t numberOfDispatches{27};
+
+    static const MessageDispatch s_dispatches[numberOfDispatches];
+    static const DispatchIndex s_commandIndex;
+    static const DispatchIndex s_systemIndex;
+
+    template <size_t N>
+    static constexpr DispatchIndex makeDispatchIndex(const MessageDispatch (&dispatches)[N], bool systemCmd)
+    {
+        DispatchIndex index{};
+        for (size_t i = 0; i < 256; i++)
+        {
+            index.slot[i] = noDispatch;
+        }
+        for (size_t i = 0; i < N; i++)
+        {
+            if (systemCmd == (static_cast<uint8_t>(Cmd::systemCmd) == dispatches[i].command))
+            {
+                index.slot[systemCmd ? dispatches[i].subCmd : dispatches[i].command] = static_cast<uint8_t>(i);
+            }
+        }
+        return index;
+    }
+
+    // upper limits of the handling time buckets, the last bucket takes everything above
+    static constexpr uint32_t s_timeBucketLimitsINus[numberOfTimeBuckets - 1]{10, 50, 100, 500, 1000};
+
+    uint32_t m_dispatchCounter[numberOfDispatches]{};
+    uint32_t m_dispatchHistogram[numberOfDispatches][numberOfTimeBuckets]{};
+    uint32_t m_unhandledMessageCounter{0};
+
+    bool receiveSystemStop(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemGo(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemHalt(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoStop(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoRemoveCycle(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoDataProtocol(uint32_t uid, const TrackMessage &message);
+    bool receiveAccTime(uint32_t uid, const TrackMessage &message);
+    bool receiveFastReadMfx(uint32_t uid, const TrackMessage &message);
+    bool receiveTrackProtocol(uint32_t uid, const TrackMessage &message);
+    bool receiveMfxCounter(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemOverLoad(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemStatus(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemIdent(uint32_t uid, const TrackMessage &message);
+    bool receiveSystemReset(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoDiscovery(uint32_t uid, const TrackMessage &message);
+    bool receiveMfxBind(uint32_t uid, const TrackMessage &message);
+    bool receiveMfxVerify(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoSpeed(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoDir(uint32_t uid, const TrackMessage &message);
+    bool receiveLocoFunc(uint32_t uid, const TrackMessage &message);
+    bool receiveReadConfig(uint32_t uid, const TrackMessage &message);
+    bool receiveWriteConfig(uint32_t uid, const TrackMessage &message);
+    bool receiveAccSwitch(uint32_t uid, const TrackMessage &message);
+    bool receivePing(uint32_t uid, const TrackMessage &message);
+    bool receiveStatusDataConfig(uint32_t uid, const TrackMessage &message);
+    bool receiveConfigData(uint32_t uid, const TrackMessage &message);
+    // uid carries the stream length for configDataSteam
+    bool receiveConfigDataStream(uint32_t uid, const TrackMessage &message);
+
     virtual void notifyProgrammingCmdSent() {};
 
     // onCallback
@@ -291,6 +418,9 @@ protected:
 
     virtual bool onAccSwitch(uint32_t id, uint8_t position, uint8_t current) { return false; }
 
+    // accessory switched with the switch time of the sender, e.g. the one of an article on a MS2
+    virtual bool onAccSwitch(uint32_t id, uint8_t position, uint8_t current, uint16_t switchTimeIN10ms) { return onAccSwitch(id, position, current); }
+
     virtual bool onPing(uint16_t hash, uint32_t id, uint16_t swVersion, uint16_t hwIdent) { return false; }
 
     virtual bool onStatusDataConfig(uint16_t hash, std::array<uint8_t, 8> &data) { return false; }
@@ -374,7 +504,8 @@ public:
 
     void messageConfigData(TrackMessage &message, std::array<uint8_t, 8> &request);
 
-    bool exchangeMessage(TrackMessage &out, TrackMessage &in, word timeout);
+    // sends out and calls callback with its response or with nullptr after timeoutINms, nothing is blocked while waiting
+    bool exchangeMessage(TrackMessage &out, ProgrammingCallback callback, uint32_t timeoutINms);
 
     bool sendSystemStop(uint32_t uid = 0);
 
@@ -397,9 +528,9 @@ public:
 
     bool sendSetMfxCounter(uint16_t counter, uint32_t uid = 0);
 
-    bool sendSystemStatus(uint8_t channelNumber, uint32_t uid = 0);
+    bool sendSystemStatus(uint8_t channelNumber, uint32_t uid = 0, ProgrammingCallback callback = nullptr);
 
-    bool sendSystemStatus(uint8_t channelNumber, uint16_t configuration, uint32_t uid = 0);
+    bool sendSystemStatus(uint8_t channelNumber, uint16_t configuration, uint32_t uid = 0, ProgrammingCallback callback = nullptr);
 
     bool sendSetSystemIdent(uint16_t systemIdent, uint32_t uid = 0);
 
@@ -415,12 +546,12 @@ public:
 
     bool verifyMfxUid(uint32_t uid, uint16_t sid);
 
-    bool requestLocoSpeed(uint32_t uid);
+    bool requestLocoSpeed(uint32_t uid, ProgrammingCallback callback = nullptr);
 
     // value speed between 0 and 1024
     bool setLocoSpeed(uint32_t uid, uint16_t speed);
 
-    bool requestLocoDir(uint32_t uid);
+    bool requestLocoDir(uint32_t uid, ProgrammingCallback callback = nullptr);
 
     // if direction changes, speed is set to zero
     // 0 = Fahrtrichtung bleibt
@@ -429,13 +560,13 @@ public:
     // 3 = Fahrtrichtung umschalten
     bool setLocoDir(uint32_t uid, uint8_t dir);
 
-    bool requestLocoFunc(uint32_t uid, uint8_t function);
+    bool requestLocoFunc(uint32_t uid, uint8_t function, ProgrammingCallback callback = nullptr);
 
     bool setLocoFunc(uint32_t uid, uint8_t function, uint8_t value);
 
-    bool sendReadConfig(uint32_t id, uint16_t cvAdr, uint8_t number);
+    bool sendReadConfig(uint32_t id, uint16_t cvAdr, uint8_t number, ProgrammingCallback callback = nullptr);
 
-    bool sendWriteConfig(uint32_t id, uint16_t cvAdr, uint8_t value, bool directProc, bool writeByte);
+    bool sendWriteConfig(uint32_t id, uint16_t cvAdr, uint8_t value, bool directProc, bool writeByte, ProgrammingCallback callback = nullptr);
 
     bool setAccSwitch(uint32_t uid, uint8_t position, uint8_t current);
 
@@ -445,7 +576,14 @@ public:
 
     bool sendPing(uint32_t uid, uint16_t swVersion, uint16_t hwIdent);
 
-    bool requestStatusDataConfig(uint32_t uid, uint8_t index);
+    bool requestStatusDataConfig(uint32_t uid, uint8_t index, ProgrammingCallback callback = nullptr);
 
     bool requestConfigData(std::array<uint8_t, 8> &request);
+
+    // number of handled messages and their handling time histogram, false if command is not dispatched
+    bool getMessageStatistics(uint8_t command, uint8_t subCmd, uint32_t &counter, std::array<uint32_t, numberOfTimeBuckets> &histogram);
+
+    uint32_t getUnhandledMessageCounter() { return m_unhandledMessageCounter; }
+
+    bool isHashNegotiated() { return HashState::Valid == m_hashState; }
 };
\ No newline at end of file
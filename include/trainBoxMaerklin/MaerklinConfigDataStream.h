@@ -20,9 +20,12 @@
 #include "trainBoxMaerklin/MaerklinCanInterface.h"
 #include "trainBoxMaerklin/MaerklinStationConfig.h"
 #include <array>
+#include <deque>
+#include <map>
 #include <memory>
 #include <vector>
 #include <string>
+#include <zlib.h>
 
 class MaerklinConfigDataStream
 {
@@ -33,15 +36,30 @@ class MaerklinConfigDataStream
             Lokinfo,
             Loknamen,
             MagInfo,
-            Lokdb
+            Lokdb,
+            Loks
         };
 
+    typedef struct
+    {
+        uint32_t bytes;
+        unsigned long durationINms;
+        uint32_t bytesPerSecond;
+        // number of times the receive buffer had to grow during the transfer
+        uint16_t reallocations;
+    } TransferStatistics;
+
 public:
     // can interface is needed to request data over interface
     MaerklinConfigDataStream(MaerklinCanInterface &interface, std::vector<MaerklinStationConfig> &stationList);
     virtual ~MaerklinConfigDataStream();
 
-    bool requestConfigData(DataType type, std::string *info, std::string* buffer);
+    // stationHash is the station that is asked, 0 asks the first station of the station list.
+    // Only a stream of this station or one sent with our own hash is taken as answer
+    bool requestConfigData(DataType type, std::string *info, std::string* buffer, uint16_t stationHash = 0);
+
+    // drops the open request and a running transfer into buffer, has to be called before buffer is destroyed
+    void cancelConfigData(std::string *buffer);
 
     bool onConfigData(uint16_t hash, std::array<uint8_t, 8> data);
 
@@ -55,34 +73,91 @@ public:
 
     void setHash(uint16_t hash) { m_hash = hash; }
 
+    // statistics of the last completed transfer
+    const TransferStatistics &getTransferStatistics() { return m_transferStatistics; }
+
     // void setConfigDataStreamFeedbackFunc(void (*reportResultFunc)(std::vector<uint8_t>* data, uint16_t hash, bool success)){m_reportResultFunc = reportResultFunc;}
 
 protected:
-    bool m_configDataStreamStartReceived{false};
-
     uint16_t m_hash{0};
 
-    uint16_t m_hashExpected{0};
+    // larger streams are not reserved and larger compressed streams are rejected.
+    // The ESP32 usually can not provide a larger block from its heap
+    const uint32_t m_maxUncompressedLength{96 * 1024};
+
+    // a stream is dropped if no frame was received for this time
+    const unsigned long m_sessionTimeoutINms{2000};
 
-    uint16_t m_crcExpected{0};
+    // a request is dropped if no stream started for it in this time
+    const unsigned long m_requestTimeoutINms{20000};
 
-    uint32_t m_length{0};
+    // requested is false for streams nobody asked for, e.g. broadcasts or answers to other devices
+    virtual void m_reportResultFunc(std::string* data, uint16_t hash, bool success, bool requested) = 0;
 
-    uint32_t m_lengthExpected{0};
+    // crc of config data in the same way as it is calculated for a stream
+    static uint16_t calculateCRC(const std::string &data);
 
-    virtual void m_reportResultFunc(std::string* data, uint16_t hash, bool success) = 0;
+    // drops streams and requests whose deadline passed
+    void cyclic();
 
 private:
-    uint16_t updateCRC(uint16_t CRC_acc, uint8_t CRC_input);
+    typedef struct
+    {
+        std::string *buffer;
+        bool compressed;
+        unsigned long deadlineINms;
+        // 0 if no station is known, then any stream is taken
+        uint16_t stationHash;
+    } PendingRequest;
+
+    // one running transfer per hash of its frames
+    struct StreamSession
+    {
+        // buffer of the request or ownBuffer for streams nobody asked for
+        std::string *buffer{nullptr};
+        std::string ownBuffer;
+        bool requested{false};
+        // compressed streams start with the uncompressed length in 4 bytes, followed by zlib data
+        bool compressed{false};
+        uint32_t length{0};
+        uint32_t lengthExpected{0};
+        // crc of all data received so far, updated with every frame
+        uint16_t crc{0xFFFF};
+        uint16_t crcExpected{0};
+        uint32_t uncompressedLength{0};
+        z_stream inflateStream{};
+        bool inflateActive{false};
+        bool inflateFinished{false};
+        unsigned long startTimeINms{0};
+        unsigned long deadlineINms{0};
+        size_t bufferCapacity{0};
+        TransferStatistics statistics{};
+    };
+
+    bool startSession(uint16_t hash, uint32_t streamlength, uint16_t crc);
+
+    // reports the result and removes the session
+    void finishSession(std::map<uint16_t, StreamSession>::iterator session);
+
+    void trackBufferCapacity(StreamSession &stream);
+
+    uint16_t updateCRC(uint16_t CRC_acc, const std::array<uint8_t, 8> &data);
+
+    void endInflate(StreamSession &stream);
+
+    // inflates the frame into the buffer of the session as it arrives
+    void inflateFrame(StreamSession &stream, const std::array<uint8_t, 8> &data);
 
     MaerklinCanInterface &m_interface;
 
     std::vector<MaerklinStationConfig> &m_stationList;
 
-    std::string *m_buffer{nullptr};
+    // requests waiting for their stream, the next started stream takes the oldest one
+    std::deque<PendingRequest> m_pendingRequests;
+
+    std::map<uint16_t, StreamSession> m_sessions;
 
-    // backup buffer to save packages which are received outside of running transmission
-    std::string m_backupBuffer;
+    TransferStatistics m_transferStatistics{};
 
     // void (*m_reportResultFunc)(std::vector<uint8_t>* data, uint16_t hash, bool success){nullptr};
 
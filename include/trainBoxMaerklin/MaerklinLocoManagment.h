@@ -18,8 +18,12 @@
 
 #include <Arduino.h>
 #include <string>
+#include <list>
+#include <map>
 #include <memory>
+#include <functional>
 #include "trainBoxMaerklin/MaerklinConfigDataStream.h"
+#include "Cs2DataParser.h"
 
 // ToDo:
 // handle different files that are received. Currently only locoInfo is used
@@ -30,6 +34,7 @@ public:
     enum class LocoManagmentState : uint8_t
     {
         Idle,
+        WaitingForLocoFile,
         WaitingForLocoList,
         WaitingForLocoNamen,
         WaitingForLocoInfo
@@ -45,17 +50,41 @@ public:
 
     uint32_t getUid();
 
-    void getLokomotiveConfig(void (*writeFileCallback)(std::string *data), void (*resultCallback)(bool success));
+    // locos are written one by one in the order of the loco list. changed is set for locos that are new or
+    // whose lokinfo differs from the last sync, all others are written from the cache
+    void getLokomotiveConfig(void (*writeFileCallback)(std::string *data, bool changed), void (*resultCallback)(bool success));
+
+    // next sync downloads every loco again
+    void clearLocoCache() { m_locoCache.clear(); }
+
+    // crcs of the cached locos with one line "listEntryKnown;listEntryCrc;infoCrc;name" per loco,
+    // stored next to lokomotive.cs2 so the cache survives a restart
+    std::string getLocoCacheIndex() const;
+
+    // rebuilds the cache from a stored index and the locos of the lokomotive.cs2 written with it.
+    // readLoco(offset, length, data) reads one loco of the file, so the file is never loaded at once
+    void restoreLocoCache(const std::string &index, const std::vector<Cs2DataParser::LocoRange> &locos,
+                          std::function<bool(size_t, size_t, std::string &)> readLoco);
 
     std::vector<std::string>* getLocoList() {return &m_locoList;};
 
+    // request zlib compressed lokomotive.cs2 first, loco list and lokinfo are used if it fails
+    void setUseCompressedLocoFile(bool use) { m_useCompressedLocoFile = use; }
+
+    // number of lokinfo requests that are sent without waiting for the answer of the previous ones
+    void setLocoInfoWindow(uint8_t window) { m_locoInfoWindow = (0 == window) ? 1 : window; }
+
 protected:
     // function is called by class ConfigDataStream in case that values where successful received with or without intention
     // or a planed transmission failed
 
-    void m_reportResultFunc(std::string *data, uint16_t hash, bool success) override
+    void m_reportResultFunc(std::string *data, uint16_t hash, bool success, bool requested) override
     {
-        handleConfigDataStreamFeedback(data, hash, success);
+        // streams of other stations are no answer to our requests
+        if (requested)
+        {
+            handleConfigDataStreamFeedback(data, hash, success);
+        }
     }
 
     bool startConfigDataRequest(DataType type, std::string *info, std::string *buffer);
@@ -66,6 +95,58 @@ protected:
 
     void handleConfigDataStreamFeedback(std::string *data, uint16_t hash, bool success);
 
+    enum class LocoInfoState : uint8_t
+    {
+        Pending,
+        Cached,
+        Received,
+        Failed
+    };
+
+    struct LocoInfoRequest
+    {
+        size_t locoNum{0};
+        std::string info;
+        std::string buffer;
+        unsigned long deadlineINms{0};
+        uint8_t repeat{0};
+    };
+
+    // converted loco of the last sync. A loco is only downloaded again if its entry in lokliste changed
+    struct LocoCacheEntry
+    {
+        uint16_t listEntryCrc{0};
+        bool listEntryKnown{false};
+        uint16_t infoCrc{0};
+        std::string cs2Data;
+    };
+
+    void startLocoInfoDownload();
+
+    // writes the locos of a received lokomotive.cs2 one by one
+    void writeLocoFile(std::string *data);
+
+    void dropRemovedLocosFromCache();
+
+    // open requests are cancelled before their buffers are destroyed
+    void cancelLocoInfoRequests();
+
+    // fills the window of requests in flight
+    void requestNextLocoInfos();
+
+    void requestLocoInfo(LocoInfoRequest &request);
+
+    void handleLocoInfoFeedback(std::string *data, bool success);
+
+    // converts the lokinfo of the request into the cache
+    void handleLocoInfo(LocoInfoRequest &request, std::string *data);
+
+    // repeats or gives up every request on its own timeout
+    void handleLocoInfoTimeouts();
+
+    // writes finished locos in the order of the loco list
+    void writeLocoInfos();
+
     // void newLocoList(std::string& locoList);
 
 private:
@@ -94,17 +175,32 @@ private:
 
     std::string m_buffer;
 
-    bool m_isZLib{false};
+    bool m_useCompressedLocoFile{false};
 
     uint16_t m_numberOfLoco{0};
 
-    uint8_t m_currentLocoNum{0};
+    uint8_t m_locoInfoWindow{2};
+
+    std::list<LocoInfoRequest> m_locoInfoRequests;
+
+    std::vector<bool> m_locoInfoChanged;
+
+    // crc of the entry of every loco in lokliste, empty if the names were read with loknamen
+    std::vector<uint16_t> m_locoListEntryCrcs;
+
+    std::map<std::string, LocoCacheEntry> m_locoCache;
+
+    std::vector<LocoInfoState> m_locoInfoStates;
+
+    size_t m_nextLocoInfoNum{0};
+
+    size_t m_nextWrittenLocoInfoNum{0};
 
     uint8_t m_transmissionStarted{false};
 
     void (*m_resultCallback)(bool success){nullptr};
 
-    void (*m_writeFileCallback)(std::string *data){nullptr};
+    void (*m_writeFileCallback)(std::string *data, bool changed){nullptr};
 
     bool m_debug;
 };
\ No newline at end of file
@@ -20,9 +20,12 @@
 
 namespace Udp
 {
+    // one z21 dataset, data is only valid while the message is handled
     typedef struct {
         uint8_t client;
-        uint8_t *data;
+        const uint8_t *data;
+        uint16_t length;             // number of valid bytes at data
+        unsigned long timestampINms; // time of reception, 0 for transmitted messages
     } Message;
 };
 
@@ -36,5 +39,8 @@ public:
 
     virtual bool transmit(Udp::Message &message) = 0;
 
+    // transmit the same message to every client in the list with one call
+    virtual bool transmit(Udp::Message &message, const uint8_t *clients, uint8_t numberOfClients) = 0;
+
     virtual bool receive(Udp::Message &message) = 0;
 };
\ No newline at end of file
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <iostream>
+#include <AsyncUDP.h>
 #include "z21/UdpInterface.h"
 #include <memory>
 
@@ -32,6 +33,14 @@ public:
     byte time; // aktive Zeit
   } listofIP;
 
+  typedef struct
+  {
+    uint32_t packets;           // received datagrams
+    uint32_t datasets;          // z21 datasets handed over to the observers
+    uint32_t malformedDatasets; // datasets dropped because of an implausible length
+    uint32_t bytes;             // received bytes
+  } Statistics;
+
   UdpInterfaceLinux(uint16_t maxNumberOfClients, int16_t port, boolean debug);
   virtual ~UdpInterfaceLinux(){};
 
@@ -40,12 +49,16 @@ public:
 
   bool transmit(Udp::Message &message) override;
 
+  bool transmit(Udp::Message &message, const uint8_t *clients, uint8_t numberOfClients) override;
+
   bool receive(Udp::Message &message) override;
 
   void activateStationBroadcast();
 
+  const Statistics &getStatistics() { return m_statistics; }
+
 protected:
-  void handlePacket(uint8_t client, uint8_t *packet, size_t packetLength);
+  void handlePacket(uint8_t client, const uint8_t *packet, size_t packetLength, unsigned long timestampINms);
 
 private:
   const int m_port;
@@ -60,5 +73,12 @@ private:
   // will store last time of IP decount updated
   unsigned long m_IPpreviousMillis;
 
+  bool m_debug;
+
+  Statistics m_statistics;
+
+  // packet counter at the last report, used to calculate the packet rate
+  uint32_t m_reportedPackets;
+
   byte addIP(IPAddress ip);
 };
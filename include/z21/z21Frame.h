@@ -0,0 +1,120 @@
+/*********************************************************************
+ * z21Frame
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace z21Frame
+{
+    // complete z21 dataset as it is put on the wire:
+    // length (2 byte little endian), header (2 byte little endian), payload and for X-Bus frames the XOR byte
+    template <size_t N>
+    struct Frame
+    {
+        uint8_t data[N];
+
+        constexpr size_t size() const { return N; }
+    };
+
+    constexpr uint16_t headerX{0x40}; // LAN_X_HEADER
+
+    // frame without checksum, e.g. LAN_GET_CODE or LAN_GET_HWINFO
+    template <typename... Bytes>
+    constexpr Frame<sizeof...(Bytes) + 4> make(uint16_t header, Bytes... bytes)
+    {
+        static_assert(sizeof...(Bytes) > 0, "z21 frame without payload");
+        const uint8_t payload[] = {static_cast<uint8_t>(bytes)...};
+        Frame<sizeof...(Bytes) + 4> frame{};
+        frame.data[0] = static_cast<uint8_t>(frame.size() & 0xFF);
+        frame.data[1] = static_cast<uint8_t>(frame.size() >> 8);
+        frame.data[2] = static_cast<uint8_t>(header & 0xFF);
+        frame.data[3] = static_cast<uint8_t>(header >> 8);
+        for (size_t i = 0; i < sizeof...(Bytes); i++)
+        {
+            frame.data[i + 4] = payload[i];
+        }
+        return frame;
+    }
+
+    // LAN_X_HEADER frame, the XOR over X-Header and data bytes is appended
+    template <typename... Bytes>
+    constexpr Frame<sizeof...(Bytes) + 5> makeX(Bytes... bytes)
+    {
+        static_assert(sizeof...(Bytes) > 0, "z21 frame without payload");
+        const uint8_t payload[] = {static_cast<uint8_t>(bytes)...};
+        Frame<sizeof...(Bytes) + 5> frame{};
+        frame.data[0] = static_cast<uint8_t>(frame.size() & 0xFF);
+        frame.data[1] = static_cast<uint8_t>(frame.size() >> 8);
+        frame.data[2] = static_cast<uint8_t>(headerX & 0xFF);
+        frame.data[3] = static_cast<uint8_t>(headerX >> 8);
+        uint8_t xorValue = 0;
+        for (size_t i = 0; i < sizeof...(Bytes); i++)
+        {
+            frame.data[i + 4] = payload[i];
+            xorValue ^= payload[i];
+        }
+        frame.data[frame.size() - 1] = xorValue;
+        return frame;
+    }
+
+    // pre-serialized LAN_X_LOCO_INFO of one loco
+    // every byte change updates the XOR byte directly, so the image can be sent without any further work
+    class LocoInfo
+    {
+    public:
+        enum Index : uint8_t
+        {
+            AdrMsb = 5,
+            AdrLsb = 6,
+            Steps = 7,     // 0=14, 2=28, 4=128, 0x08 busy
+            Speed = 8,     // DSSS SSSS
+            Function0 = 9, // F0, F4, F3, F2, F1 followed by F5-F12, F13-F20, F21-F28 and F29-F31
+            Xor = 14
+        };
+
+        static constexpr uint8_t length{15};
+
+        LocoInfo()
+            : m_data{length, 0x00, static_cast<uint8_t>(headerX & 0xFF), static_cast<uint8_t>(headerX >> 8), xHeaderLocoInfo, 0, 0, 0, 0, 0, 0, 0, 0, 0, xHeaderLocoInfo}
+        {
+        }
+
+        void set(Index index, uint8_t value)
+        {
+            m_data[Xor] ^= m_data[index] ^ value;
+            m_data[index] = value;
+        }
+
+        void setFunctions(uint8_t group, uint8_t value) { set(static_cast<Index>(Function0 + group), value); }
+
+        void setAddress(uint16_t adr)
+        {
+            set(AdrMsb, (adr >> 8) & 0x3F);
+            set(AdrLsb, adr & 0xFF);
+        }
+
+        uint8_t get(Index index) const { return m_data[index]; }
+
+        const uint8_t *data() const { return m_data; }
+
+    private:
+        static constexpr uint8_t xHeaderLocoInfo{0xEF};
+
+        uint8_t m_data[length];
+    };
+}
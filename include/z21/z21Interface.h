@@ -17,6 +17,7 @@
 // include types & constants of Wiring core API
 #include <Arduino.h>
 #include <array>
+#include "z21/z21Frame.h"
 
 //**************************************************************
 #define ZDebug Serial // Port for the Debugging
@@ -215,7 +216,7 @@ protected:
 public:
 	z21Interface(HwType hwType, uint32_t swVersion, boolean debug); // Constuctor
 
-	void receive(uint8_t client, uint8_t *packet); // Pr�fe auf neue Ethernet Daten
+	void receive(uint8_t client, const uint8_t *packet, uint16_t length); // Pr�fe auf neue Ethernet Daten
 
 	void setPower(EnergyState state); // Zustand Gleisspannung Melden
 	EnergyState getPower();			  // Zusand Gleisspannung ausgeben
@@ -242,17 +243,109 @@ public:
 
 	void sendSystemInfo(uint8_t client, uint16_t maincurrent, uint16_t mainvoltage, uint16_t temp); // Send to all clients that request via BC the System Information
 
+	// statistics of the receive dispatcher
+	uint32_t getCommandCounter(uint16_t header, uint8_t xHeader = 0); // number of handled commands with this header (and X-Header)
+	uint32_t getUnknownCommandCounter() { return m_unknownCommandCounter; }
+	uint32_t getInvalidLengthCounter() { return m_invalidLengthCounter; } // datasets dropped because they are too short for their command
+
 	// library-accessible "private" interface
 private:
 	HwType m_hwType;
 
 	uint16_t m_swVersion;
 
+	// replies that only depend on construction parameters, serialized once
+	z21Frame::Frame<12> m_frameHwInfo;
+	z21Frame::Frame<9> m_frameFirmwareVersion;
+	z21Frame::Frame<8> m_frameSerialNumber;
+	bool m_frameSerialNumberValid;
+
 	// Variables:
 	EnergyState m_railPower;					// state of the railpower
 	long z21InterfaceIPpreviousMillis;		// will store last time of IP decount updated
 	TypeActIP ActIP[z21InterfaceclientMAX]; // Speicherarray for IPs
 
+	// receive dispatcher: header/X-Header -> index -> handler with minimal dataset length
+	typedef void (z21Interface::*CommandHandler)(uint8_t client, const uint8_t *packet, uint16_t length);
+
+	struct Command
+	{
+		uint8_t id;		   // Header or X-Header
+		uint8_t minLength; // minimal length of the dataset including length, header and XOR
+		CommandHandler handler;
+	};
+
+	struct CommandIndex
+	{
+		uint8_t slot[256];
+	};
+
+	static constexpr uint8_t noCommand{0xFF};
+	static constexpr uint8_t numberOfCommands{23};
+	static constexpr uint8_t numberOfXCommands{13};
+
+	static const Command s_commands[numberOfCommands];
+	static const Command s_xCommands[numberOfXCommands];
+	static const CommandIndex s_commandIndex;
+	static const CommandIndex s_xCommandIndex;
+
+	template <size_t N>
+	static constexpr CommandIndex makeCommandIndex(const Command (&commands)[N])
+	{
+		CommandIndex index{};
+		for (size_t i = 0; i < 256; i++)
+		{
+			index.slot[i] = noCommand;
+		}
+		for (size_t i = 0; i < N; i++)
+		{
+			index.slot[commands[i].id] = static_cast<uint8_t>(i);
+		}
+		return index;
+	}
+
+	uint32_t m_commandCounter[numberOfCommands];
+	uint32_t m_xCommandCounter[numberOfXCommands];
+	uint32_t m_unknownCommandCounter;
+	uint32_t m_invalidLengthCounter;
+
+	void receiveGetSerialNumber(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetHwInfo(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveLogoff(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetCode(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveX(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXGetSetting(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXCvRead(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXCvWrite(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXDccReadRegister(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXCvPom(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXGetTurnoutInfo(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXSetTurnout(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXSetExtAccessory(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXGetExtAccessoryInfo(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXSetStop(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXGetLocoInfo(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXSetLocoDrive(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveXGetFirmwareVersion(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSetBroadcastFlags(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetBroadcastFlags(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetLocoMode(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSetLocoMode(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetTurnOutMode(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSetTurnOutMode(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveRmBusGetData(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveIgnore(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSystemStateGetData(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveRailcomGetData(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveLocoNetFromLan(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveLocoNetDispatchAddr(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveLocoNetDetector(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveCanDetector(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetConfig1(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSetConfig1(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveGetConfig2(uint8_t client, const uint8_t *packet, uint16_t length);
+	void receiveSetConfig2(uint8_t client, const uint8_t *packet, uint16_t length);
+
 	// Functions:
 	void returnLocoStateFull(uint8_t client, uint16_t Adr, bool bc); // Antwort auf Statusabfrage
 	uint16_t getLocalBcFlag(uint32_t flag);							 // Convert Z21 LAN BC flag to local stored flag
@@ -268,7 +361,10 @@ private:
 protected:
 	boolean m_debug;
 
-	void EthSend(uint8_t client, unsigned int DataLen, z21Interface::Header Header, uint8_t *dataString, boolean withXOR, uint16_t BC);
+	void EthBuild(uint8_t *data, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR);
+	void EthSend(uint8_t client, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR, uint16_t BC);
+	void EthSend(const uint8_t *clients, uint8_t numberOfClients, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR); // one frame to a list of clients
+	void EthSendFrame(uint8_t client, const uint8_t *data, uint16_t BC); // send an already serialized frame
 
 	virtual uint16_t getSerialNumber() = 0;
 
@@ -287,7 +383,11 @@ protected:
 
 	virtual void notifyz21InterfacegetSystemInfo(uint8_t client){};
 
-	virtual void notifyz21InterfaceEthSend(uint8_t client, uint8_t *data) = 0;
+	virtual void notifyz21InterfaceBroadcastFlags(uint8_t client, uint16_t bcFlag){}; // client set new broadcast flags
+
+	virtual void notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data) = 0;
+	virtual void notifyz21InterfaceEthSend(const uint8_t *clients, uint8_t numberOfClients, const uint8_t *data) = 0; // same data to all listed clients
+	virtual void notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data, uint16_t length);						 // several datasets one after another
 
 	virtual void notifyz21InterfaceLNdetector(uint8_t client, uint8_t typ, uint16_t Adr){};
 	virtual uint8_t notifyz21InterfaceLNdispatch(uint16_t Adr) { return 0; };
@@ -38,7 +38,11 @@ class z21InterfaceObserver:public z21Interface, public Observer<Udp::Message>
 
   protected:
 
-	void notifyz21InterfaceEthSend(uint8_t client, uint8_t *data) override;
+	void notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data) override;
+
+	void notifyz21InterfaceEthSend(const uint8_t *clients, uint8_t numberOfClients, const uint8_t *data) override;
+
+	void notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data, uint16_t length) override;
 
   private:
     std::shared_ptr<UdpInterface> m_udpInterface; 
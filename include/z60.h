@@ -20,10 +20,13 @@
 #include "trainBoxMaerklin/MaerklinConfigDataStream.h"
 #include "trainBoxMaerklin/MaerklinStationConfig.h"
 #include "z21/z21InterfaceObserver.h"
+#include "Helper/PackedStateArray.h"
 #include <unordered_map>
-#include <list>
 #include <vector>
 #include <map>
+#include <queue>
+#include <deque>
+#include <functional>
 
 class z60 : public virtual MaerklinCanInterfaceObserver, public virtual z21InterfaceObserver
 {
@@ -43,6 +46,33 @@ public:
         unsigned long lastSpeedCmdTimeINms;
         bool speedResponseReceived;
         std::array<uint8_t, 7> data;
+        z21Frame::LocoInfo locoInfo; // pre-serialized LAN_X_LOCO_INFO
+        uint8_t direction{0};        // last direction sent to trainbox, 0 = unknown
+        bool speedPending{false};    // pendingSpeed was not sent yet
+        bool speedScheduled{false};  // entry in m_speedSchedule exists
+        uint8_t pendingSpeed{0};     // latest z21 speed byte (DSSS SSSS)
+        uint8_t pendingStepConfig{0};
+    };
+
+    struct SpeedDeadline
+    {
+        unsigned long timeINms;
+        size_t slot;
+        uint16_t adrZ21;
+
+        bool operator>(const SpeedDeadline &other) const { return static_cast<long>(timeINms - other.timeINms) > 0; }
+    };
+
+    struct PendingAccessory
+    {
+        uint16_t adrZ21;
+        uint8_t position;
+    };
+
+    struct ActiveCoil
+    {
+        uint16_t adrZ21;
+        unsigned long releaseTimeINms;
     };
 
     struct ConfigLoco
@@ -61,6 +91,17 @@ public:
 
     void deleteLocoConfig();
 
+    // writes pending loco config changes to flash, e.g. before a restart
+    void flushLocoConfig();
+
+    // switch time of a single turnout, 0 uses the default switch time
+    void setTurnoutSwitchTime(uint16_t adrZ21, uint16_t switchTimeIN10ms);
+
+    // turnout positions are kept in flash over a restart, has to be set before begin()
+    void setTurnoutPersistence(bool isActiv) { m_turnoutPersistence = isActiv; }
+
+    void flushTurnouts();
+
     void setProgramming(bool isActiv) { m_programmingActiv = isActiv; }
 
     bool isProgrammingActiv() { return m_programmingActiv; }
@@ -92,6 +133,8 @@ private:
 
     const char *m_keyTurnOutMode{"turnoutmode"};
 
+    const char *m_keyTurnouts{"turnouts"};
+
     const char *m_keyConfig1{"config1"};
 
     const char *m_keyConfig2{"config2"};
@@ -106,7 +149,21 @@ private:
     const uint16_t m_startAdressDcc28{6000};
     const uint16_t m_startAdressDcc128{8000};
 
-    std::list<DataLoco> m_locos;
+    // fixed ring of locos, once m_maxNumberOfLoco is reached the oldest entry is overwritten
+    std::vector<DataLoco> m_locos;
+    size_t m_oldestLoco{0};
+    // slot in m_locos by z21 adress and by trainbox adress (several z21 adresses can share one trainbox adress)
+    std::unordered_map<uint16_t, size_t> m_locoIndexZ21;
+    std::unordered_multimap<uint32_t, size_t> m_locoIndexTrainbox;
+
+    // write-behind of loco config, see saveLocoConfig and cyclic
+    bool m_locoConfigDirty{false};
+    unsigned long m_locoConfigDirtyTimeINms{0};
+    unsigned long m_locoConfigChangedTimeINms{0};
+    const unsigned long m_locoConfigSaveDelayINms{2000};
+    const unsigned long m_maxLocoConfigSaveDelayINms{10000};
+    // loco config as it is currently stored in flash
+    std::vector<uint8_t> m_savedLocoConfig;
 
     // typedef struct
     // {
@@ -125,11 +182,43 @@ private:
 
     MfxDetectionState m_mfxDetectionState {MfxDetectionState::Idle};
 
-    const size_t m_maxNumberOfTurnout{1024};
+    enum class DiscoveryState : uint8_t
+    {
+        Idle = 0,
+        Pinging,
+        Finished
+    };
+
+    // trainbox and mobile stations are searched after begin by up to m_maxDiscoveryPings pings
+    DiscoveryState m_discoveryState{DiscoveryState::Idle};
+    uint8_t m_discoveryPingCounter{0};
+    unsigned long m_nextDiscoveryPingTimeINms{0};
+    const unsigned long m_discoveryStartDelayINms{1000};
+    const unsigned long m_discoveryPingIntervalINms{500};
+    const uint8_t m_maxDiscoveryPings{5};
 
     const uint16_t m_startAdressAccDCC{1000};
 
-    std::unordered_map<uint16_t, uint8_t> m_turnouts;
+    // position of every z21 accessory adress, 0 = unknown, 1 = straight, 2 = diverging
+    PackedStateArray<8192> m_turnouts;
+
+    // accessory commands wait here until less than m_maxActiveCoils coils are powered
+    std::deque<PendingAccessory> m_accessoryQueue;
+    std::vector<ActiveCoil> m_activeCoils;
+    const size_t m_maxActiveCoils{2};
+    const unsigned long m_coilReleaseMarginINms{20};
+    uint16_t m_defaultSwitchTimeIN10ms{20};
+    std::unordered_map<uint16_t, uint16_t> m_turnoutSwitchTimes;
+
+    bool m_turnoutPersistence{false};
+    bool m_turnoutsDirty{false};
+    unsigned long m_turnoutsDirtyTimeINms{0};
+    unsigned long m_turnoutsChangedTimeINms{0};
+
+    // LAN_X_TURNOUT_INFO datasets fitting in one datagram. Kept as member, since the snapshot is built
+    // in the callback of the udp task with its small stack
+    static constexpr uint16_t m_turnoutSnapshotLength{1395};
+    uint8_t m_turnoutSnapshot[m_turnoutSnapshotLength];
 
     // 1024 adresses => 1024/8
     // std::array<uint8_t, 32> turnOutMode;
@@ -139,6 +228,9 @@ private:
 
     const unsigned long minimumCmdIntervalINms{100};
 
+    // locos with a speed waiting for minimumCmdIntervalINms, earliest first
+    std::priority_queue<SpeedDeadline, std::vector<SpeedDeadline>, std::greater<SpeedDeadline>> m_speedSchedule;
+
     std::vector<uint32_t> m_trainboxIdList;
 
     std::vector<MaerklinStationConfig> m_stationList;
@@ -149,20 +241,24 @@ private:
     uint16_t m_voltageINmV{0};
     uint16_t m_tempIN10_2deg{0};
 
-    uint32_t m_lastProgrammingCmdSentTimeINms{0};
-
     std::string m_foundLocoString;
 
     bool m_debug;
 
+    // marks loco config as changed, it is written to flash by cyclic
     void saveLocoConfig();
 
+    void sendPendingLocoSpeed(DataLoco &loco, unsigned long currentTimeINms);
+    void sendScheduledLocoSpeeds(unsigned long currentTimeINms);
+
     // true if emergency stop is activ
-    bool calcSpeedZ21toTrainbox(uint8_t data, uint8_t speedConfig, uint8_t &speed);
+    bool calcSpeedZ21toTrainbox(uint8_t data, uint8_t speedConfig, uint16_t &speed);
 
-    void calcSpeedTrainboxToZ21(uint8_t speed, uint8_t speedConfig, uint8_t &data);
+    void calcSpeedTrainboxToZ21(uint16_t speed, uint8_t speedConfig, uint8_t &data);
 
-    void notifyLocoState(uint8_t client, uint16_t Adr, std::array<uint8_t, 7> &locoData);
+    void notifyLocoState(uint8_t client, DataLoco &loco);
+
+    void handleDiscovery(unsigned long currentTimeINms);
 
     bool getConfig1(std::array<uint8_t, 10> &config) override;
 
@@ -174,7 +270,9 @@ private:
 
     uint16_t getSerialNumber() override;
 
-    void notifyProgrammingCmdSent() override;
+    ProgrammingCallback nackOnTimeout();
+
+    void notifyHashNegotiated() override;
 
     // onCallback
     bool onSystemStop(uint32_t id) override;
@@ -237,6 +335,8 @@ private:
 
     bool onAccSwitch(uint32_t id, uint8_t position, uint8_t current) override;
 
+    bool onAccSwitch(uint32_t id, uint8_t position, uint8_t current, uint16_t switchTimeIN10ms) override;
+
     bool onPing(uint16_t hash, uint32_t id, uint16_t swVersion, uint16_t hwIdent) override;
 
     bool onStatusDataConfig(uint16_t hash, std::array<uint8_t, 8> &data) override;
@@ -256,6 +356,9 @@ private:
     // Z21
 
     void addToLocoList(uint16_t adr, uint8_t mode, uint8_t steps);
+    DataLoco *findLoco(uint16_t adrZ21);
+    void insertLoco(const DataLoco &loco);
+    void setLocoTrainboxAdr(DataLoco &loco, uint16_t adrTrainbox);
     uint16_t fromZ21AdrToTrainboxAdr(uint16_t adr, uint8_t mode);
     void handleGetLocoMode(uint16_t adr, uint8_t &mode) override;
     void handleSetLocoMode(uint16_t adr, uint8_t mode) override;
@@ -282,6 +385,15 @@ private:
     void notifyz21InterfaceDCCWRITE(uint8_t regAdr, uint8_t value) override;
     void notifyz21InterfaceDCCREAD(uint8_t regAdr) override;
 
+    void setTurnoutPosition(uint16_t adr, uint8_t position);
+    uint32_t fromZ21AdrToTrainboxAccAdr(uint16_t adr);
+
+    uint16_t fromTrainboxAccAdrToZ21Adr(uint32_t adrTurnOut);
+    void handleAccessoryQueue(unsigned long currentTimeINms);
+    void sendTurnoutSnapshot(uint8_t client);
+
+    void notifyz21InterfaceBroadcastFlags(uint8_t client, uint16_t bcFlag) override;
+
     void notifyz21InterfaceAccessoryInfo(uint16_t Adr, uint8_t &position) override;
     void notifyz21InterfaceAccessory(uint16_t Adr, bool state, bool active) override;
 
@@ -15,6 +15,7 @@
  */
 
 #include "Cs2DataParser.h"
+#include <algorithm>
 
 static const std::vector<Cs2DataParser::LocoFunctionType> functionType = {
     {" ", " ", 0},
@@ -117,123 +118,335 @@ static const std::vector<Cs2DataParser::LocoFunctionType> functionType = {
     {"Rechts", "", 1},
     {"Drehen rechts", "", 1},
     {"Magnet", "", 0}};
-bool Cs2DataParser::parseCs2ToLocoData(std::string *data, LocoData &locoData)
+
+namespace
 {
-    bool result{false};
-    // Serial.println("check string");
-    // Serial.println(data->c_str());
-    auto n = data->find("lokomotive\n");
-    // text starts at beginning
-    if (0 == n)
+    enum class FunctionBlockType : uint8_t
+    {
+        None,
+        Functions,
+        SecondFunctions
+    };
+
+    // values of one .funktionen or .funktionen_2 block while it is read
+    struct FunctionBlock
+    {
+        FunctionBlockType blockType{FunctionBlockType::None};
+        bool numberFound{false};
+        bool typeFound{false};
+        uint16_t number{0};
+        uint16_t type{0};
+        uint16_t time{0};
+    };
+
+    void addFunction(const FunctionBlock &block, std::vector<Cs2DataParser::FunctionData> &functionData)
+    {
+        if ((FunctionBlockType::None == block.blockType) || !block.numberFound || !block.typeFound)
+        {
+            return;
+        }
+        // type 1 of .funktionen_2 is not used as well
+        if ((0 == block.type) || ((FunctionBlockType::SecondFunctions == block.blockType) && (1 == block.type)))
+        {
+            return;
+        }
+        if (functionType.size() > block.type)
+        {
+            functionData.emplace_back(Cs2DataParser::FunctionData{functionType[block.type].iconName, functionType[block.type].shortcut, block.number, functionType[block.type].buttonType, block.time});
+        }
+        else
+        {
+            functionData.emplace_back(Cs2DataParser::FunctionData{"weight", "unknown", block.number, 0, block.time});
+        }
+    }
+}
+
+bool Cs2DataParser::Text::equals(const char *text) const
+{
+    return (strlen(text) == length) && (0 == memcmp(data, text, length));
+}
+
+bool Cs2DataParser::Tokenizer::next(Token &token)
+{
+    while (m_current < m_end)
+    {
+        const char *begin = m_current;
+        const char *end = static_cast<const char *>(memchr(begin, '\n', m_end - begin));
+        if (nullptr == end)
+        {
+            end = m_end;
+            m_current = m_end;
+        }
+        else
+        {
+            m_current = end + 1;
+        }
+        if ((end > begin) && ('\r' == *(end - 1)))
+        {
+            end--;
+        }
+        while ((begin < end) && (' ' == *begin))
+        {
+            begin++;
+        }
+        // empty lines are skipped
+        if (begin == end)
+        {
+            continue;
+        }
+        token.depth = 0;
+        while ((begin < end) && ('.' == *begin))
+        {
+            token.depth++;
+            begin++;
+        }
+        const char *separator = static_cast<const char *>(memchr(begin, '=', end - begin));
+        token.hasValue = (nullptr != separator);
+        if (nullptr == separator)
+        {
+            token.key = Text{begin, static_cast<size_t>(end - begin)};
+            token.value = Text{end, 0};
+        }
+        else
+        {
+            token.key = Text{begin, static_cast<size_t>(separator - begin)};
+            token.value = Text{separator + 1, static_cast<size_t>(end - separator - 1)};
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Cs2DataParser::parseNumber(const Text &text, uint16_t &result, uint8_t base)
+{
+    const char *current = text.data;
+    const char *end = text.data + text.length;
+    while ((current < end) && (' ' == *current))
+    {
+        current++;
+    }
+    if ((16 == base) && ((end - current) > 2) && ('0' == current[0]) && ('x' == (current[1] | 0x20)))
+    {
+        current += 2;
+    }
+    uint32_t value = 0;
+    bool found = false;
+    for (; current < end; current++)
+    {
+        uint8_t digit;
+        if ((*current >= '0') && (*current <= '9'))
+        {
+            digit = *current - '0';
+        }
+        else if (((*current | 0x20) >= 'a') && ((*current | 0x20) <= 'f'))
+        {
+            digit = (*current | 0x20) - 'a' + 10;
+        }
+        else
+        {
+            break;
+        }
+        if (digit >= base)
+        {
+            break;
+        }
+        value = value * base + digit;
+        found = true;
+    }
+    if (found)
+    {
+        result = static_cast<uint16_t>(value);
+    }
+    return found;
+}
+
+Cs2DataParser::LocoIndexer::LocoIndexer(std::vector<LocoRange> &locos)
+    : m_locos(locos)
+{
+    m_locos.clear();
+}
+
+void Cs2DataParser::LocoIndexer::add(const char *data, size_t length)
+{
+    const char *current = data;
+    const char *end = data + length;
+    while (current < end)
     {
-        std::string::size_type pos = getParameter(data, ".name=", locoData.name);
-        pos = getParameterHex(data, ".adresse=", locoData.adress);
-        std::string adressType;
-        pos = getParameter(data, ".typ=", adressType);
-        if ("mm" == adressType || "mm2_prg" == adressType || "mm2_lok" == adressType || "mm2_dil8" == adressType)
+        const char *lineEnd = static_cast<const char *>(memchr(current, '\n', end - current));
+        if (nullptr == lineEnd)
         {
-            locoData.adress += 2000;
+            if (m_line.empty())
+            {
+                m_lineOffset = m_position + (current - data);
+            }
+            m_line.append(current, end - current);
+            break;
+        }
+        if (m_line.empty())
+        {
+            addLine(current, lineEnd - current, m_position + (current - data));
         }
-        else if ("dcc")
+        else
         {
-            locoData.adress += 8000;
+            m_line.append(current, lineEnd - current);
+            addLine(m_line.data(), m_line.size(), m_lineOffset);
+            m_line.clear();
         }
-        else if ("mfx")
+        current = lineEnd + 1;
+    }
+    m_position += length;
+}
+
+void Cs2DataParser::LocoIndexer::finish()
+{
+    if (!m_line.empty())
+    {
+        addLine(m_line.data(), m_line.size(), m_lineOffset);
+        m_line.clear();
+    }
+    if (m_inLoco)
+    {
+        m_locos.back().length = m_position - m_locos.back().offset;
+        m_inLoco = false;
+    }
+    m_locos.erase(std::remove_if(m_locos.begin(), m_locos.end(), [](const LocoRange &loco)
+                                 { return loco.name.empty(); }),
+                  m_locos.end());
+}
+
+void Cs2DataParser::LocoIndexer::addLine(const char *line, size_t length, size_t offset)
+{
+    Tokenizer tokenizer(line, length);
+    Token token;
+    if (!tokenizer.next(token))
+    {
+        return;
+    }
+    size_t keyOffset = offset + (token.key.data - line);
+    if (0 == token.depth)
+    {
+        // every line without dots ends the loco before
+        if (m_inLoco)
         {
-            locoData.adress += 4000;
+            m_locos.back().length = keyOffset - m_locos.back().offset;
         }
-        std::string::size_type startPos = pos;
-        std::string::size_type funktionenLength = sizeof(".funktionen\n");
-        for (pos = data->find(".funktionen\n", pos); std::string::npos != pos; pos = data->find(".funktionen\n", pos))
+        m_inLoco = token.key.equals("lokomotive");
+        if (m_inLoco)
         {
-            pos += funktionenLength;
-            uint16_t fktNum = 0;
-            if (std::string::npos == getParameter(data, "..nr=", fktNum, pos))
+            m_locos.emplace_back(LocoRange{std::string(), keyOffset, 0});
+        }
+    }
+    else if (m_inLoco && (1 == token.depth) && m_locos.back().name.empty() && token.key.equals("name"))
+    {
+        m_locos.back().name = token.value.toString();
+    }
+}
+
+void Cs2DataParser::indexLocos(const char *data, size_t length, std::vector<LocoRange> &locos)
+{
+    LocoIndexer indexer(locos);
+    indexer.add(data, length);
+    indexer.finish();
+}
+
+bool Cs2DataParser::parseCs2ToLocoData(std::string *data, LocoData &locoData)
+{
+    // text starts at beginning
+    if ((nullptr == data) || (0 != data->compare(0, strlen("lokomotive\n"), "lokomotive\n")))
+    {
+        return false;
+    }
+    Tokenizer tokenizer(*data);
+    Token token;
+    // section name
+    tokenizer.next(token);
+
+    locoData.name.clear();
+    locoData.adress = 0;
+    locoData.functionData.clear();
+    Text adressType{nullptr, 0};
+    // functions of .funktionen_2 are added behind the ones of .funktionen
+    std::vector<FunctionData> secondFunctionData;
+    FunctionBlock block;
+    // only the first loco is read if there are more in the data
+    while (tokenizer.next(token) && (0 != token.depth))
+    {
+        if (1 == token.depth)
+        {
+            addFunction(block, (FunctionBlockType::SecondFunctions == block.blockType) ? secondFunctionData : locoData.functionData);
+            block = FunctionBlock{};
+            if (token.key.equals("name"))
             {
-                continue;
+                locoData.name = token.value.toString();
             }
-            uint16_t fktType = 0;
-            if (std::string::npos == getParameter(data, "..typ=", fktType, pos))
+            else if (token.key.equals("adresse"))
             {
-                continue;
+                parseNumber(token.value, locoData.adress, 16);
             }
-            uint16_t fktTime = 0;
-            getParameter(data, "..dauer=", fktTime, pos);
-            // uint16_t fktValue = 0;
-            // getParameter(data, "..wert=", fktValue, pos);
-            if (0 != fktType)
+            else if (token.key.equals("typ"))
             {
-                if (functionType.size() > fktType)
-                {
-                    locoData.functionData.emplace_back(FunctionData{functionType[fktType].iconName, functionType[fktType].shortcut, fktNum, functionType[fktType].buttonType, fktTime});
-                }
-                else
-                {
-                    locoData.functionData.emplace_back(FunctionData{"weight", "unknown", fktNum, 0, fktTime});
-                }
+                adressType = token.value;
+            }
+            else if (token.key.equals("funktionen"))
+            {
+                block.blockType = FunctionBlockType::Functions;
+            }
+            else if (token.key.equals("funktionen_2"))
+            {
+                block.blockType = FunctionBlockType::SecondFunctions;
             }
-            startPos = pos;
         }
-        pos = startPos;
-
-        funktionenLength = sizeof(".funktionen_2\n");
-        for (pos = data->find(".funktionen_2\n", pos); std::string::npos != pos; pos = data->find(".funktionen_2\n", pos))
+        else if ((2 == token.depth) && (FunctionBlockType::None != block.blockType))
         {
-            pos += funktionenLength;
-            uint16_t fktNum = 0;
-            if (std::string::npos == getParameter(data, "..nr=", fktNum, pos))
+            if (token.key.equals("nr"))
             {
-                continue;
+                block.numberFound = parseNumber(token.value, block.number);
             }
-            uint16_t fktType = 0;
-            if (std::string::npos == getParameter(data, "..typ=", fktType, pos))
+            else if (token.key.equals("typ"))
             {
-                continue;
+                block.typeFound = parseNumber(token.value, block.type);
             }
-            uint16_t fktTime = 0;
-            getParameter(data, "..dauer=", fktTime, pos);
-            // uint16_t fktValue = 0;
-            // getParameter(data, "..wert=", fktValue, pos);
-            if ((0 != fktType) && (1 != fktType))
+            else if (token.key.equals("dauer"))
             {
-                if (functionType.size() > fktType)
-                {
-                    locoData.functionData.emplace_back(FunctionData{functionType[fktType].iconName, functionType[fktType].shortcut, fktNum, functionType[fktType].buttonType, fktTime});
-                }
-                else
-                {
-                    locoData.functionData.emplace_back(FunctionData{"weight", "unknown", fktNum, 0, fktTime});
-                }
+                parseNumber(token.value, block.time);
             }
         }
-        result = true;
     }
-    return result;
-};
+    addFunction(block, (FunctionBlockType::SecondFunctions == block.blockType) ? secondFunctionData : locoData.functionData);
+    locoData.functionData.insert(locoData.functionData.end(), secondFunctionData.begin(), secondFunctionData.end());
+
+    if (adressType.equals("mm") || adressType.equals("mm2_prg") || adressType.equals("mm2_lok") || adressType.equals("mm2_dil8"))
+    {
+        locoData.adress += 2000;
+    }
+    else if (adressType.equals("dcc"))
+    {
+        locoData.adress += 8000;
+    }
+    else if (adressType.equals("mfx"))
+    {
+        locoData.adress += 4000;
+    }
+    return true;
+}
 
-std::string::size_type Cs2DataParser::getParameterHex(std::string *data, std::string parameter, uint16_t &result, std::string::size_type startpos)
+std::string::size_type Cs2DataParser::getParameterHex(std::string *data, const std::string &parameter, uint16_t &result, std::string::size_type startpos)
 {
     std::string dummy;
     std::string::size_type rv = getParameter(data, parameter, dummy, startpos);
-    if (!dummy.empty())
-    {
-        result = static_cast<uint16_t>(std::stoul(dummy, nullptr, 16));
-    }
+    parseNumber(Text{dummy.data(), dummy.size()}, result, 16);
     return rv;
 }
 
-std::string::size_type Cs2DataParser::getParameter(std::string *data, std::string parameter, uint16_t &result, std::string::size_type startpos)
+std::string::size_type Cs2DataParser::getParameter(std::string *data, const std::string &parameter, uint16_t &result, std::string::size_type startpos)
 {
     std::string dummy;
     std::string::size_type rv = getParameter(data, parameter, dummy, startpos);
-    if (!dummy.empty())
-    {
-        result = static_cast<uint16_t>(std::stoul(dummy, nullptr, 10));
-    }
+    parseNumber(Text{dummy.data(), dummy.size()}, result, 10);
     return rv;
 }
 
-std::string::size_type Cs2DataParser::getParameter(std::string *data, std::string parameter, std::string &result, std::string::size_type startpos)
+std::string::size_type Cs2DataParser::getParameter(std::string *data, const std::string &parameter, std::string &result, std::string::size_type startpos)
 {
     std::string::size_type length = parameter.length();
     std::string::size_type start = data->find(parameter, startpos);
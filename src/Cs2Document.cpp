@@ -0,0 +1,183 @@
+/*********************************************************************
+ * TrainBox Maerklin CS2 Document
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#include "Cs2Document.h"
+
+Cs2Document::Cs2Document(size_t arenaBlockSize)
+    : m_arena(arenaBlockSize)
+{
+    clear();
+}
+
+Cs2Document::~Cs2Document()
+{
+}
+
+bool Cs2Document::parse(const char *data, size_t length)
+{
+    clear();
+    if (nullptr == data)
+    {
+        return false;
+    }
+    // tokens point into the copy, so nothing is copied line by line
+    Cs2DataParser::Tokenizer tokenizer(m_arena.copy(data, length), length);
+    Cs2DataParser::Token token;
+    Node *current = m_root;
+    while (tokenizer.next(token))
+    {
+        // a line belongs to the last line with less dots
+        Node *parent = current;
+        while ((nullptr != parent->parent) && (parent->depth >= token.depth))
+        {
+            parent = parent->parent;
+        }
+        current = createNode(parent, token.depth, token.hasValue, token.key, token.value);
+    }
+    return true;
+}
+
+void Cs2Document::clear()
+{
+    m_arena.clear();
+    m_root = createNode(nullptr, 0, false, Cs2DataParser::Text{"", 0}, Cs2DataParser::Text{"", 0});
+}
+
+Cs2Document::Node *Cs2Document::findChild(Node *parent, const char *key, Node *after)
+{
+    if (nullptr == parent)
+    {
+        return nullptr;
+    }
+    for (Node *child = (nullptr == after) ? parent->firstChild : after->next; nullptr != child; child = child->next)
+    {
+        if (child->key.equals(key))
+        {
+            return child;
+        }
+    }
+    return nullptr;
+}
+
+Cs2Document::Node *Cs2Document::addChild(Node *parent, const char *key, const char *value)
+{
+    if (nullptr == parent)
+    {
+        return nullptr;
+    }
+    size_t keyLength = strlen(key);
+    Cs2DataParser::Text keyText{m_arena.copy(key, keyLength), keyLength};
+    Cs2DataParser::Text valueText{"", 0};
+    if (nullptr != value)
+    {
+        size_t valueLength = strlen(value);
+        valueText = Cs2DataParser::Text{m_arena.copy(value, valueLength), valueLength};
+    }
+    uint8_t depth = (nullptr == parent->parent) ? 0 : parent->depth + 1;
+    return createNode(parent, depth, nullptr != value, keyText, valueText);
+}
+
+void Cs2Document::setValue(Node *node, const char *value, size_t length)
+{
+    if (nullptr == node)
+    {
+        return;
+    }
+    node->value = Cs2DataParser::Text{m_arena.copy(value, length), length};
+    node->hasValue = true;
+}
+
+bool Cs2Document::removeChild(Node *parent, Node *child)
+{
+    if ((nullptr == parent) || (nullptr == child) || (child->parent != parent))
+    {
+        return false;
+    }
+    Node *previous = nullptr;
+    for (Node *node = parent->firstChild; node != child; node = node->next)
+    {
+        previous = node;
+    }
+    if (nullptr == previous)
+    {
+        parent->firstChild = child->next;
+    }
+    else
+    {
+        previous->next = child->next;
+    }
+    if (parent->lastChild == child)
+    {
+        parent->lastChild = previous;
+    }
+    child->parent = nullptr;
+    child->next = nullptr;
+    return true;
+}
+
+size_t Cs2Document::getSerializedLength() const
+{
+    size_t length = 0;
+    serialize([&length](const char *data, size_t partLength)
+              { length += partLength; });
+    return length;
+}
+
+std::string Cs2Document::toString() const
+{
+    std::string result;
+    result.reserve(getSerializedLength());
+    serialize([&result](const char *data, size_t length)
+              { result.append(data, length); });
+    return result;
+}
+
+Cs2Document::Node *Cs2Document::createNode(Node *parent, uint8_t depth, bool hasValue, Cs2DataParser::Text key, Cs2DataParser::Text value)
+{
+    Node *node = m_arena.create<Node>();
+    node->depth = depth;
+    node->hasValue = hasValue;
+    node->key = key;
+    node->value = value;
+    node->parent = parent;
+    if (nullptr != parent)
+    {
+        if (nullptr == parent->lastChild)
+        {
+            parent->firstChild = node;
+        }
+        else
+        {
+            parent->lastChild->next = node;
+        }
+        parent->lastChild = node;
+    }
+    return node;
+}
+
+const Cs2Document::Node *Cs2Document::nextNode(const Node *node)
+{
+    // depth first without recursion
+    if (nullptr != node->firstChild)
+    {
+        return node->firstChild;
+    }
+    while ((nullptr != node) && (nullptr == node->next))
+    {
+        node = node->parent;
+    }
+    return (nullptr == node) ? nullptr : node->next;
+}
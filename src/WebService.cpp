@@ -1,5 +1,6 @@
 #include "WebService.h"
 #include <map>
+#include <algorithm>
 #include <ESPmDNS.h>
 
 WebService *WebService::m_instance{nullptr};
@@ -11,6 +12,8 @@ WebService::WebService()
       m_defaultLocoCs2("defaultLocoCs2", "defaultLocoCs2", "Set lokomotive.cs2 back to default values", false),
       m_progActive("progActive", "progActive", "Trackprogramming activ", false),
       m_readingLoco("readingLoco", "readingLoco", "Read locos from Mobile Station", false),
+      m_compressedLocoFile("compressedLocoFile", "compressedLocoFile", "Read compressed lokomotive.cs2 (CS2/CS3 only)", false),
+      m_fullLocoSync("fullLocoSync", "fullLocoSync", "Read all locos again, e.g. after changing functions", false),
       m_saveButton("saveButton", "Run", "/z60configstatus"),
       m_getZ21DbButton("getZ21DbButton", "Download Z21 Database", "/z21.html"),
       m_auxZ60ConfigStatus("/z60configstatus", "Config Status"),
@@ -33,74 +36,50 @@ WebService::WebService()
                         Serial.println("Can requested");
                         m_WebServer.send(200, "", ""); });
 
-    m_WebServer.on("/config/prefs.cs2", [this]()
+    // fixed config files are sent from flash without a copy
+    addDocument("/config/prefs.cs2",
+                "[Preferences]\nversion\n .major=0\n .minor=1\npage\n .entry\n ..key=Version\n ..value=\n"
+                "page\n .entry\n ..key=SerNum\n ..value=84\n .entry\n ..key=GfpUid\n ..value=1129525928\n .entry\n ..key=GuiUid\n"
+                " ..value=1129525929\n .entry\n ..key=HardVers\n ..value=3.1\n");
+
+    addDocument("/config/magnetartikel.cs2",
+                "[magnetartikel]\n"
+                "version\n"
+                " .minor=1\n");
+
+    addDocument("/config/gleisbild.cs2",
+                "[gleisbild]\n"
+                "version\n"
+                " .major=1\n"
+                "groesse\n"
+                "zuletztBenutzt\n"
+                " .name=gleisbildDummy\n"
+                "seite\n"
+                " .name=gleisbildDummy\n");
+
+    addDocument("/config/fahrstrassen.cs2",
+                "[fahrstrassen]\n"
+                "version\n"
+                " .minor=4\n");
+
+    addDocument("/config/gleisbilder/gleisbildDummy.cs2",
+                "[gleisbildseite]\n"
+                "version\n"
+                " .major=1\n");
+
+    addDocument("/config/geraet.vrs",
+                "[geraet]\n"
+                "version\n"
+                " .minor=1\n"
+                "geraet\n"
+                " .sernum=1\n"
+                " .hardvers=ESP,1\n");
+
+    // single loco of lokomotive.cs2 without reading the rest of the file
+    m_WebServer.on("/config/loco", [this]()
                    {
-                        Serial.println("prefs requested");
-                        m_WebServer.send(200, "text/plain", 
-                        F(
-                            "[Preferences]\nversion\n .major=0\n .minor=1\npage\n .entry\n ..key=Version\n ..value=\n"
-                            "page\n .entry\n ..key=SerNum\n ..value=84\n .entry\n ..key=GfpUid\n ..value=1129525928\n .entry\n ..key=GuiUid\n"
-                            " ..value=1129525929\n .entry\n ..key=HardVers\n ..value=3.1\n"
-                        )); });
-
-    m_WebServer.on("/config/magnetartikel.cs2", [this]()
-                   {
-                        Serial.println("magnetartikel requested");
-                        m_WebServer.send(200, "text/plain",
-                        F(
-                            "[magnetartikel]\n"
-                            "version\n"
-                            " .minor=1\n"
-                        )); });
-
-    m_WebServer.on("/config/gleisbild.cs2", [this]()
-                   {
-                        Serial.println("gleisbild requested");
-                        m_WebServer.send(200, "text/plain",
-                        F(
-                            "[gleisbild]\n"
-                            "version\n"
-                            " .major=1\n"
-                            "groesse\n"
-                            "zuletztBenutzt\n"
-                            " .name=gleisbildDummy\n"
-                            "seite\n"
-                            " .name=gleisbildDummy\n"
-                        )); });
-
-    m_WebServer.on("/config/fahrstrassen.cs2", [this]()
-                   {
-                        Serial.println("fahrstrassen requested");
-                        m_WebServer.send(200, "text/plain",
-                        F(
-                            "[fahrstrassen]\n"
-                            "version\n"
-                            " .minor=4\n"
-                        )); });
-
-    m_WebServer.on("/config/gleisbilder/gleisbildDummy.cs2", [this]()
-                   {
-                        Serial.println("gleisbildDummy requested");
-                        m_WebServer.send(200, "text/plain",
-                        F(
-                            "[gleisbildseite]\n"
-                            "version\n"
-                            " .major=1\n"
-                        )); });
-
-    m_WebServer.on("/config/geraet.vrs", [this]()
-                   {
-                        Serial.println("geraet requested");
-                        m_WebServer.send(200, "text/plain",
-                        F(
-                            "[geraet]\n"
-                            "version\n"
-                            " .minor=1\n"
-                            "geraet\n"
-                            " .sernum=1\n"
-                            " .hardvers=ESP,1\n"
-                            ""
-                        )); });
+                        Serial.println("loco requested");
+                        sendLoco(m_WebServer.arg("name")); });
 
     // m_WebServer.on("/ajaxlokliste", [this]()
     //                {
@@ -139,8 +118,28 @@ void WebService::cyclic()
     m_AutoConnect.handleClient();
 }
 
+void WebService::addDocument(const std::string &path, const char *content)
+{
+    m_documents[path] = content;
+    m_WebServer.on(path.c_str(), [this, path]()
+                   {
+                        Serial.printf("%s requested\n", path.c_str());
+                        sendDocument(path); });
+}
+
+void WebService::sendDocument(const std::string &path)
+{
+    auto configDocument = m_documents.find(path);
+    if (configDocument == m_documents.end())
+    {
+        m_WebServer.send(404, "text/plain", "document not available");
+        return;
+    }
+    m_WebServer.send_P(200, "text/plain", configDocument->second);
+}
+
 void WebService::begin(AutoConnectConfig &autoConnectConfig, std::function<void(void)> deleteLocoConfigFkt, std::function<void(void)> defaultLocoListFkt,
-                       std::function<void(bool)> programmingFkt, std::function<void(void)> readingFkt, std::function<void(void)> searchMotorolaFkt,
+                       std::function<void(bool)> programmingFkt, std::function<void(bool, bool)> readingFkt, std::function<void(void)> searchMotorolaFkt,
                        std::function<void(void)> searchDccShortFkt, std::function<void(void)> searchDccLongFkt, std::string* foundLocoString)
 {
     m_programmingFkt = programmingFkt;
@@ -186,7 +185,7 @@ void WebService::begin(AutoConnectConfig &autoConnectConfig, std::function<void(
                                     if (m_WebServer.hasArg("readingLoco"))
                                     {
                                         Serial.println("trigger loco reading");
-                                        m_readingFkt();
+                                        m_readingFkt(m_WebServer.hasArg("compressedLocoFile"), m_WebServer.hasArg("fullLocoSync"));
                                     }
                                 }
                             if(m_transmissionFinished)
@@ -218,7 +217,7 @@ void WebService::begin(AutoConnectConfig &autoConnectConfig, std::function<void(
 
     m_AutoConnect.onNotFound(WebService::handleNotFound);
 
-    m_auxZ60Config.add({m_deleteLocoConfig, m_defaultLocoCs2, m_progActive, m_readingLoco, m_saveButton, m_getZ21DbButton});
+    m_auxZ60Config.add({m_deleteLocoConfig, m_defaultLocoCs2, m_progActive, m_readingLoco, m_compressedLocoFile, m_fullLocoSync, m_saveButton, m_getZ21DbButton});
     m_auxZ60ConfigStatus.add({m_readingStatus, m_locoNames, m_reloadButton, m_getZ21DbButton});
 
     m_AutoConnect.join(m_auxZ60Config);
@@ -275,9 +274,82 @@ void WebService::begin(AutoConnectConfig &autoConnectConfig, std::function<void(
     }
 }
 
+bool WebService::updateLocoIndex()
+{
+    if (m_locoIndexValid)
+    {
+        return true;
+    }
+    File lokomotiveFile = SPIFFS.open("/config/lokomotive.cs2", "r");
+    if (!lokomotiveFile)
+    {
+        return false;
+    }
+    // file may be larger than the free heap, so it is read in parts
+    Cs2DataParser::LocoIndexer indexer(m_locoIndex);
+    uint8_t buffer[512];
+    size_t length;
+    while ((length = lokomotiveFile.read(buffer, sizeof(buffer))) > 0)
+    {
+        indexer.add(reinterpret_cast<const char *>(buffer), length);
+    }
+    indexer.finish();
+    lokomotiveFile.close();
+    m_locoIndexValid = true;
+    return true;
+}
+
+void WebService::invalidateLocoIndex()
+{
+    m_locoIndex.clear();
+    m_locoIndexValid = false;
+}
+
+void WebService::sendLoco(const String &name)
+{
+    if (!m_lokomotiveAvailable || !updateLocoIndex())
+    {
+        m_WebServer.send(404, "text/plain", "lokomotive.cs2 not available");
+        return;
+    }
+    auto loco = std::find_if(m_locoIndex.begin(), m_locoIndex.end(), [&name](const Cs2DataParser::LocoRange &range)
+                             { return 0 == strcmp(range.name.c_str(), name.c_str()); });
+    if (loco == m_locoIndex.end())
+    {
+        m_WebServer.send(404, "text/plain", (name + " not available").c_str());
+        return;
+    }
+    File lokomotiveFile = SPIFFS.open("/config/lokomotive.cs2", "r");
+    if (!lokomotiveFile || !lokomotiveFile.seek(loco->offset))
+    {
+        m_WebServer.send(404, "text/plain", "lokomotive.cs2 not available");
+        return;
+    }
+    const char header[]{"[lokomotive]\n"};
+    m_WebServer.setContentLength(strlen(header) + loco->length);
+    m_WebServer.send(200, "text/plain", "");
+    m_WebServer.sendContent(header, strlen(header));
+    // only the range of the loco is read
+    char buffer[512];
+    size_t left = loco->length;
+    while (left > 0)
+    {
+        size_t length = lokomotiveFile.read(reinterpret_cast<uint8_t *>(buffer), (left < sizeof(buffer)) ? left : sizeof(buffer));
+        if (0 == length)
+        {
+            break;
+        }
+        m_WebServer.sendContent(buffer, length);
+        left -= length;
+    }
+    lokomotiveFile.close();
+}
+
 void WebService::setLokomotiveAvailable(bool isAvailable)
 {
     m_lokomotiveAvailable = isAvailable;
+    // file was written or is written now
+    invalidateLocoIndex();
 }
 
 void WebService::setTransmissionFinished(bool hasFinished)
@@ -370,6 +442,9 @@ String WebService::postUpload(AutoConnectAux &aux, PageArgument &args)
             SPIFFS.remove("/config/lokomotive.cs2");
         }
         SPIFFS.rename(String("/" + upload.value).c_str(), "/config/lokomotive.cs2");
+        // loco cache belongs to the replaced file
+        SPIFFS.remove("/config/lokomotive.crc");
+        m_instance->invalidateLocoIndex();
     }
     else
     {
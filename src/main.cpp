@@ -37,6 +37,8 @@ const uint16_t hash{0};
 const uint32_t serialNumber{0xFFFFFFF0};
 const uint16_t swVersion{0x0142};
 const int16_t z21Port{21105};
+// turnout positions are restored after a restart
+const bool turnoutPersistence{true};
 
 std::shared_ptr<UdpInterfaceEsp32> udpInterface = std::make_shared<UdpInterfaceEsp32>(30, z21Port, false);
 
@@ -54,6 +56,25 @@ uint16_t locoId{1};
 uint16_t functionId{1};
 sqlite3 *z21Database;
 
+// values are bound instead of pasted into the statement, loco names may contain quotes
+bool executeSql(const std::string &sql, std::function<void(sqlite3_stmt *)> bindValues)
+{
+  sqlite3_stmt *statement{nullptr};
+  if (SQLITE_OK != sqlite3_prepare_v2(z21Database, sql.c_str(), -1, &statement, nullptr))
+  {
+    Serial.printf("SQL error: %s | %s\n", sqlite3_errmsg(z21Database), sql.c_str());
+    return false;
+  }
+  bindValues(statement);
+  int result = sqlite3_step(statement);
+  if (SQLITE_DONE != result)
+  {
+    Serial.printf("SQL error: %s | %s\n", sqlite3_errmsg(z21Database), sql.c_str());
+  }
+  sqlite3_finalize(statement);
+  return SQLITE_DONE == result;
+}
+
 /**********************************************************************************/
 void setup()
 {
@@ -67,6 +88,34 @@ void setup()
       ;
   }
 
+  // cache of the last loco sync, so the next one only downloads locos that changed
+  File locoCacheIndex = SPIFFS.open("/config/lokomotive.crc", "r");
+  if (locoCacheIndex)
+  {
+    std::string index = locoCacheIndex.readString().c_str();
+    locoCacheIndex.close();
+    File lokomotiveFile = SPIFFS.open("/config/lokomotive.cs2", "r");
+    if (lokomotiveFile)
+    {
+      // file is read in parts, only the cached locos are kept
+      std::vector<Cs2DataParser::LocoRange> locos;
+      Cs2DataParser::LocoIndexer indexer(locos);
+      char buffer[512];
+      size_t readLength;
+      while ((readLength = lokomotiveFile.read(reinterpret_cast<uint8_t *>(buffer), sizeof(buffer))) > 0)
+      {
+        indexer.add(buffer, readLength);
+      }
+      indexer.finish();
+      locoManagment.restoreLocoCache(index, locos, [&lokomotiveFile](size_t offset, size_t length, std::string &data) -> bool
+                                     {
+                                       data.resize(length);
+                                       return lokomotiveFile.seek(offset) && (length == lokomotiveFile.read(reinterpret_cast<uint8_t *>(&data[0]), length));
+                                     });
+      lokomotiveFile.close();
+    }
+  }
+
   AutoConnectConfig configAutoConnect;
 
   String idOfEsp = String((uint32_t)(ESP.getEfuseMac() >> 32), HEX);
@@ -228,6 +277,9 @@ void setup()
             " ..wert=0\n"
             ""));
         lokomotiveCs2.close();
+        // cache does not fit to the file anymore
+        SPIFFS.remove("/config/lokomotive.crc");
+        locoManagment.clearLocoCache();
         WebService::getInstance()->setLokomotiveAvailable(true);
       }
       WebService::getInstance()->setTransmissionFinished(true);
@@ -236,9 +288,9 @@ void setup()
     auto programmingFkt = [](bool result)
     { centralStation.setProgramming(result); };
 
-    auto readingFkt = []()
+    auto readingFkt = [](bool useCompressedLocoFile, bool fullSync)
     {
-      auto lambdaWriteFile = [](std::string *data)
+      auto lambdaWriteFile = [](std::string *data, bool changed)
       {
         WebService::getInstance()->setLocoList(locoManagment.getLocoList());
         if (nullptr != data)
@@ -250,36 +302,38 @@ void setup()
           // String sql = "insert into functions(id,vehicle_id,button_type,shortcut,time,position,image_name,function,show_function_number,is_configured) values(1,2,0,'','0',0,'light',0,1,0)";
 
           // returns if no loco data is present (lokomotive)
+          // unchanged locos are already in the database
           Cs2DataParser::LocoData locoData;
-          if (Cs2DataParser::parseCs2ToLocoData(data, locoData))
+          if (changed && Cs2DataParser::parseCs2ToLocoData(data, locoData))
           {
-            auto callback = [](void *data, int argc, char **argv, char **azColName) -> int
-            {
-              for (int i = 1; i < argc; i++)
-              {
-                Serial.printf("%s|", argv[i]);
-              }
-              Serial.printf("\n");
-              return 0;
-            };
-
-            std::string sql = "insert into vehicles(id,name,image_name,type,max_speed,address) values(" + std::to_string(locoId) + ",'" + locoData.name + "','" + locoData.name + ".png'," + "0,120," + std::to_string(locoData.adress) + ")";
-
-            if (sqlite3_exec(z21Database, sql.c_str(), callback, (void *)data, &zErrMsg) != SQLITE_OK)
-            {
-              Serial.printf("SQL error: %s\n", zErrMsg);
-              sqlite3_free(zErrMsg);
-            }
+            // replace entries of the loco if it was known before
+            auto bindName = [&locoData](sqlite3_stmt *statement)
+            { sqlite3_bind_text(statement, 1, locoData.name.c_str(), -1, SQLITE_TRANSIENT); };
+            executeSql("delete from functions where vehicle_id in (select id from vehicles where name=?1)", bindName);
+            executeSql("delete from vehicles where name=?1", bindName);
+
+            executeSql("insert into vehicles(id,name,image_name,type,max_speed,address) values(?1,?2,?3,0,120,?4)",
+                       [&locoData](sqlite3_stmt *statement)
+                       {
+                         std::string imageName = locoData.name + ".png";
+                         sqlite3_bind_int(statement, 1, locoId);
+                         sqlite3_bind_text(statement, 2, locoData.name.c_str(), -1, SQLITE_TRANSIENT);
+                         sqlite3_bind_text(statement, 3, imageName.c_str(), -1, SQLITE_TRANSIENT);
+                         sqlite3_bind_int(statement, 4, locoData.adress);
+                       });
 
             for (auto iterator = locoData.functionData.begin(); iterator != locoData.functionData.end(); ++iterator)
             {
-              sql = "insert into functions(id,vehicle_id,button_type,shortcut,time,position,image_name,function,show_function_number,is_configured) values(" + std::to_string(functionId) + "," + std::to_string(locoId) + "," + std::to_string(iterator->buttonType) + ",'" + iterator->shortcut + "','0'," + std::to_string(iterator->function) + ",'" + iterator->imageName + "'," + std::to_string(iterator->function) + ",1,0)";
-              if (sqlite3_exec(z21Database, sql.c_str(), callback, (void *)data, &zErrMsg) != SQLITE_OK)
-              {
-                Serial.printf("SQL error: %s | %s\n", zErrMsg, sql.c_str());
-                sqlite3_free(zErrMsg);
-              }
-              else
+              if (executeSql("insert into functions(id,vehicle_id,button_type,shortcut,time,position,image_name,function,show_function_number,is_configured) values(?1,?2,?3,?4,'0',?5,?6,?5,1,0)",
+                             [&iterator](sqlite3_stmt *statement)
+                             {
+                               sqlite3_bind_int(statement, 1, functionId);
+                               sqlite3_bind_int(statement, 2, locoId);
+                               sqlite3_bind_int(statement, 3, iterator->buttonType);
+                               sqlite3_bind_text(statement, 4, iterator->shortcut.c_str(), -1, SQLITE_TRANSIENT);
+                               sqlite3_bind_int(statement, 5, iterator->function);
+                               sqlite3_bind_text(statement, 6, iterator->imageName.c_str(), -1, SQLITE_TRANSIENT);
+                             }))
               {
                 functionId++;
               }
@@ -303,6 +357,27 @@ void setup()
             Serial.printf("\n");
             return 0;
           };
+          // remove locos that are not available anymore
+          std::vector<std::string> *locoList = locoManagment.getLocoList();
+          if (!locoList->empty())
+          {
+            // one parameter per loco name
+            std::string names;
+            for (size_t i = 0; i < locoList->size(); i++)
+            {
+              names += names.empty() ? "?" : ",?";
+            }
+            auto bindNames = [locoList](sqlite3_stmt *statement)
+            {
+              for (size_t i = 0; i < locoList->size(); i++)
+              {
+                sqlite3_bind_text(statement, i + 1, (*locoList)[i].c_str(), -1, SQLITE_TRANSIENT);
+              }
+            };
+            executeSql("delete from functions where vehicle_id in (select id from vehicles where name not in (" + names + "))", bindNames);
+            executeSql("delete from vehicles where name not in (" + names + ")", bindNames);
+          }
+
           if (sqlite3_exec(z21Database, "Select * from vehicles", callback, (void *)data, &zErrMsg) != SQLITE_OK)
           {
             Serial.printf("SQL error: %s\n", zErrMsg);
@@ -320,6 +395,21 @@ void setup()
         // close database
         sqlite3_close(z21Database);
 
+        // cache is only valid together with a completely written lokomotive.cs2
+        if (success)
+        {
+          File locoCacheIndex = SPIFFS.open("/config/lokomotive.crc", FILE_WRITE);
+          if (locoCacheIndex)
+          {
+            locoCacheIndex.print(locoManagment.getLocoCacheIndex().c_str());
+            locoCacheIndex.close();
+          }
+        }
+        else
+        {
+          SPIFFS.remove("/config/lokomotive.crc");
+        }
+
         WebService::getInstance()->setLocoList(locoManagment.getLocoList());
         WebService::getInstance()->setLokomotiveAvailable(success);
         WebService::getInstance()->setTransmissionFinished(true);
@@ -327,7 +417,7 @@ void setup()
 
       WebService::getInstance()->setTransmissionFinished(false);
       WebService::getInstance()->setLokomotiveAvailable(false);
-      // open sql database and delete current entries
+      // open sql database, entries are only replaced for locos that changed
       sqlite3_initialize();
 
       int sqliteResult = sqlite3_open("/spiffs/config/Loco.sqlite", &z21Database);
@@ -339,27 +429,30 @@ void setup()
       {
         Serial.println(F("Opened database successfully"));
 
-        auto callback = [](void *data, int argc, char **argv, char **azColName) -> int
+        // new entries are added behind the existing ones
+        auto nextIdCallback = [](void *data, int argc, char **argv, char **azColName) -> int
         {
-          for (int i = 1; i < argc; i++)
+          if ((argc > 0) && (nullptr != argv[0]))
           {
-            Serial.printf("%s|", argv[i]);
+            *static_cast<uint16_t *>(data) = atoi(argv[0]) + 1;
           }
-          Serial.printf("\n");
           return 0;
         };
 
-        if (sqlite3_exec(z21Database, "delete from vehicles", callback, (void *)data, &zErrMsg) != SQLITE_OK)
+        locoId = 1;
+        functionId = 1;
+        if (sqlite3_exec(z21Database, "select max(id) from vehicles", nextIdCallback, (void *)&locoId, &zErrMsg) != SQLITE_OK)
         {
           Serial.printf("SQL error: %s\n", zErrMsg);
           sqlite3_free(zErrMsg);
         }
-        if (sqlite3_exec(z21Database, "delete from functions", callback, (void *)data, &zErrMsg) != SQLITE_OK)
+        if (sqlite3_exec(z21Database, "select max(id) from functions", nextIdCallback, (void *)&functionId, &zErrMsg) != SQLITE_OK)
         {
           Serial.printf("SQL error: %s\n", zErrMsg);
           sqlite3_free(zErrMsg);
         }
       }
+      // file is still written completely, unchanged locos come from the cache instead of the Mobile Station
       lokomotiveCs2 = SPIFFS.open("/config/lokomotive.cs2", FILE_WRITE);
       if (!lokomotiveCs2)
       {
@@ -372,8 +465,12 @@ void setup()
 
       if (lokomotiveCs2 && (0 == sqliteResult))
       {
-        locoId = 1;
-        functionId = 1;
+        locoManagment.setUseCompressedLocoFile(useCompressedLocoFile);
+        // changes of functions are not visible in lokliste, so they need a full sync
+        if (fullSync)
+        {
+          locoManagment.clearLocoCache();
+        }
         locoManagment.getLokomotiveConfig(lambdaWriteFile, lambdaWriteFileResult);
       }
     };
@@ -424,6 +521,9 @@ void setup()
 
   centralStation.setLocoManagment(&locoManagment);
 
+  // has to be set before begin, which reads the stored positions
+  centralStation.setTurnoutPersistence(turnoutPersistence);
+
   centralStation.begin();
 
   can2Lan = Can2Lan::getCan2Lan();
@@ -70,473 +70,516 @@ void MaerklinCanInterface::generateHash()
 {
 	TrackMessage message;
 
-	bool ok = false;
+	m_hash = (random(0x10000) & 0xff7f) | 0x0300;
 
-	while (!ok)
+	if (m_debug)
 	{
-		m_hash = (random(0x10000) & 0xff7f) | 0x0300;
+		Serial.print(F("### Trying new hash "));
+		printHex(Serial, m_hash, 4);
+		Serial.println();
+	}
+
+	message.clear();
+	message.command = 0x18;
+
+	sendMessage(message);
+
+	// hash is kept if no other device uses it until m_hashProbeTimeINms passed, see cyclic and handleReceivedMessage
+	m_hashState = HashState::Probing;
+	m_hashProbeStartTimeINms = millis();
+}
 
+bool MaerklinCanInterface::exchangeMessage(TrackMessage &out, ProgrammingCallback callback, uint32_t timeoutINms)
+{
+	// response is matched by handleProgrammingResponse out of handleReceivedMessage
+	ProgrammingCmd cmd{out, timeoutINms, callback};
+	bool result = queueProgrammingCmd(cmd);
+	if (!result && m_debug)
+	{
+		Serial.println(F("!!! Send error"));
+	}
+	return result;
+}
+
+bool MaerklinCanInterface::queueProgrammingCmd(ProgrammingCmd &cmd)
+{
+	m_programmingCmdQueue.push_back(cmd);
+	return sendNextProgrammingCmd();
+}
+
+void MaerklinCanInterface::cyclic()
+{
+	if ((HashState::Probing == m_hashState) && ((millis() - m_hashProbeStartTimeINms) >= m_hashProbeTimeINms))
+	{
+		m_hashState = HashState::Valid;
 		if (m_debug)
 		{
-			Serial.print(F("### Trying new hash "));
-			printHex(Serial, m_hash, 4);
-			Serial.println();
+			Serial.print(F("### New hash "));
+			Serial.print(m_hash, HEX);
+			Serial.println(F(" looks good"));
 		}
+		notifyHashNegotiated();
+	}
 
-		message.clear();
-		message.command = 0x18;
-
-		sendMessage(message);
-
-		delay(500);
+	m_programmingTimeouts.advance(millis(), [this](uint16_t handle)
+								  { handleProgrammingTimeout(handle); });
+	sendNextProgrammingCmd();
+}
 
-		ok = true;
-		unsigned long time = millis();
-		while (receiveMessage(message))
+void MaerklinCanInterface::handleProgrammingTimeout(uint16_t handle)
+{
+	for (auto active = m_activeProgrammingCmds.begin(); active != m_activeProgrammingCmds.end(); ++active)
+	{
+		if (active->handle == handle)
 		{
-			if (message.hash == m_hash)
+			if (m_debug)
 			{
-				ok = false;
-				break;
+				Serial.print(F("Timeout ProgrammingCmd:"));
+				Serial.println(active->cmd.message);
 			}
-			if (millis() < time + 2000)
+			ProgrammingCallback callback = active->cmd.callback;
+			m_activeProgrammingCmds.erase(active);
+			if (callback)
 			{
-				break;
+				callback(nullptr);
 			}
+			return;
 		}
 	}
+}
 
-	if (m_debug)
+// device a programming command is addressed to, commands for different devices run in parallel
+uint32_t MaerklinCanInterface::programmingDevice(const TrackMessage &message)
+{
+	if ((static_cast<uint8_t>(Cmd::locoDetection) == message.command) || (message.length < 4))
 	{
-		Serial.print(F("### New hash "));
-		Serial.print(m_hash, HEX);
-		Serial.println(F(" looks good"));
+		// discovery answers with the uid of the found loco, so it blocks all other discoveries
+		return 0;
 	}
+	return (static_cast<uint32_t>(message.data[0]) << 24) + (static_cast<uint32_t>(message.data[1]) << 16) + (static_cast<uint32_t>(message.data[2]) << 8) + message.data[3];
 }
 
-bool MaerklinCanInterface::exchangeMessage(TrackMessage &out, TrackMessage &in, word timeout)
+bool MaerklinCanInterface::isProgrammingResponse(const TrackMessage &request, const TrackMessage &response)
 {
-	int command = out.command;
+	if (request.command != response.command)
+	{
+		return false;
+	}
+	switch (static_cast<MaerklinCanInterface::Cmd>(request.command))
+	{
+	case MaerklinCanInterface::Cmd::locoDetection:
+		return true;
+	case MaerklinCanInterface::Cmd::systemCmd:
+		// same sub command and for system status the same channel
+		return (response.length >= 6) && (programmingDevice(request) == programmingDevice(response)) && (request.data[4] == response.data[4]) &&
+			   ((static_cast<uint8_t>(SubCmd::systemStatus) != request.data[4]) || (request.data[5] == response.data[5]));
+	case MaerklinCanInterface::Cmd::readConfig:
+	case MaerklinCanInterface::Cmd::writeConfig:
+		// same cv
+		return (response.length >= 6) && (programmingDevice(request) == programmingDevice(response)) && (request.data[4] == response.data[4]) && (request.data[5] == response.data[5]);
+	case MaerklinCanInterface::Cmd::locoFunc:
+		// same function
+		return (response.length >= 5) && (programmingDevice(request) == programmingDevice(response)) && (request.data[4] == response.data[4]);
+	case MaerklinCanInterface::Cmd::statusDataConfig:
+		// only the last frame with uid, index and number of frames finishes the request
+		return (6 == response.length) && (programmingDevice(request) == programmingDevice(response)) && (request.data[4] == response.data[4]);
+	default:
+		return (response.length >= 4) && (programmingDevice(request) == programmingDevice(response));
+	}
+}
 
-	if (!sendMessage(out))
+void MaerklinCanInterface::handleProgrammingResponse(TrackMessage &message)
+{
+	for (auto active = m_activeProgrammingCmds.begin(); active != m_activeProgrammingCmds.end(); ++active)
 	{
-		if (m_debug)
+		if (isProgrammingResponse(active->cmd.message, message))
 		{
-			Serial.println(F("!!! Send error"));
-			Serial.println(F("!!! Emergency stop"));
-			// setPower(false);
+			// timeout in wheel is ignored, since handle is not active anymore
+			ProgrammingCallback callback = active->cmd.callback;
+			m_activeProgrammingCmds.erase(active);
+			if (callback)
+			{
+				callback(&message);
+			}
+			sendNextProgrammingCmd();
+			return;
 		}
+	}
+}
+
+constexpr MaerklinCanInterface::MessageDispatch MaerklinCanInterface::s_dispatches[MaerklinCanInterface::numberOfDispatches] = {
+	// system commands, dispatched by sub command
+	{0x00, 0x00, false, &MaerklinCanInterface::receiveSystemStop}, // systemStop
+	{0x00, 0x01, false, &MaerklinCanInterface::receiveSystemGo}, // systemGo
+	{0x00, 0x02, false, &MaerklinCanInterface::receiveSystemHalt}, // systemHalt
+	{0x00, 0x03, false, &MaerklinCanInterface::receiveLocoStop}, // locoStop
+	{0x00, 0x04, true, &MaerklinCanInterface::receiveLocoRemoveCycle}, // locoRemoveCycle
+	{0x00, 0x05, true, &MaerklinCanInterface::receiveLocoDataProtocol}, // locoDataProtocol
+	{0x00, 0x06, true, &MaerklinCanInterface::receiveAccTime}, // accTime
+	{0x00, 0x07, true, &MaerklinCanInterface::receiveFastReadMfx}, // fastReadMfx
+	{0x00, 0x08, true, &MaerklinCanInterface::receiveTrackProtocol}, // setTrackProtocol
+	{0x00, 0x09, true, &MaerklinCanInterface::receiveMfxCounter}, // setMfxCounter
+	{0x00, 0x0A, false, &MaerklinCanInterface::receiveSystemOverLoad}, // systemOverLoad
+	{0x00, 0x0B, true, &MaerklinCanInterface::receiveSystemStatus}, // systemStatus
+	{0x00, 0x0C, true, &MaerklinCanInterface::receiveSystemIdent}, // systemIdent
+	{0x00, 0x18, true, &MaerklinCanInterface::receiveSystemReset}, // systemReset
+	// all other commands
+	{0x01, noSubCmd, true, &MaerklinCanInterface::receiveLocoDiscovery}, // locoDetection
+	{0x02, noSubCmd, true, &MaerklinCanInterface::receiveMfxBind}, // mfxBind
+	{0x03, noSubCmd, true, &MaerklinCanInterface::receiveMfxVerify}, // mfxVerify
+	{0x04, noSubCmd, true, &MaerklinCanInterface::receiveLocoSpeed}, // locoSpeed
+	{0x05, noSubCmd, true, &MaerklinCanInterface::receiveLocoDir}, // locoDir
+	{0x06, noSubCmd, true, &MaerklinCanInterface::receiveLocoFunc}, // locoFunc
+	{0x07, noSubCmd, true, &MaerklinCanInterface::receiveReadConfig}, // readConfig
+	{0x08, noSubCmd, true, &MaerklinCanInterface::receiveWriteConfig}, // writeConfig
+	{0x0B, noSubCmd, true, &MaerklinCanInterface::receiveAccSwitch}, // accSwitch
+	{0x18, noSubCmd, true, &MaerklinCanInterface::receivePing}, // ping
+	{0x1D, noSubCmd, true, &MaerklinCanInterface::receiveStatusDataConfig}, // statusDataConfig
+	{0x20, noSubCmd, true, &MaerklinCanInterface::receiveConfigData}, // requestConfigData
+	{0x21, noSubCmd, false, &MaerklinCanInterface::receiveConfigDataStream}}; // configDataSteam
+
+constexpr MaerklinCanInterface::DispatchIndex MaerklinCanInterface::s_commandIndex = MaerklinCanInterface::makeDispatchIndex(MaerklinCanInterface::s_dispatches, false);
+constexpr MaerklinCanInterface::DispatchIndex MaerklinCanInterface::s_systemIndex = MaerklinCanInterface::makeDispatchIndex(MaerklinCanInterface::s_dispatches, true);
+constexpr uint8_t MaerklinCanInterface::noDispatch;
+constexpr uint8_t MaerklinCanInterface::noSubCmd;
+constexpr size_t MaerklinCanInterface::numberOfDispatches;
+constexpr uint8_t MaerklinCanInterface::numberOfTimeBuckets;
+constexpr uint32_t MaerklinCanInterface::s_timeBucketLimitsINus[MaerklinCanInterface::numberOfTimeBuckets - 1];
+
+void MaerklinCanInterface::handleReceivedMessage(TrackMessage &message)
+{
+	// another device already uses our hash
+	if ((HashState::Probing == m_hashState) && (message.hash == m_hash))
+	{
+		generateHash();
+	}
+
+	// check message if it is a response of a programming command and call its callback
+	if (message.response && !m_activeProgrammingCmds.empty())
+	{
+		handleProgrammingResponse(message);
+	}
+
+	uint8_t slot = (static_cast<uint8_t>(Cmd::systemCmd) == message.command) ? s_systemIndex.slot[message.data[4]] : s_commandIndex.slot[message.command];
+	if ((noDispatch == slot) || (s_dispatches[slot].responseOnly && !message.response))
+	{
+		m_unhandledMessageCounter++;
+		return;
+	}
+
+	uint32_t uid = (static_cast<uint32_t>(message.data[0]) << 24) + (static_cast<uint32_t>(message.data[1]) << 16) + (static_cast<uint32_t>(message.data[2]) << 8) + message.data[3];
+	unsigned long startTimeINus = micros();
+	(this->*s_dispatches[slot].handler)(uid, message);
+	uint32_t durationINus = static_cast<uint32_t>(micros() - startTimeINus);
+
+	uint8_t bucket = 0;
+	while ((bucket < (numberOfTimeBuckets - 1)) && (durationINus >= s_timeBucketLimitsINus[bucket]))
+	{
+		bucket++;
+	}
+	m_dispatchCounter[slot]++;
+	m_dispatchHistogram[slot][bucket]++;
+}
+
+bool MaerklinCanInterface::getMessageStatistics(uint8_t command, uint8_t subCmd, uint32_t &counter, std::array<uint32_t, numberOfTimeBuckets> &histogram)
+{
+	uint8_t slot = (static_cast<uint8_t>(Cmd::systemCmd) == command) ? s_systemIndex.slot[subCmd] : s_commandIndex.slot[command];
+	if (noDispatch == slot)
+	{
 		return false;
 	}
+	counter = m_dispatchCounter[slot];
+	for (uint8_t i = 0; i < numberOfTimeBuckets; i++)
+	{
+		histogram[i] = m_dispatchHistogram[slot][i];
+	}
+	return true;
+}
+
+bool MaerklinCanInterface::receiveSystemStop(uint32_t uid, const TrackMessage &message)
+{
+	return ((5 == message.length) || (8 == message.length)) && onSystemStop(uid);
+}
+
+bool MaerklinCanInterface::receiveSystemGo(uint32_t uid, const TrackMessage &message)
+{
+	return (5 == message.length) && onSystemGo(uid);
+}
 
-	unsigned long time = millis();
+bool MaerklinCanInterface::receiveSystemHalt(uint32_t uid, const TrackMessage &message)
+{
+	return (5 == message.length) && onSystemHalt(uid);
+}
+
+bool MaerklinCanInterface::receiveLocoStop(uint32_t uid, const TrackMessage &message)
+{
+	return (5 == message.length) && onLocoStop(uid);
+}
 
-	// TrackMessage response;
+bool MaerklinCanInterface::receiveLocoRemoveCycle(uint32_t uid, const TrackMessage &message)
+{
+	return (5 == message.length) && onLocoRemoveCycle(uid);
+}
+
+bool MaerklinCanInterface::receiveLocoDataProtocol(uint32_t uid, const TrackMessage &message)
+{
+	return (6 == message.length) && onLocoDataProtocol(uid, static_cast<ProtocolLoco>(message.data[5]));
+}
 
-	while (millis() < time + timeout)
+bool MaerklinCanInterface::receiveAccTime(uint32_t uid, const TrackMessage &message)
+{
+	if (7 != message.length)
 	{
-		in.clear();
-		bool result = receiveMessage(in);
+		return false;
+	}
+	uint16_t accTimeIN10ms = (message.data[5] << 8) + message.data[6];
+	return onAccTime(uid, accTimeIN10ms);
+}
 
-		if (result && in.command == command && in.response)
-		{
-			return true;
-		}
-		else if (result)
-		{
-			handleReceivedMessage(in);
-		}
+bool MaerklinCanInterface::receiveFastReadMfx(uint32_t uid, const TrackMessage &message)
+{
+	if (7 != message.length)
+	{
+		return false;
 	}
+	uint16_t mfxSid = (message.data[5] << 8) + message.data[6];
+	return onFastReadMfx(uid, mfxSid);
+}
 
-	if (m_debug)
+bool MaerklinCanInterface::receiveTrackProtocol(uint32_t uid, const TrackMessage &message)
+{
+	return (6 == message.length) && onTrackProtocol(uid, message.data[5]);
+}
+
+bool MaerklinCanInterface::receiveMfxCounter(uint32_t uid, const TrackMessage &message)
+{
+	if (7 != message.length)
 	{
-		Serial.println(F("!!! Receive timeout"));
+		return false;
 	}
+	uint16_t counter = (message.data[5] << 8) + message.data[6];
+	return onMfxCounter(uid, counter);
+}
 
+bool MaerklinCanInterface::receiveSystemOverLoad(uint32_t uid, const TrackMessage &message)
+{
+	return (6 == message.length) && onSystemOverLoad(uid, message.data[5]);
+}
+
+bool MaerklinCanInterface::receiveSystemStatus(uint32_t uid, const TrackMessage &message)
+{
+	uint8_t channel = message.data[5];
+	if (7 == message.length)
+	{
+		bool valid = (0x01 == message.data[6]);
+		return onSystemStatus(uid, channel, valid);
+	}
+	else if (8 == message.length)
+	{
+		uint16_t value = (message.data[6] << 8) + message.data[7];
+		return onSystemStatus(uid, channel, value);
+	}
 	return false;
 }
 
-bool MaerklinCanInterface::queueProgrammingCmd(ProgrammingCmd &cmd)
+bool MaerklinCanInterface::receiveSystemIdent(uint32_t uid, const TrackMessage &message)
 {
-	bool result{true};
-	m_programmingCmdQueue.push(cmd);
-	if (!m_programmingCmdActive)
+	if (7 != message.length)
 	{
-		m_programmingCmdActive = true;
-		result = sendNextProgrammingCmd();
+		return false;
 	}
-	return result;
+	uint16_t feedbackId = (message.data[5] << 8) + message.data[6];
+	return onSystemIdent(uid, feedbackId);
 }
 
-void MaerklinCanInterface::handleReceivedMessage(TrackMessage &message)
+bool MaerklinCanInterface::receiveSystemReset(uint32_t uid, const TrackMessage &message)
+{
+	return (6 == message.length) && onSystemReset(uid, message.data[5]);
+}
+
+bool MaerklinCanInterface::receiveLocoDiscovery(uint32_t uid, const TrackMessage &message)
 {
-	// Serial.print("==> ");
-	// Serial.println(message);
-	bool messageHandled{false};
-	// check message if it is a response or not and call callbacks
-	if (message.response)
+	if (0 == message.length)
 	{
-		switch (static_cast<MaerklinCanInterface::Cmd>(message.command))
-		{
-		case MaerklinCanInterface::Cmd::systemCmd:
-			switch (static_cast<MaerklinCanInterface::SubCmd>(message.data[4]))
-			{
-			case MaerklinCanInterface::SubCmd::locoRemoveCycle:
-				if (5 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					messageHandled = onLocoRemoveCycle(id);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::locoDataProtocol:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					messageHandled = onLocoDataProtocol(id, static_cast<ProtocolLoco>(message.data[5]));
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::accTime:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint16_t accTimeIN10ms = (message.data[5] << 8) + message.data[6];
-					messageHandled = onAccTime(id, accTimeIN10ms);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::fastReadMfx:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint16_t mfxSid = (message.data[5] << 8) + message.data[6];
-					messageHandled = onFastReadMfx(id, mfxSid);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::setTrackProtocol:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					messageHandled = onTrackProtocol(id, message.data[5]);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::setMfxCounter:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint16_t counter = (message.data[5] << 8) + message.data[6];
-					messageHandled = onMfxCounter(id, counter);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::systemStatus:
-				if (message.command == m_currentProgrammingCmd.message.command)
-				{
-					m_programmingCmdActive = false;
-					sendNextProgrammingCmd();
-				}
-				if (7 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint8_t channel = message.data[5];
-					bool valid = (0x01 == message.data[6]);
-					messageHandled = onSystemStatus(id, channel, valid);
-				}
-				else if (8 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint8_t channel = message.data[5];
-					uint16_t value = (message.data[6] << 8) + message.data[7];
-					messageHandled = onSystemStatus(id, channel, value);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::systemIdent:
-				if (7 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					uint16_t feedbackId = (message.data[5] << 8) + message.data[6];
-					messageHandled = onSystemIdent(id, feedbackId);
-				}
-				break;
-			case MaerklinCanInterface::SubCmd::systemReset:
-				if (6 == message.length)
-				{
-					uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-					messageHandled = onSystemReset(id, message.data[5]);
-				}
-				break;
-			default:
-				break;
-			}
-			break;
-		case MaerklinCanInterface::Cmd::locoDetection:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (0 == message.length)
-			{
-				messageHandled = onLocoDiscovery();
-			}
-			else if (5 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onLocoDiscovery(id, message.data[4]);
-			}
-			else if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint8_t protocol = message.data[4];
-				uint8_t ask = message.data[5];
-				messageHandled = onLocoDiscovery(id, protocol, ask);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::mfxBind:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (6 == message.length)
-			{
-				uint32_t uid = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t sid = (message.data[4] << 8) + message.data[5];
-				messageHandled = onMfxBind(uid, sid);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::mfxVerify:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (6 == message.length)
-			{
-				uint32_t uid = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t sid = (message.data[4] << 8) + message.data[5];
-				messageHandled = onMfxVerify(uid, sid);
-			}
-			else if (7 == message.length)
-			{
-				uint32_t uid = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t sid = (message.data[4] << 8) + message.data[5];
-				uint8_t ask = message.data[6];
-				messageHandled = onMfxVerify(uid, sid, ask);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::locoSpeed:
-			if (4 == message.length) // locomotive is not known
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onLocoSpeed(id);
-			}
-			else if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t speed = (message.data[4] << 8) + message.data[5];
-				messageHandled = onLocoSpeed(id, speed);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::locoDir:
-			if (5 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint8_t dir = message.data[4];
-				messageHandled = onLocoDir(id, dir);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::locoFunc:
-			if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint8_t function = message.data[4];
-				uint8_t value = message.data[5];
-				messageHandled = onLocoFunc(id, function, value);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::readConfig:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (7 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t cvAdr = (message.data[4] << 8) + message.data[5];
-				uint8_t value = message.data[6];
-				messageHandled = onReadConfig(id, cvAdr, value, true);
-			}
-			else if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t cvAdr = (message.data[4] << 8) + message.data[5];
-				uint8_t value = 0;
-				messageHandled = onReadConfig(id, cvAdr, value, false);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::writeConfig:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (8 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t cvAdr = (message.data[4] << 8) + message.data[5];
-				uint8_t value = message.data[6];
-				bool writeSuccessful = message.data[7] & 0x80;
-				bool verified = message.data[7] & 0x40;
-				messageHandled = onWriteConfig(id, cvAdr, value, writeSuccessful, verified);
-			}
-			break;
+		return onLocoDiscovery();
+	}
+	else if (5 == message.length)
+	{
+		return onLocoDiscovery(uid, message.data[4]);
+	}
+	else if (6 == message.length)
+	{
+		uint8_t protocol = message.data[4];
+		uint8_t ask = message.data[5];
+		return onLocoDiscovery(uid, protocol, ask);
+	}
+	return false;
+}
 
-		case MaerklinCanInterface::Cmd::accSwitch:
-			if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint8_t position = message.data[4];
-				uint8_t current = message.data[5];
-				messageHandled = onAccSwitch(id, position, current);
-			}
-			else if (8 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint8_t position = message.data[4];
-				uint8_t current = message.data[5];
-				messageHandled = onAccSwitch(id, position, current);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::ping:
-			if (8 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				uint16_t swVersion = (static_cast<uint16_t>(message.data[4]) << 8) + message.data[5];
-				uint16_t hwIdent = (static_cast<uint16_t>(message.data[6]) << 8) + message.data[7];
-				messageHandled = onPing(message.hash, id, swVersion, hwIdent);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::statusDataConfig:
-			if (message.command == m_currentProgrammingCmd.message.command)
-			{
-				m_programmingCmdActive = false;
-				sendNextProgrammingCmd();
-			}
-			if (8 == message.length)
-			{
-				std::array<uint8_t, 8> data{message.data[0], message.data[1], message.data[2], message.data[3], message.data[4], message.data[5], message.data[6], message.data[7]};
-				messageHandled = onStatusDataConfig(message.hash, data);
-			}
-			else if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onStatusDataConfig(message.hash, id, message.data[4], message.data[5]);
-			}
-			break;
-		case MaerklinCanInterface::Cmd::requestConfigData:
-			if (8 == message.length)
-			{
-				std::array<uint8_t, 8> data{message.data[0], message.data[1], message.data[2], message.data[3], message.data[4], message.data[5], message.data[6], message.data[7]};
-				messageHandled = onConfigData(message.hash, data);
-			}
-			break;
-		default:
+bool MaerklinCanInterface::receiveMfxBind(uint32_t uid, const TrackMessage &message)
+{
+	if (6 != message.length)
+	{
+		return false;
+	}
+	uint16_t sid = (message.data[4] << 8) + message.data[5];
+	return onMfxBind(uid, sid);
+}
 
-			break;
-		}
+bool MaerklinCanInterface::receiveMfxVerify(uint32_t uid, const TrackMessage &message)
+{
+	uint16_t sid = (message.data[4] << 8) + message.data[5];
+	if (6 == message.length)
+	{
+		return onMfxVerify(uid, sid);
 	}
+	else if (7 == message.length)
+	{
+		uint8_t ask = message.data[6];
+		return onMfxVerify(uid, sid, ask);
+	}
+	return false;
+}
 
-	// Maybe TODO
-	// commands where it response bit is not relevant
-	switch (static_cast<MaerklinCanInterface::Cmd>(message.command))
+bool MaerklinCanInterface::receiveLocoSpeed(uint32_t uid, const TrackMessage &message)
+{
+	if (4 == message.length) // locomotive is not known
 	{
-	case MaerklinCanInterface::Cmd::systemCmd:
-		switch (static_cast<MaerklinCanInterface::SubCmd>(message.data[4]))
-		{
-		case MaerklinCanInterface::SubCmd::systemStop:
-			if ((5 == message.length) || (8 == message.length))
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onSystemStop(id);
-			}
-			break;
-		case MaerklinCanInterface::SubCmd::systemGo:
-			if (5 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onSystemGo(id);
-			}
-			break;
-		case MaerklinCanInterface::SubCmd::systemHalt:
-			if (5 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onSystemHalt(id);
-			}
-			break;
-		case MaerklinCanInterface::SubCmd::locoStop:
-			if (5 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onLocoStop(id);
-			}
-			break;
-		case MaerklinCanInterface::SubCmd::systemOverLoad:
-			if (6 == message.length)
-			{
-				uint32_t id = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-				messageHandled = onSystemOverLoad(id, message.data[5]);
-			}
-			break;
-		default:
-			break;
-		}
-		break;
-	case MaerklinCanInterface::Cmd::configDataSteam:
-		if (8 == message.length)
-		{
-			std::array<uint8_t, 8> data{message.data[0], message.data[1], message.data[2], message.data[3], message.data[4], message.data[5], message.data[6], message.data[7]};
-			messageHandled = onConfigDataStream(message.hash, data);
-		}
-		else if (7 == message.length)
-		{
-			uint32_t length = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-			uint16_t crc = (message.data[4] << 8) + message.data[5];
-			messageHandled = onConfigDataStream(message.hash, length, crc, message.data[6]);
-		}
-		else if (6 == message.length)
-		{
-			uint32_t length = (message.data[0] << 24) + (message.data[1] << 16) + (message.data[2] << 8) + message.data[3];
-			uint16_t crc = (message.data[4] << 8) + message.data[5];
-			messageHandled = onConfigDataStream(message.hash, length, crc);
-		}
-		else
-		{
-			messageHandled = onConfigDataSteamError(message.hash);
-		}
-		break;
-	default:
-		break;
+		return onLocoSpeed(uid);
+	}
+	else if (6 == message.length)
+	{
+		uint16_t speed = (message.data[4] << 8) + message.data[5];
+		return onLocoSpeed(uid, speed);
 	}
+	return false;
+}
 
-	if (messageHandled)
+bool MaerklinCanInterface::receiveLocoDir(uint32_t uid, const TrackMessage &message)
+{
+	return (5 == message.length) && onLocoDir(uid, message.data[4]);
+}
+
+bool MaerklinCanInterface::receiveLocoFunc(uint32_t uid, const TrackMessage &message)
+{
+	return (6 == message.length) && onLocoFunc(uid, message.data[4], message.data[5]);
+}
+
+bool MaerklinCanInterface::receiveReadConfig(uint32_t uid, const TrackMessage &message)
+{
+	uint16_t cvAdr = (message.data[4] << 8) + message.data[5];
+	if (7 == message.length)
 	{
+		return onReadConfig(uid, cvAdr, message.data[6], true);
 	}
+	else if (6 == message.length)
+	{
+		return onReadConfig(uid, cvAdr, 0, false);
+	}
+	return false;
 }
 
-bool MaerklinCanInterface::sendNextProgrammingCmd()
+bool MaerklinCanInterface::receiveWriteConfig(uint32_t uid, const TrackMessage &message)
 {
-	bool result{false};
-	if (!m_programmingCmdQueue.empty())
+	if (8 != message.length)
 	{
-		m_currentProgrammingCmd = m_programmingCmdQueue.front();
-		m_programmingCmdQueue.pop();
-		sendMessage(m_currentProgrammingCmd.message);
-		notifyProgrammingCmdSent();
-		m_programmingCmdActive = true;
+		return false;
+	}
+	uint16_t cvAdr = (message.data[4] << 8) + message.data[5];
+	uint8_t value = message.data[6];
+	bool writeSuccessful = message.data[7] & 0x80;
+	bool verified = message.data[7] & 0x40;
+	return onWriteConfig(uid, cvAdr, value, writeSuccessful, verified);
+}
+
+bool MaerklinCanInterface::receiveAccSwitch(uint32_t uid, const TrackMessage &message)
+{
+	if (8 == message.length)
+	{
+		uint16_t switchTimeIN10ms = (message.data[6] << 8) + message.data[7];
+		return onAccSwitch(uid, message.data[4], message.data[5], switchTimeIN10ms);
+	}
+	return (6 == message.length) && onAccSwitch(uid, message.data[4], message.data[5]);
+}
+
+bool MaerklinCanInterface::receivePing(uint32_t uid, const TrackMessage &message)
+{
+	if (8 != message.length)
+	{
+		return false;
+	}
+	uint16_t swVersion = (static_cast<uint16_t>(message.data[4]) << 8) + message.data[5];
+	uint16_t hwIdent = (static_cast<uint16_t>(message.data[6]) << 8) + message.data[7];
+	return onPing(message.hash, uid, swVersion, hwIdent);
+}
+
+bool MaerklinCanInterface::receiveStatusDataConfig(uint32_t uid, const TrackMessage &message)
+{
+	if (8 == message.length)
+	{
+		std::array<uint8_t, 8> data = message.data;
+		return onStatusDataConfig(message.hash, data);
 	}
-	else
+	else if (6 == message.length)
 	{
-		m_programmingCmdActive = false;
+		return onStatusDataConfig(message.hash, uid, message.data[4], message.data[5]);
+	}
+	return false;
+}
+
+bool MaerklinCanInterface::receiveConfigData(uint32_t uid, const TrackMessage &message)
+{
+	return (8 == message.length) && onConfigData(message.hash, message.data);
+}
+
+bool MaerklinCanInterface::receiveConfigDataStream(uint32_t uid, const TrackMessage &message)
+{
+	if (8 == message.length)
+	{
+		std::array<uint8_t, 8> data = message.data;
+		return onConfigDataStream(message.hash, data);
+	}
+	else if (7 == message.length)
+	{
+		uint16_t crc = (message.data[4] << 8) + message.data[5];
+		return onConfigDataStream(message.hash, uid, crc, message.data[6]);
+	}
+	else if (6 == message.length)
+	{
+		uint16_t crc = (message.data[4] << 8) + message.data[5];
+		return onConfigDataStream(message.hash, uid, crc);
+	}
+	return onConfigDataSteamError(message.hash);
+}
+
+// sends every queued command whose device is free, commands for one device keep their order
+bool MaerklinCanInterface::sendNextProgrammingCmd()
+{
+	bool result{true};
+	for (auto queued = m_programmingCmdQueue.begin(); (queued != m_programmingCmdQueue.end()) && (m_activeProgrammingCmds.size() < m_maxActiveProgrammingCmds);)
+	{
+		uint32_t device = programmingDevice(queued->message);
+		bool deviceBusy{false};
+		for (const auto &active : m_activeProgrammingCmds)
+		{
+			if (programmingDevice(active.cmd.message) == device)
+			{
+				deviceBusy = true;
+				break;
+			}
+		}
+		if (deviceBusy)
+		{
+			++queued;
+			continue;
+		}
+		uint16_t handle = m_nextProgrammingHandle++;
+		m_activeProgrammingCmds.push_back(ActiveProgrammingCmd{handle, *queued});
+		queued = m_programmingCmdQueue.erase(queued);
+		ProgrammingCmd &cmd = m_activeProgrammingCmds.back().cmd;
+		m_programmingTimeouts.schedule(handle, millis() + cmd.timeoutINms);
+		result = sendMessage(cmd.message) && result;
+		notifyProgrammingCmdSent();
 	}
 	return result;
 }
@@ -882,7 +925,7 @@ void MaerklinCanInterface::messageReadConfig(TrackMessage &message, uint32_t id,
 {
 	message.clear();
 	message.prio = static_cast<uint8_t>(MessagePrio::noPrio);
-	message.command = static_cast<uint8_t>(MaerklinCanInterface::Cmd::locoFunc);
+	message.command = static_cast<uint8_t>(MaerklinCanInterface::Cmd::readConfig);
 	message.length = 0x07;
 	message.data[0] = 0xFF & (id >> 24);
 	message.data[1] = 0xFF & (id >> 16);
@@ -897,7 +940,7 @@ void MaerklinCanInterface::messageWriteConfig(TrackMessage &message, uint32_t id
 {
 	message.clear();
 	message.prio = static_cast<uint8_t>(MessagePrio::noPrio);
-	message.command = static_cast<uint8_t>(MaerklinCanInterface::Cmd::locoFunc);
+	message.command = static_cast<uint8_t>(MaerklinCanInterface::Cmd::writeConfig);
 	message.length = 0x08;
 	message.data[0] = 0xFF & (id >> 24);
 	message.data[1] = 0xFF & (id >> 16);
@@ -1062,19 +1105,19 @@ bool MaerklinCanInterface::sendSetMfxCounter(uint16_t counter, uint32_t uid)
 	return sendMessage(message);
 }
 
-bool MaerklinCanInterface::sendSystemStatus(uint8_t channelNumber, uint32_t uid)
+bool MaerklinCanInterface::sendSystemStatus(uint8_t channelNumber, uint32_t uid, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageSystemStatus(message, channelNumber, uid);
-	ProgrammingCmd cmd{message, 500};
+	ProgrammingCmd cmd{message, 500, callback};
 	return queueProgrammingCmd(cmd);
 }
 
-bool MaerklinCanInterface::sendSystemStatus(uint8_t channelNumber, uint16_t configuration, uint32_t uid)
+bool MaerklinCanInterface::sendSystemStatus(uint8_t channelNumber, uint16_t configuration, uint32_t uid, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageSystemStatus(message, channelNumber, configuration, uid);
-	ProgrammingCmd cmd{message, 500};
+	ProgrammingCmd cmd{message, 500, callback};
 	return queueProgrammingCmd(cmd);
 }
 
@@ -1160,11 +1203,11 @@ bool MaerklinCanInterface::verifyMfxUid(uint32_t uid, uint16_t sid)
 	return queueProgrammingCmd(cmd);
 }
 
-bool MaerklinCanInterface::requestLocoSpeed(uint32_t uid)
+bool MaerklinCanInterface::requestLocoSpeed(uint32_t uid, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageLocoSpeed(message, uid);
-	return sendMessage(message);
+	return exchangeMessage(message, callback, 1000);
 }
 
 bool MaerklinCanInterface::setLocoSpeed(uint32_t uid, uint16_t speed)
@@ -1174,11 +1217,11 @@ bool MaerklinCanInterface::setLocoSpeed(uint32_t uid, uint16_t speed)
 	return sendMessage(message);
 }
 
-bool MaerklinCanInterface::requestLocoDir(uint32_t uid)
+bool MaerklinCanInterface::requestLocoDir(uint32_t uid, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageLocoDir(message, uid);
-	return sendMessage(message);
+	return exchangeMessage(message, callback, 1000);
 }
 
 bool MaerklinCanInterface::setLocoDir(uint32_t uid, uint8_t dir)
@@ -1188,11 +1231,11 @@ bool MaerklinCanInterface::setLocoDir(uint32_t uid, uint8_t dir)
 	return sendMessage(message);
 }
 
-bool MaerklinCanInterface::requestLocoFunc(uint32_t uid, uint8_t function)
+bool MaerklinCanInterface::requestLocoFunc(uint32_t uid, uint8_t function, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageLocoFunc(message, uid, function);
-	return sendMessage(message);
+	return exchangeMessage(message, callback, 1000);
 }
 
 bool MaerklinCanInterface::setLocoFunc(uint32_t uid, uint8_t function, uint8_t value)
@@ -1202,19 +1245,19 @@ bool MaerklinCanInterface::setLocoFunc(uint32_t uid, uint8_t function, uint8_t v
 	return sendMessage(message);
 }
 
-bool MaerklinCanInterface::sendReadConfig(uint32_t id, uint16_t cvAdr, uint8_t number)
+bool MaerklinCanInterface::sendReadConfig(uint32_t id, uint16_t cvAdr, uint8_t number, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageReadConfig(message, id, cvAdr, number);
-	ProgrammingCmd cmd{message, 1000};
+	ProgrammingCmd cmd{message, 1000, callback};
 	return queueProgrammingCmd(cmd);
 }
 
-bool MaerklinCanInterface::sendWriteConfig(uint32_t id, uint16_t cvAdr, uint8_t value, bool directProc, bool writeByte)
+bool MaerklinCanInterface::sendWriteConfig(uint32_t id, uint16_t cvAdr, uint8_t value, bool directProc, bool writeByte, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageWriteConfig(message, id, cvAdr, value, directProc, writeByte);
-	ProgrammingCmd cmd{message, 1000};
+	ProgrammingCmd cmd{message, 1000, callback};
 	return queueProgrammingCmd(cmd);
 }
 
@@ -1246,12 +1289,11 @@ bool MaerklinCanInterface::sendPing(uint32_t uid, uint16_t swVersion, uint16_t h
 	return sendMessage(message);
 }
 
-bool MaerklinCanInterface::requestStatusDataConfig(uint32_t uid, uint8_t index)
+bool MaerklinCanInterface::requestStatusDataConfig(uint32_t uid, uint8_t index, ProgrammingCallback callback)
 {
 	TrackMessage message;
 	messageStatusDataConfig(message, uid, index);
-	ProgrammingCmd cmd{message, 1000};
-	return queueProgrammingCmd(cmd);
+	return exchangeMessage(message, callback, 1000);
 }
 
 bool MaerklinCanInterface::requestConfigData(std::array<uint8_t, 8> &request)
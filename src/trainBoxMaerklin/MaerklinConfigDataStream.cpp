@@ -15,6 +15,82 @@
  */
 
 #include "trainBoxMaerklin/MaerklinConfigDataStream.h"
+#include <algorithm>
+
+namespace
+{
+    // CRC-16/CCITT (poly 0x1021, init 0xFFFF, not reflected) over the received config data
+    constexpr uint16_t crcPoly{0x1021};
+    constexpr uint16_t crcInit{0xFFFF};
+
+    // slicing by 8: table[k][b] is the crc of byte b followed by k zero bytes, so a whole 8 byte frame is done with 8 lookups
+    struct CrcTables
+    {
+        uint16_t table[8][256];
+    };
+
+    constexpr CrcTables makeCrcTables()
+    {
+        CrcTables tables{};
+        for (uint16_t b = 0; b < 256; b++)
+        {
+            uint16_t crc = static_cast<uint16_t>(b << 8);
+            for (uint8_t i = 0; i < 8; i++)
+            {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ crcPoly) : static_cast<uint16_t>(crc << 1);
+            }
+            tables.table[0][b] = crc;
+        }
+        for (uint8_t k = 1; k < 8; k++)
+        {
+            for (uint16_t b = 0; b < 256; b++)
+            {
+                uint16_t crc = tables.table[k - 1][b];
+                tables.table[k][b] = static_cast<uint16_t>((crc << 8) ^ tables.table[0][crc >> 8]);
+            }
+        }
+        return tables;
+    }
+
+    constexpr CrcTables crcTables = makeCrcTables();
+
+    constexpr uint16_t crcByte(uint16_t crc, uint8_t data)
+    {
+        return static_cast<uint16_t>((crc << 8) ^ crcTables.table[0][(crc >> 8) ^ data]);
+    }
+
+    constexpr uint16_t crcFrame(uint16_t crc, const uint8_t *data)
+    {
+        return crcTables.table[7][data[0] ^ (crc >> 8)] ^ crcTables.table[6][data[1] ^ (crc & 0xFF)] ^
+               crcTables.table[5][data[2]] ^ crcTables.table[4][data[3]] ^
+               crcTables.table[3][data[4]] ^ crcTables.table[2][data[5]] ^
+               crcTables.table[1][data[6]] ^ crcTables.table[0][data[7]];
+    }
+
+    constexpr bool crcTablesValid()
+    {
+        // check value of CRC-16/CCITT-FALSE
+        const uint8_t check[16] = {'1', '2', '3', '4', '5', '6', '7', '8', '9', 0, 0, 0, 0, 0, 0, 0};
+        uint16_t crc = crcInit;
+        for (uint8_t i = 0; i < 9; i++)
+        {
+            crc = crcByte(crc, check[i]);
+        }
+        if (0x29B1 != crc)
+        {
+            return false;
+        }
+        // a frame gives the same crc as its bytes
+        uint16_t crcBytes = crcInit;
+        for (uint8_t i = 0; i < 16; i++)
+        {
+            crcBytes = crcByte(crcBytes, check[i]);
+        }
+        return crcBytes == crcFrame(crcFrame(crcInit, check), check + 8);
+    }
+
+    static_assert(crcTablesValid(), "crc tables are invalid");
+}
 
 MaerklinConfigDataStream::MaerklinConfigDataStream(MaerklinCanInterface &interface, std::vector<MaerklinStationConfig> &stationList)
     : m_interface(interface), m_stationList(stationList)
@@ -23,18 +99,26 @@ MaerklinConfigDataStream::MaerklinConfigDataStream(MaerklinCanInterface &interfa
 
 MaerklinConfigDataStream::~MaerklinConfigDataStream()
 {
+    for (auto &session : m_sessions)
+    {
+        endInflate(session.second);
+    }
 }
 
-bool MaerklinConfigDataStream::requestConfigData(DataType type, std::string *info, std::string *buffer)
+bool MaerklinConfigDataStream::requestConfigData(DataType type, std::string *info, std::string *buffer, uint16_t stationHash)
 {
     if (nullptr == buffer)
     {
         return false;
     }
-    m_buffer = buffer;
-    m_buffer->clear();
-    m_lengthExpected = 0xFFFFFFFFUL;
-    m_length = 0;
+    // a repeated request replaces the old one and a transfer still running into this buffer
+    cancelConfigData(buffer);
+    buffer->clear();
+    if ((0 == stationHash) && !m_stationList.empty())
+    {
+        stationHash = m_stationList.front().hash;
+    }
+    m_pendingRequests.push_back(PendingRequest{buffer, DataType::Loks == type, millis() + m_requestTimeoutINms, stationHash});
 
     switch (type)
     {
@@ -119,6 +203,13 @@ bool MaerklinConfigDataStream::requestConfigData(DataType type, std::string *inf
         m_interface.requestConfigData(request);
     }
     break;
+    case DataType::Loks:
+    {
+        // zlib compressed lokomotive.cs2
+        std::array<uint8_t, 8> request = {'l', 'o', 'k', 's', 0, 0, 0, 0};
+        m_interface.requestConfigData(request);
+    }
+    break;
     default:
         Serial.println("DataType not supported");
         return false;
@@ -126,162 +217,303 @@ bool MaerklinConfigDataStream::requestConfigData(DataType type, std::string *inf
     return true;
 }
 
+void MaerklinConfigDataStream::cancelConfigData(std::string *buffer)
+{
+    for (auto request = m_pendingRequests.begin(); request != m_pendingRequests.end();)
+    {
+        request = (request->buffer == buffer) ? m_pendingRequests.erase(request) : std::next(request);
+    }
+    for (auto session = m_sessions.begin(); session != m_sessions.end();)
+    {
+        if (session->second.requested && (session->second.buffer == buffer))
+        {
+            endInflate(session->second);
+            session = m_sessions.erase(session);
+        }
+        else
+        {
+            ++session;
+        }
+    }
+}
+
 bool MaerklinConfigDataStream::onConfigData(uint16_t hash, std::array<uint8_t, 8> data)
 {
     Serial.println("onConfigData");
-    // expected hash can be set here in case of ConfigDataStream7
-    m_hashExpected = hash;
     return true;
 }
 
 bool MaerklinConfigDataStream::onConfigDataStream(uint16_t hash, uint32_t streamlength, uint16_t crc)
 {
     // Serial.println("onConfigDataStream6");
-    // receiver hash is expected
-    m_hashExpected = hash;
-    m_lengthExpected = streamlength;
-    m_length = 0;
-    m_crcExpected = crc;
-    m_buffer->clear();
-    m_configDataStreamStartReceived = true;
-    return true;
+    // receiver hash is used for the following frames
+    return startSession(hash, streamlength, crc);
 }
 
 bool MaerklinConfigDataStream::onConfigDataStream(uint16_t hash, uint32_t streamlength, uint16_t crc, uint8_t res)
 {
     // Serial.println("onConfigDataStream7");
-    // sender hash is expected
-    m_hashExpected = hash; // is already set in onConfigData
-    m_lengthExpected = streamlength;
-    // Serial.print("m_lengthExpected:");
-    // Serial.println(m_lengthExpected);
-    m_length = 0;
-    m_crcExpected = crc;
-    m_buffer->clear();
-    m_configDataStreamStartReceived = true;
-    return true;
+    // sender hash is used for the following frames
+    return startSession(hash, streamlength, crc);
 }
 
 bool MaerklinConfigDataStream::onConfigDataStream(uint16_t hash, std::array<uint8_t, 8> &data)
 {
     // Serial.println("onConfigDataStream8");
-    bool result{false};
-    // hash is expected the same as in start message
-    if (m_configDataStreamStartReceived)
+    auto session = m_sessions.find(hash);
+    if (session == m_sessions.end())
     {
-        if (hash == m_hashExpected)
-        {
-            // for (auto i : data)
-            // {
-            //     Serial.print((char)i);
-            // }
-            // Serial.print("\n");
-
-            result = true;
-            if (nullptr != m_buffer)
-            {
-                for (auto i : data)
-                {
-                    m_buffer->push_back(i);
-                }
-            }
-            m_length += 8;
-
-            // Serial.print("m_length");
-            // Serial.println(m_length);
-            if (m_length >= m_lengthExpected)
-            {
-                m_configDataStreamStartReceived = false;
-                // Serial.println("Successsfull reading");
-                // if (nullptr != m_buffer)
-                // {
-                //     for (auto i : (*m_buffer))
-                //     {
-                //         Serial.print((char)i);
-                //     }
-                //     Serial.print("\n");
-                // }
-
-                uint16_t CRC_acc = 0xFFFF;
-                for (uint8_t i : (*m_buffer))
-                {
-                    CRC_acc = updateCRC(CRC_acc, i);
-                }
-                // Serial.print("CRC:");
-                // Serial.print(m_crcExpected);
-                // Serial.print("::");
-                // Serial.println(CRC_acc);
-                if (m_crcExpected == CRC_acc)
-                {
-                    // if (nullptr != m_reportResultFunc)
-                    // {
-                    //     m_reportResultFunc(m_buffer, hash, true);
-                    // }
-                    Serial.println("CRC success");
-                    m_length = 0;
-                    m_reportResultFunc(m_buffer, hash, true);
-                    m_buffer->clear();
-                    // Success
-                    // copy buffer to new location and request next file if needed
-                }
-                else
-                {
-                    // if (nullptr != m_reportResultFunc)
-                    // {
-                    //     m_reportResultFunc(m_buffer, hash, false);
-                    // }
-                    Serial.printf("CRC failed %d : %d", m_crcExpected, CRC_acc);
-                    m_length = 0;
-                    m_reportResultFunc(nullptr, hash, false);
-                    m_buffer->clear();                    
-                }
-            }
-        }
+        // we received data before trigger message. ignore this data
+        return false;
+    }
+    StreamSession &stream = session->second;
+    if (stream.compressed)
+    {
+        inflateFrame(stream, data);
     }
     else
     {
-        // we received data before trigger message. ignore this data
+        stream.buffer->append(reinterpret_cast<const char *>(data.data()), data.size());
+        trackBufferCapacity(stream);
+    }
+    stream.length += 8;
+    stream.crc = updateCRC(stream.crc, data);
+    stream.deadlineINms = millis() + m_sessionTimeoutINms;
+
+    if (stream.length >= stream.lengthExpected)
+    {
+        finishSession(session);
     }
-    return result;
+    return true;
 }
 
 bool MaerklinConfigDataStream::onConfigDataSteamError(uint16_t hash)
 {
     Serial.println("onConfigDataSteamError");
-    if (m_configDataStreamStartReceived && (hash == m_hashExpected))
+    auto session = m_sessions.find(hash);
+    if (session == m_sessions.end())
+    {
+        return false;
+    }
+    bool requested = session->second.requested;
+    endInflate(session->second);
+    m_sessions.erase(session);
+    if (requested)
     {
-        m_configDataStreamStartReceived = false;
-        m_lengthExpected = 0;
-        m_hashExpected = 0;
-        m_buffer = &m_backupBuffer;
-        m_reportResultFunc(nullptr, hash, false);
-        return true;
+        m_reportResultFunc(nullptr, hash, false, true);
     }
-    return false;
+    return true;
 }
 
-uint16_t MaerklinConfigDataStream::updateCRC(uint16_t CRC_acc, uint8_t CRC_input)
+void MaerklinConfigDataStream::cyclic()
 {
-#define POLY 0x1021
-    // Create the CRC "dividend" for polynomial arithmetic (binary arithmetic with no carries)
-    CRC_acc = CRC_acc ^ (CRC_input << 8);
-    // "Divide" the poly into the dividend using CRC XOR subtraction CRC_acc holds the
-    // "remainder" of each divide. Only complete this division for 8 bits since input is 1 byte
-    for (int i = 0; i < 8; i++)
-    {
-        // Check if the MSB is set (if MSB is 1, then the POLY can "divide" into the "dividend")
-        if ((CRC_acc & 0x8000) == 0x8000)
+    unsigned long currentTimeINms = millis();
+    for (auto session = m_sessions.begin(); session != m_sessions.end();)
+    {
+        if (static_cast<long>(currentTimeINms - session->second.deadlineINms) >= 0)
         {
-            // if so, shift the CRC value, and XOR "subtract" the poly
-            CRC_acc = CRC_acc << 1;
-            CRC_acc ^= POLY;
+            // requester handles its own timeout
+            Serial.printf("Config stream of hash %x timed out\n", session->first);
+            endInflate(session->second);
+            session = m_sessions.erase(session);
         }
         else
         {
-            // if not, just shift the CRC value
-            CRC_acc = CRC_acc << 1;
+            ++session;
+        }
+    }
+    while (!m_pendingRequests.empty() && (static_cast<long>(currentTimeINms - m_pendingRequests.front().deadlineINms) >= 0))
+    {
+        m_pendingRequests.pop_front();
+    }
+}
+
+bool MaerklinConfigDataStream::startSession(uint16_t hash, uint32_t streamlength, uint16_t crc)
+{
+    // map nodes are not moved, so inflate can keep its pointer to the z_stream of the session
+    StreamSession &stream = m_sessions[hash];
+    endInflate(stream);
+    // a restarted stream keeps its request, a new one takes the oldest open request to its sender.
+    // Streams of other devices are received into the own buffer of the session
+    if (!stream.requested)
+    {
+        auto request = std::find_if(m_pendingRequests.begin(), m_pendingRequests.end(), [this, hash](const PendingRequest &pending)
+                                    { return (0 == pending.stationHash) || (hash == pending.stationHash) || (hash == m_hash); });
+        if (request != m_pendingRequests.end())
+        {
+            stream.buffer = request->buffer;
+            stream.compressed = request->compressed;
+            stream.requested = true;
+            m_pendingRequests.erase(request);
+        }
+        else
+        {
+            stream.buffer = &stream.ownBuffer;
+            stream.compressed = false;
+        }
+    }
+    stream.length = 0;
+    stream.lengthExpected = streamlength;
+    stream.crc = crcInit;
+    stream.crcExpected = crc;
+    stream.uncompressedLength = 0;
+    stream.inflateFinished = false;
+    stream.statistics = TransferStatistics{};
+    stream.startTimeINms = millis();
+    stream.deadlineINms = stream.startTimeINms + m_sessionTimeoutINms;
+
+    // clear keeps the capacity, so the buffer is reused as arena for all following transfers
+    stream.buffer->clear();
+    stream.bufferCapacity = stream.buffer->capacity();
+    if (stream.compressed)
+    {
+        // output is reserved as soon as the uncompressed length is received
+        stream.inflateStream = z_stream{};
+        stream.inflateActive = (Z_OK == inflateInit(&stream.inflateStream));
+    }
+    else
+    {
+        size_t paddedLength = (static_cast<size_t>(streamlength) + 7) & ~static_cast<size_t>(7);
+        if (paddedLength <= m_maxUncompressedLength)
+        {
+            stream.buffer->reserve(paddedLength);
+            trackBufferCapacity(stream);
+        }
+    }
+    return true;
+}
+
+void MaerklinConfigDataStream::finishSession(std::map<uint16_t, StreamSession>::iterator session)
+{
+    uint16_t hash = session->first;
+    StreamSession &stream = session->second;
+
+    stream.statistics.bytes = stream.length;
+    stream.statistics.durationINms = millis() - stream.startTimeINms;
+    if (0 != stream.statistics.durationINms)
+    {
+        stream.statistics.bytesPerSecond = static_cast<uint32_t>((static_cast<uint64_t>(stream.length) * 1000) / stream.statistics.durationINms);
+    }
+    m_transferStatistics = stream.statistics;
+
+    bool inflated = !stream.compressed || (stream.inflateFinished && (stream.inflateStream.total_out == stream.uncompressedLength));
+    endInflate(stream);
+    bool crcValid = (stream.crcExpected == stream.crc);
+    uint16_t crc = stream.crc;
+    uint16_t crcExpected = stream.crcExpected;
+    bool requested = stream.requested;
+
+    // session is removed before reporting, since the report may already start the next request
+    std::string data;
+    std::string *buffer = stream.buffer;
+    if (!requested)
+    {
+        data = std::move(stream.ownBuffer);
+        buffer = &data;
+    }
+    m_sessions.erase(session);
+
+    if (crcValid && inflated)
+    {
+        Serial.println("CRC success");
+        Serial.printf("%u bytes in %lu ms, %u bytes/s, %u reallocations\n", m_transferStatistics.bytes, m_transferStatistics.durationINms,
+                      m_transferStatistics.bytesPerSecond, m_transferStatistics.reallocations);
+        m_reportResultFunc(buffer, hash, true, requested);
+    }
+    else
+    {
+        Serial.printf("CRC failed %d : %d inflated %d", crcExpected, crc, inflated);
+        // nobody waits for a failed stream that was not requested
+        if (requested)
+        {
+            m_reportResultFunc(nullptr, hash, false, true);
         }
     }
-    // Return the final remainder (CRC value)
-    return CRC_acc;
-}
\ No newline at end of file
+}
+
+void MaerklinConfigDataStream::trackBufferCapacity(StreamSession &stream)
+{
+    if (stream.buffer->capacity() != stream.bufferCapacity)
+    {
+        stream.bufferCapacity = stream.buffer->capacity();
+        stream.statistics.reallocations++;
+    }
+}
+
+uint16_t MaerklinConfigDataStream::updateCRC(uint16_t CRC_acc, const std::array<uint8_t, 8> &data)
+{
+    return crcFrame(CRC_acc, data.data());
+}
+
+uint16_t MaerklinConfigDataStream::calculateCRC(const std::string &data)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+    size_t index = 0;
+    uint16_t crc = crcInit;
+    for (; (index + 8) <= data.size(); index += 8)
+    {
+        crc = crcFrame(crc, bytes + index);
+    }
+    for (; index < data.size(); index++)
+    {
+        crc = crcByte(crc, bytes[index]);
+    }
+    return crc;
+}
+
+void MaerklinConfigDataStream::endInflate(StreamSession &stream)
+{
+    if (stream.inflateActive)
+    {
+        inflateEnd(&stream.inflateStream);
+        stream.inflateActive = false;
+    }
+}
+
+void MaerklinConfigDataStream::inflateFrame(StreamSession &stream, const std::array<uint8_t, 8> &data)
+{
+    // bytes behind streamlength are padding of the last frame
+    size_t end = data.size();
+    if ((stream.length + end) > stream.lengthExpected)
+    {
+        end = (stream.lengthExpected > stream.length) ? (stream.lengthExpected - stream.length) : 0;
+    }
+    size_t start = 0;
+    // uncompressed length in big endian is sent in front of the zlib data
+    for (; (start < end) && ((stream.length + start) < 4); start++)
+    {
+        stream.uncompressedLength = (stream.uncompressedLength << 8) | data[start];
+        if (3 == (stream.length + start))
+        {
+            if (stream.uncompressedLength > m_maxUncompressedLength)
+            {
+                Serial.printf("Uncompressed length %u too big", stream.uncompressedLength);
+                endInflate(stream);
+            }
+            else
+            {
+                // whole output is reserved once, so inflate writes directly into the buffer
+                stream.buffer->resize(stream.uncompressedLength);
+                trackBufferCapacity(stream);
+            }
+        }
+    }
+    if (!stream.inflateActive || stream.inflateFinished || (start >= end))
+    {
+        return;
+    }
+    stream.inflateStream.next_in = const_cast<Bytef *>(data.data() + start);
+    stream.inflateStream.avail_in = end - start;
+    stream.inflateStream.next_out = reinterpret_cast<Bytef *>(&(*stream.buffer)[0]) + stream.inflateStream.total_out;
+    stream.inflateStream.avail_out = stream.uncompressedLength - stream.inflateStream.total_out;
+    int ret = inflate(&stream.inflateStream, Z_NO_FLUSH);
+    if (Z_STREAM_END == ret)
+    {
+        stream.inflateFinished = true;
+    }
+    else if ((Z_OK != ret) && (Z_BUF_ERROR != ret))
+    {
+        Serial.printf("Inflate failed %d", ret);
+        endInflate(stream);
+    }
+}
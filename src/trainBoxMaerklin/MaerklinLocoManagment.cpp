@@ -16,6 +16,47 @@
 
 #include "trainBoxMaerklin/MaerklinLocoManagment.h"
 #include "Cs2DataParser.h"
+#include <algorithm>
+
+namespace
+{
+    // keys of lokinfo that are named differently in lokomotive.cs2, everything else is copied
+    struct KeyTranslation
+    {
+        const char *ms2Key;
+        size_t keyLength;
+        // the line end of function keys is kept
+        size_t consumedLength;
+        const char *cs2Key;
+        // functions are numbered in the order they appear
+        bool numbered;
+    };
+
+    constexpr KeyTranslation keyTranslations[] = {
+        {".fkt\n", 5, 4, ".funktionen\n ..nr=", true},
+        {".fkt2\n", 6, 5, ".funktionen_2\n ..nr=", true},
+        {".typ2", 5, 5, ".typ", false},
+        {".dauer2", 7, 7, ".dauer", false},
+        {".wert2", 6, 6, ".wert", false}};
+
+    // compares only the length of the key, not the rest of the data
+    bool startsWith(const std::string &data, size_t index, const char *key, size_t keyLength)
+    {
+        return 0 == data.compare(index, keyLength, key, keyLength);
+    }
+
+    const KeyTranslation *findKeyTranslation(const std::string &data, size_t index)
+    {
+        for (const KeyTranslation &translation : keyTranslations)
+        {
+            if (startsWith(data, index, translation.ms2Key, translation.keyLength))
+            {
+                return &translation;
+            }
+        }
+        return nullptr;
+    }
+}
 
 MaerklinLocoManagment::MaerklinLocoManagment(uint32_t uid, MaerklinCanInterface &interface,
                                              std::vector<MaerklinStationConfig> &stationList, unsigned long messageTimeout,
@@ -30,6 +71,7 @@ MaerklinLocoManagment::MaerklinLocoManagment(uint32_t uid, MaerklinCanInterface
 
 MaerklinLocoManagment::~MaerklinLocoManagment()
 {
+    cancelLocoInfoRequests();
 }
 
 uint32_t MaerklinLocoManagment::getUid()
@@ -37,13 +79,23 @@ uint32_t MaerklinLocoManagment::getUid()
     return m_uid;
 }
 
-void MaerklinLocoManagment::getLokomotiveConfig(void (*writeFileCallback)(std::string *data), void (*resultCallback)(bool success))
+void MaerklinLocoManagment::getLokomotiveConfig(void (*writeFileCallback)(std::string *data, bool changed), void (*resultCallback)(bool success))
 {
     m_resultCallback = resultCallback;
     m_writeFileCallback = writeFileCallback;
-    m_state = LocoManagmentState::WaitingForLocoList;
     m_currentInfo.clear();
-    m_currentType = DataType::Lokliste;
+    m_locoListEntryCrcs.clear();
+    if (m_useCompressedLocoFile)
+    {
+        // whole lokomotive.cs2 in one compressed transfer
+        m_state = LocoManagmentState::WaitingForLocoFile;
+        m_currentType = DataType::Loks;
+    }
+    else
+    {
+        m_state = LocoManagmentState::WaitingForLocoList;
+        m_currentType = DataType::Lokliste;
+    }
     startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
     // m_state = LocoManagmentState::WaitingForLocoNamen;
     // m_currentInfo = "0 2";
@@ -82,107 +134,96 @@ bool MaerklinLocoManagment::Ms2LocoToCs2Loco(std::string &locoName, std::string
     {
         return false;
     }
+    const std::string &ms2 = *ms2Data;
+    std::string &cs2 = *cs2Data;
     uint8_t functionNumber = 0;
-    size_t strLenFkt = strlen(".fkt\n") - 2;
-    size_t index = ms2Data->find("lok\n");
-    *cs2Data = "";
-    if (std::string::npos != index)
-    {
-        *cs2Data = "lokomotive\n .name=" + locoName + "\n .icon=loco\n ";
-        size_t indexEndOfFile = ms2Data->find_last_of('\n');
-        bool newLine = true;
-        for (index += 4; index < ms2Data->size(); index++)
+    size_t index = ms2.find("lok\n");
+    cs2.clear();
+    if (std::string::npos == index)
+    {
+        return false;
+    }
+    // every line gets one more space and every function about 20 characters
+    cs2.reserve(ms2.size() + ms2.size() / 2 + locoName.size() + 32);
+    cs2 += "lokomotive\n .name=";
+    cs2 += locoName;
+    cs2 += "\n .icon=loco\n ";
+    size_t indexEndOfFile = ms2.find_last_of('\n');
+    bool newLine = true;
+    for (index += 4; index < ms2.size(); index++)
+    {
+        if (indexEndOfFile == index)
         {
-            char character = ms2Data->at(index);
-            if (' ' == character)
-            {
-                if (newLine)
-                {
-                    continue;
-                }
-                else
-                {
-                    *cs2Data += character;
-                }
-            }
-            else if (indexEndOfFile == index)
-            {
-                *cs2Data += "\n";
-                break;
-            }
-            else if ('\r' == character)
-            {
-                continue;
-            }
-            else if ('\n' == character)
+            cs2 += '\n';
+            break;
+        }
+        char character = ms2[index];
+        switch (character)
+        {
+        case ' ':
+            // indentation is replaced by the one of lokomotive.cs2
+            if (!newLine)
             {
-                newLine = true;
-                *cs2Data += "\n ";
+                cs2 += character;
             }
-            else if ('.' == character)
+            break;
+        case '\r':
+            break;
+        case '\n':
+            newLine = true;
+            cs2 += "\n ";
+            break;
+        case '.':
+        {
+            newLine = false;
+            const KeyTranslation *translation = findKeyTranslation(ms2, index);
+            if (nullptr != translation)
             {
-                newLine = false;
-                if (ms2Data->find(".fkt\n", index) == index)
+                cs2 += translation->cs2Key;
+                if (translation->numbered)
                 {
-                    *cs2Data += ".funktionen\n ..nr=";
                     char intBuffer[4];
                     sprintf(intBuffer, "%u", functionNumber);
-                    *cs2Data += intBuffer;
+                    cs2 += intBuffer;
                     functionNumber++;
-                    index += strLenFkt;
                 }
-                else if (ms2Data->find(".fkt2\n", index) == index)
-                {
-                    *cs2Data += ".funktionen_2\n ..nr=";
-                    char intBuffer[4];
-                    sprintf(intBuffer, "%u", functionNumber);
-                    *cs2Data += intBuffer;
-                    functionNumber++;
-                    index += (strLenFkt + 1);
-                }
-                else if (ms2Data->find(".typ2", index) == index)
-                {
-                    *cs2Data += ".typ";
-                    index += 4;
-                }
-                else if (ms2Data->find(".dauer2", index) == index)
-                {
-                    *cs2Data += ".dauer";
-                    index += 6;
-                }
-                else if (ms2Data->find(".wert2", index) == index)
-                {
-                    *cs2Data += ".wert";
-                    index += 5;
-                }
-                else if ((ms2Data->find(".name=", index) == index) && (ms2Data->at(index - 1) != '.'))
-                {
-                    while (ms2Data->at(index) != '\n')
-                    {
-                        index++;
-                    }
-                    index++;
-                    newLine = true;
-                }
-                else
+                index += translation->consumedLength - 1;
+            }
+            else if (startsWith(ms2, index, ".name=", 6) && ('.' != ms2[index - 1]))
+            {
+                // name was already written, the line is dropped together with the first character of the next one
+                size_t lineEnd = ms2.find('\n', index);
+                if (std::string::npos == lineEnd)
                 {
-                    *cs2Data += character;
+                    return true;
                 }
+                index = lineEnd + 1;
+                newLine = true;
             }
             else
             {
-                newLine = false;
-                *cs2Data += character;
+                cs2 += character;
             }
         }
-        return true;
+        break;
+        default:
+            newLine = false;
+            cs2 += character;
+            break;
+        }
     }
-    return false;
+    return true;
 }
 
 void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, uint16_t hash, bool success)
 {
-    if (m_transmissionStarted) // message expected
+    if (LocoManagmentState::WaitingForLocoInfo == m_state)
+    {
+        handleLocoInfoFeedback(data, success);
+        return;
+    }
+    // only data in m_buffer answers the running request
+    if (m_transmissionStarted && ((nullptr == data) || (&m_buffer == data))) // message expected
     {
         if (success)
         {
@@ -201,6 +242,15 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                 }
                 switch (m_state)
                 {
+                case LocoManagmentState::WaitingForLocoFile:
+                {
+                    if (m_debug)
+                    {
+                        Serial.println("Received lokomotive.cs2");
+                    }
+                    writeLocoFile(data);
+                }
+                break;
                 case LocoManagmentState::WaitingForLocoList:
                 {
                     if (m_debug)
@@ -210,6 +260,7 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                     // extract all loconames and switch to lokinfo for getting data
                     size_t nameStringSize = strlen(".name=");
                     m_locoList.clear();
+                    m_locoListEntryCrcs.clear();
                     for (size_t index = 0, nameEnd = 0; (index = data->find(".name=", index)) != std::string::npos; index = nameEnd)
                     {
                         index += nameStringSize;
@@ -218,6 +269,13 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                         if (!locoName.empty())
                         {
                             m_locoList.emplace_back(move(locoName));
+                            // entry of the loco reaches up to the name of the next one, the last one ends before the padding
+                            size_t entryEnd = data->find(".name=", index);
+                            if (std::string::npos == entryEnd)
+                            {
+                                entryEnd = data->find('\0', index);
+                            }
+                            m_locoListEntryCrcs.push_back(calculateCRC(data->substr(index, entryEnd - index)));
                         }
                         // Serial.print("Found loco:");
                         // Serial.print(m_locos->back()->name.c_str());
@@ -225,7 +283,6 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                         // Serial.println(m_buffer->substr(index, nameEnd - index).size());
                     }
                     m_numberOfLoco = m_locoList.size();
-                    m_currentLocoNum = 0;
                     if (m_debug)
                     {
                         Serial.println("locos:");
@@ -243,7 +300,7 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                                                    " .minor=3\n"
                                                    "session\n"
                                                    " .id=1\n"};
-                            m_writeFileCallback(&baseString);
+                            m_writeFileCallback(&baseString, false);
                         }
 
                         if (m_debug)
@@ -252,10 +309,7 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                             Serial.print(m_numberOfLoco);
                             Serial.println(" locos");
                         }
-                        m_state = LocoManagmentState::WaitingForLocoInfo;
-                        m_currentType = DataType::Lokinfo;
-                        m_currentInfo = m_locoList.at(m_currentLocoNum);
-                        startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
+                        startLocoInfoDownload();
                     }
                     else
                     {
@@ -263,34 +317,6 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                     }
                 }
                 break;
-                case LocoManagmentState::WaitingForLocoInfo:
-                {
-                    if (nullptr != m_writeFileCallback)
-                    {
-                        // transform loco string into new string
-                        std::string cs2LocoString;
-                        // Serial.print(data->c_str());
-                        Ms2LocoToCs2Loco(m_locoList.at(m_currentLocoNum), data, &cs2LocoString);
-                        m_writeFileCallback(&cs2LocoString);
-                    }
-                    m_currentLocoNum++;
-                    if (m_currentLocoNum < m_locoList.size())
-                    {
-                        m_state = LocoManagmentState::WaitingForLocoInfo;
-                        m_currentType = DataType::Lokinfo;
-                        m_currentInfo = m_locoList.at(m_currentLocoNum);
-                        startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
-                    }
-                    else
-                    {
-                        // all loco received
-                        if (nullptr != m_resultCallback)
-                        {
-                            m_resultCallback(true);
-                        }
-                    }
-                }
-                break;
                 case LocoManagmentState::WaitingForLocoNamen:
                 {
                     if (0 == m_locoList.size())
@@ -331,12 +357,7 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
                     }
                     else
                     {
-                        // request first locoinfo
-                        m_currentLocoNum = 0;
-                        m_state = LocoManagmentState::WaitingForLocoInfo;
-                        m_currentType = DataType::Lokinfo;
-                        m_currentInfo = m_locoList.at(m_currentLocoNum);
-                        startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
+                        startLocoInfoDownload();
                     }
                     // Serial.printf("LocoNamen:%s", data);
                     if (nullptr != m_resultCallback)
@@ -359,30 +380,25 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
             m_transmissionStarted = false;
             switch (m_state)
             {
+            case LocoManagmentState::WaitingForLocoFile:
+                // station does not support compressed files, read locos one by one
+                m_state = LocoManagmentState::WaitingForLocoList;
+                m_currentInfo.clear();
+                m_currentType = DataType::Lokliste;
+                startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
+                break;
+
             case LocoManagmentState::WaitingForLocoList:
                 // Does not seem to work
                 // Switch to old version
                 m_locoList.clear();
+                m_locoListEntryCrcs.clear();
                 m_state = LocoManagmentState::WaitingForLocoNamen;
                 m_currentInfo = "0 2";
                 m_currentType = DataType::Loknamen;
                 startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
                 break;
 
-            case LocoManagmentState::WaitingForLocoInfo:
-            {
-                Serial.print("Could not get loco:");
-                Serial.println(m_locoList.at(m_currentLocoNum).c_str());
-                m_currentLocoNum++;
-                if (m_currentLocoNum < m_locoList.size())
-                {
-                    m_state = LocoManagmentState::WaitingForLocoInfo;
-                    m_currentType = DataType::Lokinfo;
-                    m_currentInfo = m_locoList.at(m_currentLocoNum);
-                    startConfigDataRequest(m_currentType, &m_currentInfo, &m_buffer, 1);
-                }
-            }
-            break;
             case LocoManagmentState::WaitingForLocoNamen:
             {
                 // all loco received
@@ -417,7 +433,13 @@ void MaerklinLocoManagment::handleConfigDataStreamFeedback(std::string *data, ui
 
 void MaerklinLocoManagment::cyclic()
 {
-    if (m_transmissionStarted)
+    MaerklinConfigDataStream::cyclic();
+
+    if (LocoManagmentState::WaitingForLocoInfo == m_state)
+    {
+        handleLocoInfoTimeouts();
+    }
+    else if (m_transmissionStarted)
     {
         unsigned long currentTimeINms = millis();
         if ((m_lastCmdTimeINms + m_cmdTimeoutINms) < currentTimeINms)
@@ -439,3 +461,306 @@ void MaerklinLocoManagment::cyclic()
         }
     }
 }
+
+void MaerklinLocoManagment::startLocoInfoDownload()
+{
+    m_state = LocoManagmentState::WaitingForLocoInfo;
+    m_currentType = DataType::Lokinfo;
+    m_transmissionStarted = false;
+    cancelLocoInfoRequests();
+    m_locoInfoStates.assign(m_locoList.size(), LocoInfoState::Pending);
+    m_locoInfoChanged.assign(m_locoList.size(), false);
+    m_nextLocoInfoNum = 0;
+    m_nextWrittenLocoInfoNum = 0;
+    dropRemovedLocosFromCache();
+    // without lokliste there is nothing to compare with, so every loco is downloaded again
+    if (m_locoListEntryCrcs.size() == m_locoList.size())
+    {
+        for (size_t locoNum = 0; locoNum < m_locoList.size(); locoNum++)
+        {
+            auto entry = m_locoCache.find(m_locoList.at(locoNum));
+            if ((entry != m_locoCache.end()) && entry->second.listEntryKnown &&
+                (entry->second.listEntryCrc == m_locoListEntryCrcs.at(locoNum)) && !entry->second.cs2Data.empty())
+            {
+                m_locoInfoStates.at(locoNum) = LocoInfoState::Cached;
+            }
+        }
+    }
+    if (m_debug)
+    {
+        Serial.print("Locos to download:");
+        Serial.println(std::count(m_locoInfoStates.begin(), m_locoInfoStates.end(), LocoInfoState::Pending));
+    }
+    writeLocoInfos();
+    requestNextLocoInfos();
+}
+
+std::string MaerklinLocoManagment::getLocoCacheIndex() const
+{
+    std::string index;
+    for (auto &entry : m_locoCache)
+    {
+        char crcs[16];
+        snprintf(crcs, sizeof(crcs), "%u;%04x;%04x;", entry.second.listEntryKnown ? 1 : 0, entry.second.listEntryCrc, entry.second.infoCrc);
+        index += crcs;
+        index += entry.first;
+        index += '\n';
+    }
+    return index;
+}
+
+void MaerklinLocoManagment::restoreLocoCache(const std::string &index, const std::vector<Cs2DataParser::LocoRange> &locos,
+                                             std::function<bool(size_t, size_t, std::string &)> readLoco)
+{
+    m_locoCache.clear();
+    for (size_t lineStart = 0, lineEnd = 0; lineStart < index.size(); lineStart = lineEnd + 1)
+    {
+        lineEnd = index.find('\n', lineStart);
+        if (std::string::npos == lineEnd)
+        {
+            lineEnd = index.size();
+        }
+        unsigned int listEntryKnown = 0;
+        unsigned int listEntryCrc = 0;
+        unsigned int infoCrc = 0;
+        int nameStart = 0;
+        std::string line = index.substr(lineStart, lineEnd - lineStart);
+        if ((3 != sscanf(line.c_str(), "%u;%x;%x;%n", &listEntryKnown, &listEntryCrc, &infoCrc, &nameStart)) || (0 == nameStart))
+        {
+            continue;
+        }
+        std::string name = line.substr(nameStart);
+        // only locos that are still in the file can be written from the cache
+        auto loco = std::find_if(locos.begin(), locos.end(), [&name](const Cs2DataParser::LocoRange &range)
+                                 { return range.name == name; });
+        std::string cs2Data;
+        if ((loco != locos.end()) && readLoco(loco->offset, loco->length, cs2Data))
+        {
+            LocoCacheEntry &entry = m_locoCache[name];
+            entry.listEntryKnown = (0 != listEntryKnown);
+            entry.listEntryCrc = static_cast<uint16_t>(listEntryCrc);
+            entry.infoCrc = static_cast<uint16_t>(infoCrc);
+            entry.cs2Data = std::move(cs2Data);
+        }
+    }
+    if (m_debug)
+    {
+        Serial.print("Restored locos:");
+        Serial.println(m_locoCache.size());
+    }
+}
+
+void MaerklinLocoManagment::dropRemovedLocosFromCache()
+{
+    for (auto entry = m_locoCache.begin(); entry != m_locoCache.end();)
+    {
+        if (std::find(m_locoList.begin(), m_locoList.end(), entry->first) == m_locoList.end())
+        {
+            entry = m_locoCache.erase(entry);
+        }
+        else
+        {
+            ++entry;
+        }
+    }
+}
+
+void MaerklinLocoManagment::writeLocoFile(std::string *data)
+{
+    // the file is split into its locos, so they are written the same way as with lokinfo
+    std::vector<Cs2DataParser::LocoRange> locos;
+    Cs2DataParser::indexLocos(data->data(), data->size(), locos);
+    m_locoList.clear();
+    m_locoListEntryCrcs.clear();
+    if (nullptr != m_writeFileCallback)
+    {
+        // version and session in front of the first loco
+        std::string header = data->substr(0, locos.empty() ? data->size() : locos.front().offset);
+        m_writeFileCallback(&header, false);
+    }
+    for (auto &loco : locos)
+    {
+        m_locoList.push_back(loco.name);
+        std::string cs2Data = data->substr(loco.offset, loco.length);
+        uint16_t crc = calculateCRC(cs2Data);
+        LocoCacheEntry &entry = m_locoCache[loco.name];
+        bool changed = entry.cs2Data.empty() || (entry.infoCrc != crc);
+        entry.cs2Data = std::move(cs2Data);
+        entry.infoCrc = crc;
+        // a following sync with lokliste does not know whether the loco changed
+        entry.listEntryKnown = false;
+        if (nullptr != m_writeFileCallback)
+        {
+            m_writeFileCallback(&entry.cs2Data, changed);
+        }
+    }
+    m_numberOfLoco = m_locoList.size();
+    dropRemovedLocosFromCache();
+    m_state = LocoManagmentState::Idle;
+    if (nullptr != m_resultCallback)
+    {
+        m_resultCallback(true);
+    }
+}
+
+void MaerklinLocoManagment::cancelLocoInfoRequests()
+{
+    for (auto &request : m_locoInfoRequests)
+    {
+        cancelConfigData(&request.buffer);
+    }
+    m_locoInfoRequests.clear();
+}
+
+void MaerklinLocoManagment::requestNextLocoInfos()
+{
+    while ((m_locoInfoRequests.size() < m_locoInfoWindow) && (m_nextLocoInfoNum < m_locoList.size()))
+    {
+        // list keeps the buffer at its place while the stream is written into it
+        size_t locoNum = m_nextLocoInfoNum++;
+        if (LocoInfoState::Pending != m_locoInfoStates.at(locoNum))
+        {
+            continue;
+        }
+        m_locoInfoRequests.emplace_back();
+        LocoInfoRequest &request = m_locoInfoRequests.back();
+        request.locoNum = locoNum;
+        request.info = m_locoList.at(request.locoNum);
+        requestLocoInfo(request);
+    }
+}
+
+void MaerklinLocoManagment::requestLocoInfo(LocoInfoRequest &request)
+{
+    requestConfigData(DataType::Lokinfo, &request.info, &request.buffer);
+    request.deadlineINms = millis() + m_cmdTimeoutINms;
+}
+
+void MaerklinLocoManagment::handleLocoInfoFeedback(std::string *data, bool success)
+{
+    if (!success || (nullptr == data))
+    {
+        // the failed request is not known, it is repeated after its own timeout
+        return;
+    }
+    for (auto request = m_locoInfoRequests.begin(); request != m_locoInfoRequests.end(); ++request)
+    {
+        if (&request->buffer == data)
+        {
+            // a lokinfo does not say which request it answers. A late answer to a reissued request
+            // takes the buffer of the oldest open one, so the name decides to which loco it belongs
+            std::string locoName;
+            Cs2DataParser::getParameter(data, ".name=", locoName, 0);
+            if (!locoName.empty() && ('\r' == locoName.back()))
+            {
+                locoName.pop_back();
+            }
+            auto owner = request;
+            if (!locoName.empty() && (locoName != request->info))
+            {
+                owner = std::find_if(m_locoInfoRequests.begin(), m_locoInfoRequests.end(), [&locoName](const LocoInfoRequest &other)
+                                     { return other.info == locoName; });
+                if (owner != m_locoInfoRequests.end())
+                {
+                    // its own answer may not come any more
+                    cancelConfigData(&owner->buffer);
+                }
+            }
+            if (owner != m_locoInfoRequests.end())
+            {
+                handleLocoInfo(*owner, data);
+            }
+            if (owner != request)
+            {
+                Serial.print("Lokinfo of other loco, repeat loco:");
+                Serial.println(request->info.c_str());
+                requestLocoInfo(*request);
+            }
+            if (owner != m_locoInfoRequests.end())
+            {
+                m_locoInfoRequests.erase(owner);
+                writeLocoInfos();
+                requestNextLocoInfos();
+            }
+            return;
+        }
+    }
+}
+
+void MaerklinLocoManagment::handleLocoInfo(LocoInfoRequest &request, std::string *data)
+{
+    // only a lokinfo that differs from the cached one has to be converted and written to the database
+    uint16_t infoCrc = calculateCRC(*data);
+    LocoCacheEntry &entry = m_locoCache[m_locoList.at(request.locoNum)];
+    bool changed = entry.cs2Data.empty() || (entry.infoCrc != infoCrc);
+    if (changed)
+    {
+        // transform loco string into new string
+        Ms2LocoToCs2Loco(m_locoList.at(request.locoNum), data, &entry.cs2Data);
+        entry.infoCrc = infoCrc;
+    }
+    entry.listEntryKnown = (m_locoListEntryCrcs.size() == m_locoList.size());
+    entry.listEntryCrc = entry.listEntryKnown ? m_locoListEntryCrcs.at(request.locoNum) : 0;
+    m_locoInfoChanged.at(request.locoNum) = changed;
+    m_locoInfoStates.at(request.locoNum) = LocoInfoState::Received;
+}
+
+void MaerklinLocoManagment::handleLocoInfoTimeouts()
+{
+    unsigned long currentTimeINms = millis();
+    bool finishedRequest{false};
+    for (auto request = m_locoInfoRequests.begin(); request != m_locoInfoRequests.end();)
+    {
+        if (static_cast<long>(currentTimeINms - request->deadlineINms) < 0)
+        {
+            ++request;
+        }
+        else if (request->repeat < m_maxCmdRepeat)
+        {
+            Serial.print("Timeout, repeat loco:");
+            Serial.println(request->info.c_str());
+            request->repeat++;
+            requestLocoInfo(*request);
+            ++request;
+        }
+        else
+        {
+            Serial.print("Could not get loco:");
+            Serial.println(request->info.c_str());
+            m_locoInfoStates.at(request->locoNum) = LocoInfoState::Failed;
+            // the stream must not write into the buffer after it is gone
+            cancelConfigData(&request->buffer);
+            request = m_locoInfoRequests.erase(request);
+            finishedRequest = true;
+        }
+    }
+    if (finishedRequest)
+    {
+        writeLocoInfos();
+        requestNextLocoInfos();
+    }
+}
+
+void MaerklinLocoManagment::writeLocoInfos()
+{
+    // locos are written in the order of the loco list, no matter in which order they were received
+    while ((m_nextWrittenLocoInfoNum < m_locoInfoStates.size()) && (LocoInfoState::Pending != m_locoInfoStates.at(m_nextWrittenLocoInfoNum)))
+    {
+        // a loco that could not be read is written as it was cached before
+        auto entry = m_locoCache.find(m_locoList.at(m_nextWrittenLocoInfoNum));
+        if ((entry != m_locoCache.end()) && !entry->second.cs2Data.empty() && (nullptr != m_writeFileCallback))
+        {
+            m_writeFileCallback(&entry->second.cs2Data, m_locoInfoChanged.at(m_nextWrittenLocoInfoNum));
+        }
+        m_nextWrittenLocoInfoNum++;
+    }
+    if (m_nextWrittenLocoInfoNum >= m_locoInfoStates.size())
+    {
+        // all loco received
+        m_state = LocoManagmentState::Idle;
+        if (nullptr != m_resultCallback)
+        {
+            m_resultCallback(true);
+        }
+    }
+}
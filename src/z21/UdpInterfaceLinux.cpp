@@ -21,7 +21,10 @@ UdpInterfaceLinux::UdpInterfaceLinux(uint16_t maxNumberOfClients, int16_t port,
       m_mem(new listofIP[maxNumberOfClients]),
       m_maxNumberOfClients(maxNumberOfClients),
       m_countIP(0),
-      m_IPpreviousMillis(0)
+      m_IPpreviousMillis(0),
+      m_debug(debug),
+      m_statistics{0, 0, 0, 0},
+      m_reportedPackets(0)
 {
 }
 
@@ -30,10 +33,9 @@ void UdpInterfaceLinux::begin()
   if (m_Udp.listen(m_port))
   {
     m_Udp.onPacket([this](AsyncUDPPacket packet)
-                   {  
-      uint8_t packetBuffer[packet.length() + 1];
-      memcpy(packetBuffer, packet.data(), packet.length());
-      packetBuffer[packet.length()] = 0;
+                   {
+      // the datagram stays in the buffer of AsyncUDP until the callback returns,
+      // so the datasets are parsed in place without any copy
       // Serial.print("=>");
       // Serial.print(packet.remoteIP());
       // for(int i=0;i<packet.length();i++)
@@ -42,28 +44,37 @@ void UdpInterfaceLinux::begin()
       //   Serial.print(packet.data()[i]);
       // }
       // Serial.print("\n");
-      handlePacket(addIP(packet.remoteIP()), packetBuffer, packet.length()); });
+      handlePacket(addIP(packet.remoteIP()), packet.data(), packet.length(), millis()); });
   }
 }
 
-void UdpInterfaceLinux::handlePacket(uint8_t client, uint8_t *packet, size_t packetLength)
+void UdpInterfaceLinux::handlePacket(uint8_t client, const uint8_t *packet, size_t packetLength, unsigned long timestampINms)
 {
-  // completely transmitted to
-
-  if (4 <= packetLength)
+  // a datagram may contain several datasets, each starts with its own length (little endian)
+  // and has at least length and header (4 byte)
+  m_statistics.packets++;
+  m_statistics.bytes += packetLength;
+  size_t index = 0;
+  size_t leftSize = packetLength;
+  while (leftSize > 0)
   {
-    uint16_t index = 0;
-    uint16_t length = 0;
-    for (size_t left_size = packetLength; left_size > 3; left_size -= length, index += length)
+    if (leftSize < 4)
     {
-      length = (packet[index + 1] << 8) + packet[index];
-      if ((left_size < length) || (0 == length))
-      {
-        break;
-      }
-      Udp::Message udpMessage{client, &(packet[index])};
-      notify(&udpMessage);
+      m_statistics.malformedDatasets++;
+      break;
+    }
+    uint16_t length = (packet[index + 1] << 8) + packet[index];
+    if ((length < 4) || (leftSize < length))
+    {
+      // length is not plausible, the rest of the datagram can not be split up any more
+      m_statistics.malformedDatasets++;
+      break;
     }
+    m_statistics.datasets++;
+    Udp::Message udpMessage{client, &(packet[index]), length, timestampINms};
+    notify(&udpMessage);
+    leftSize -= length;
+    index += length;
   }
 }
 
@@ -71,7 +82,7 @@ bool UdpInterfaceLinux::transmit(Udp::Message &message)
 {
   // send data now via new interface using transmit function
   bool result{false};
-  uint16_t len = message.data[0] + (message.data[1] << 8);
+  uint16_t len = message.length;
   if (message.client == 0x00)
   { // Broadcast
     // Serial.print("B");
@@ -129,6 +140,28 @@ bool UdpInterfaceLinux::transmit(Udp::Message &message)
   return result;
 }
 
+bool UdpInterfaceLinux::transmit(Udp::Message &message, const uint8_t *clients, uint8_t numberOfClients)
+{
+  // AsyncUDP offers no batched send like sendmmsg, so the length is only
+  // calculated once and the payload is handed to each unicast address
+  bool result{numberOfClients > 0};
+  uint16_t len = message.length;
+  for (uint8_t i = 0; i < numberOfClients; i++)
+  {
+    uint8_t client = clients[i];
+    if ((0 == client) || (client > m_countIP))
+    {
+      result = false;
+      continue;
+    }
+    if (m_Udp.writeTo(message.data, len, m_mem[client - 1].IP, m_port) != len)
+    {
+      result = false;
+    }
+  }
+  return result;
+}
+
 bool UdpInterfaceLinux::receive(Udp::Message &message)
 {
   return false;
@@ -185,6 +218,16 @@ void UdpInterfaceLinux::cyclic()
         m_mem[i].time--; // Zeit herrunterrechnen
     }
     // notifyz21InterfacegetSystemInfo(0); //SysInfo an alle BC Clients senden!
+    if (m_debug)
+    {
+      Serial.print(F("UDP packets/s:"));
+      Serial.print((m_statistics.packets - m_reportedPackets) * 1000 / interval);
+      Serial.print(F(" datasets:"));
+      Serial.print(m_statistics.datasets);
+      Serial.print(F(" malformed:"));
+      Serial.println(m_statistics.malformedDatasets);
+    }
+    m_reportedPackets = m_statistics.packets;
   }
   // notifyz21InterfacegetSystemInfo(0);
 }
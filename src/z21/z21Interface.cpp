@@ -13,6 +13,21 @@
 // include this library's description file
 #include "z21/z21Interface.h"
 
+namespace
+{
+	// replies that never change are serialized at compile time
+	constexpr auto frameGetCode = z21Frame::make(0x18, 0x00);				  // LAN_GET_CODE: keine Features gesperrt
+	constexpr auto frameXGetVersion = z21Frame::makeX(0x63, 0x21, 0x30, 0x12); // X-Bus Version 3.0, ID der Zentrale 0x12
+	constexpr auto frameXUnknownCommand = z21Frame::makeX(0x61, 0x82);
+	constexpr auto frameXCVNack = z21Frame::makeX(0x61, 0x13);
+	constexpr auto frameXCVNackSC = z21Frame::makeX(0x61, 0x12);
+	constexpr auto frameXTrackPowerOff = z21Frame::makeX(0x61, 0x00);
+	constexpr auto frameXTrackPowerOn = z21Frame::makeX(0x61, 0x01);
+	constexpr auto frameXProgrammingMode = z21Frame::makeX(0x61, 0x02);
+	constexpr auto frameXTrackShortCircuit = z21Frame::makeX(0x61, 0x08);
+	constexpr auto frameXStopped = z21Frame::makeX(0x81, 0x00);
+}
+
 // Constructor /////////////////////////////////////////////////////////////////
 // Function that handles the creation and setup of instances
 
@@ -22,6 +37,16 @@ z21Interface::z21Interface(HwType hwType, uint32_t swVersion, boolean debug)
 	// initialize this instance's variables
 	m_hwType = hwType;
 	m_swVersion = swVersion;
+	uint32_t hw = static_cast<uint32_t>(m_hwType);
+	m_frameHwInfo = z21Frame::make(static_cast<uint16_t>(z21Interface::Header::LAN_GET_HWINFO),
+								   hw & 0xFF, (hw >> 8) & 0xFF, (hw >> 16) & 0xFF, (hw >> 24) & 0xFF, // HwType 32 Bit
+								   m_swVersion & 0xFF, (m_swVersion >> 8) & 0xFF, 0x00, 0x00);		   // FW Version 32 Bit
+	m_frameFirmwareVersion = z21Frame::makeX(0xF3, 0x0A, (m_swVersion >> 8) & 0xFF, m_swVersion & 0xFF); // identify Firmware, V_MSB, V_LSB
+	m_frameSerialNumberValid = false;
+	memset(m_commandCounter, 0, sizeof(m_commandCounter));
+	memset(m_xCommandCounter, 0, sizeof(m_xCommandCounter));
+	m_unknownCommandCounter = 0;
+	m_invalidLengthCounter = 0;
 	z21InterfaceIPpreviousMillis = 0;
 	m_railPower = EnergyState::csTrackVoltageOff;
 	clearIPSlots();
@@ -30,750 +55,903 @@ z21Interface::z21Interface(HwType hwType, uint32_t swVersion, boolean debug)
 // Public Methods //////////////////////////////////////////////////////////////
 // Functions available in Wiring sketches, this library, and other libraries
 
+//*********************************************************************************************
+// Dispatch tabellen
+// Header und X-Header werden ueber einen 256 Eintraege grossen Index direkt auf den Handler abgebildet.
+// Jeder Eintrag kennt die minimale Laenge des Datensatzes (inkl. Laenge, Header und XOR).
+constexpr z21Interface::Command z21Interface::s_commands[z21Interface::numberOfCommands] = {
+	{0x10, 0x04, &z21Interface::receiveGetSerialNumber},	 // LAN_GET_SERIAL_NUMBER
+	{0x12, 0x04, &z21Interface::receiveGetConfig1},		 // LAN_GET_CONFIG1
+	{0x13, 0x0E, &z21Interface::receiveSetConfig1},		 // LAN_SET_CONFIG1
+	{0x16, 0x04, &z21Interface::receiveGetConfig2},		 // LAN_GET_CONFIG2
+	{0x17, 0x14, &z21Interface::receiveSetConfig2},		 // LAN_SET_CONFIG2
+	{0x18, 0x04, &z21Interface::receiveGetCode},			 // LAN_GET_CODE
+	{0x1A, 0x04, &z21Interface::receiveGetHwInfo},		 // LAN_GET_HWINFO
+	{0x30, 0x04, &z21Interface::receiveLogoff},			 // LAN_LOGOFF
+	{0x40, 0x06, &z21Interface::receiveX},				 // LAN_X_HEADER
+	{0x50, 0x08, &z21Interface::receiveSetBroadcastFlags}, // LAN_SET_BROADCASTFLAGS
+	{0x51, 0x04, &z21Interface::receiveGetBroadcastFlags}, // LAN_GET_BROADCASTFLAGS
+	{0x60, 0x06, &z21Interface::receiveGetLocoMode},		 // LAN_GET_LOCOMODE
+	{0x61, 0x07, &z21Interface::receiveSetLocoMode},		 // LAN_SET_LOCOMODE
+	{0x70, 0x06, &z21Interface::receiveGetTurnOutMode},	 // LAN_GET_TURNOUTMODE
+	{0x71, 0x07, &z21Interface::receiveSetTurnOutMode},	 // LAN_SET_TURNOUTMODE
+	{0x81, 0x05, &z21Interface::receiveRmBusGetData},		 // LAN_RMBUS_GETDATA
+	{0x82, 0x05, &z21Interface::receiveIgnore},			 // LAN_RMBUS_PROGRAMMODULE
+	{0x85, 0x04, &z21Interface::receiveSystemStateGetData}, // LAN_SYSTEMSTATE_GETDATA
+	{0x89, 0x05, &z21Interface::receiveRailcomGetData},	 // LAN_RAILCOM_GETDATA
+	{0xA2, 0x05, &z21Interface::receiveLocoNetFromLan},	 // LAN_LOCONET_FROM_LAN
+	{0xA3, 0x06, &z21Interface::receiveLocoNetDispatchAddr}, // LAN_LOCONET_DISPATCH_ADDR
+	{0xA4, 0x07, &z21Interface::receiveLocoNetDetector},	 // LAN_LOCONET_DETECTOR
+	{0xC4, 0x07, &z21Interface::receiveCanDetector}		 // LAN_CAN_DETECTOR
+};
+
+constexpr z21Interface::Command z21Interface::s_xCommands[z21Interface::numberOfXCommands] = {
+	{0x21, 0x07, &z21Interface::receiveXGetSetting},		   // LAN_X_GET_SETTING
+	{0x22, 0x08, &z21Interface::receiveXDccReadRegister},	   // LAN_X_DCC_READ_REGISTER
+	{0x23, 0x09, &z21Interface::receiveXCvRead},			   // LAN_X_CV_READ, LAN_X_DCC_WRITE_REGISTER
+	{0x24, 0x0A, &z21Interface::receiveXCvWrite},			   // LAN_X_CV_WRITE, LAN_X_MM_WRITE_BYTE
+	{0x43, 0x08, &z21Interface::receiveXGetTurnoutInfo},	   // LAN_X_GET_TURNOUT_INFO
+	{0x44, 0x09, &z21Interface::receiveXGetExtAccessoryInfo}, // LAN_X_GET_EXT_ACCESSORY_INFO
+	{0x53, 0x09, &z21Interface::receiveXSetTurnout},		   // LAN_X_SET_TURNOUT
+	{0x54, 0x09, &z21Interface::receiveXSetExtAccessory},	   // LAN_X_SET_EXT_ACCESSORY
+	{0x80, 0x06, &z21Interface::receiveXSetStop},			   // LAN_X_SET_STOP
+	{0xE3, 0x09, &z21Interface::receiveXGetLocoInfo},		   // LAN_X_GET_LOCO_INFO
+	{0xE4, 0x0A, &z21Interface::receiveXSetLocoDrive},	   // LAN_X_SET_LOCO_DRIVE, LAN_X_SET_LOCO_FUNCTION
+	{0xE6, 0x0C, &z21Interface::receiveXCvPom},			   // LAN_X_CV_POM
+	{0xF1, 0x07, &z21Interface::receiveXGetFirmwareVersion}   // LAN_X_GET_FIRMWARE_VERSION
+};
+
+constexpr z21Interface::CommandIndex z21Interface::s_commandIndex = z21Interface::makeCommandIndex(z21Interface::s_commands);
+constexpr z21Interface::CommandIndex z21Interface::s_xCommandIndex = z21Interface::makeCommandIndex(z21Interface::s_xCommands);
+constexpr uint8_t z21Interface::noCommand;
+
 //*********************************************************************************************
 // Daten ermitteln und Auswerten
-void z21Interface::receive(uint8_t client, uint8_t *packet)
+// packet holds exactly one dataset of length bytes, nothing behind it may be read
+void z21Interface::receive(uint8_t client, const uint8_t *packet, uint16_t length)
 {
 	addIPToSlot(client, 0);
-	// send a reply, to the IP address and port that sent us the packet we received
-	uint16_t header = (packet[3] << 8) + packet[2];
-	uint8_t data[16]; // z21Interface send storage
-
-	// #if defined(ESP32)
-	// 	portMUX_TYPE myMutex = portMUX_INITIALIZER_UNLOCKED;
-	// #endif
 
-	switch (static_cast<z21Interface::Header>(header))
+	if (length < 4)
 	{
-	case z21Interface::Header::LAN_GET_SERIAL_NUMBER:
+		m_invalidLengthCounter++;
+		return;
+	}
+	uint8_t slot = (0x00 == packet[3]) ? s_commandIndex.slot[packet[2]] : noCommand;
+	if (noCommand == slot)
 	{
+		m_unknownCommandCounter++;
 		if (m_debug)
 		{
-			ZDebug.println("GET_SERIAL_NUMBER");
-		}
-		uint16_t serialNumber = getSerialNumber();
-		data[0] = serialNumber & 0xFF;
-		data[1] = (serialNumber >> 8) & 0xFF;
-		data[2] = 0x00;
-		data[3] = 0x00;
-		EthSend(client, 0x08, z21Interface::Header::LAN_GET_SERIAL_NUMBER, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone)); // Seriennummer 32 Bit (little endian)
-	}
-	break;
-	case z21Interface::Header::LAN_GET_HWINFO:
-		if (m_debug)
-		{
-			ZDebug.println("GET_HWINFO");
-		}
-		data[0] = static_cast<uint8_t>(m_hwType) & 0xFF; // HwType 32 Bit
-		data[1] = (static_cast<uint8_t>(m_hwType) >> 8) & 0xFF;
-		data[2] = (static_cast<uint8_t>(m_hwType) >> 16) & 0xFF;
-		data[3] = (static_cast<uint8_t>(m_hwType) >> 24) & 0xFF;
-		data[4] = m_swVersion & 0xFF; // FW Version 32 Bit
-		data[5] = (m_swVersion >> 8) & 0xFF;
-		data[6] = (m_swVersion >> 16) & 0xFF;
-		data[7] = (m_swVersion >> 24) & 0xFF;
-		EthSend(client, 0x0C, z21Interface::Header::LAN_GET_HWINFO, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		break;
-	case z21Interface::Header::LAN_LOGOFF:
-		if (m_debug)
-		{
-			ZDebug.println("LOGOFF");
-		}
-		clearIPSlot(client);
-		// Antwort von Z21: keine
-		break;
-	case z21Interface::Header::LAN_GET_CODE: // SW Feature-Umfang der Z21
-		/*#define Z21_NO_LOCK        0x00  // keine Features gesperrt
-		  #define z21Interface_START_LOCKED   0x01  // �z21Interface start�: Fahren und Schalten per LAN gesperrt
-		  #define z21Interface_START_UNLOCKED 0x02  // �z21Interface start�: alle Feature-Sperren aufgehoben */
-		data[0] = 0x00; // keine Features gesperrt
-		EthSend(client, 0x05, z21Interface::Header::LAN_GET_CODE, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		break;
-	case (z21Interface::Header::LAN_X_HEADER):
-		//---------------------- LAN X-Header BEGIN ---------------------------
-		switch (static_cast<z21Interface::XHeader>(packet[4]))
-		{ // X-Header
-		case z21Interface::XHeader::LAN_X_GET_SETTING:
-			//---------------------- Switch BD0 BEGIN ---------------------------
-			switch (packet[5])
-			{ // DB0
-			case 0x21:
-				if (m_debug)
-				{
-					ZDebug.println("X_GET_VERSION");
-				}
-				data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_GET_VERSION); // X-Header: 0x63
-				data[1] = 0x21;															  // DB0
-				data[2] = 0x30;															  // X-Bus Version
-				data[3] = 0x12;															  // ID der Zentrale
-				EthSend(client, 0x09, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-				break;
-			case 0x24:
-				data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_STATUS_CHANGED); // X-Header: 0x62
-				data[1] = 0x22;																 // DB0
-				data[2] = static_cast<uint8_t>(m_railPower);								 // DB1: Status
-				// ZDebug.print("X_GET_STATUS ");
-				// csEmergencyStop  0x01 // Der Nothalt ist eingeschaltet
-				// csTrackVoltageOff  0x02 // Die Gleisspannung ist abgeschaltet
-				// csShortCircuit  0x04 // Kurzschluss
-				// csProgrammingModeActive 0x20 // Der Programmiermodus ist aktiv
-				EthSend(client, 0x08, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-				break;
-			case 0x80:
-				if (m_debug)
-				{
-					ZDebug.println("X_SET_TRACK_POWER_OFF");
-				}
-#ifdef directResponse
-				data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_BC_TRACK_POWER);
-				data[1] = 0x00;
-				EthSend(client, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, Z21bcNone);
-#endif
-				notifyz21InterfaceRailPower(EnergyState::csTrackVoltageOff);
-				break;
-			case 0x81:
-				if (m_debug)
-				{
-					ZDebug.println("X_SET_TRACK_POWER_ON");
-				}
-#ifdef directResponse
-				data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_BC_TRACK_POWER);
-				data[1] = 0x01;
-				EthSend(client, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-#endif
-				notifyz21InterfaceRailPower(EnergyState::csNormal);
-
-				break;
-			}
-			//---------------------- Switch DB0 ENDE ---------------------------
-			break; // ENDE DB0
-		case z21Interface::XHeader::LAN_X_CV_READ:
-			if (packet[5] == 0x11) // LAN_X_CV_READ
-			{					   // DB0
-				if (m_debug)
-				{
-					ZDebug.println("X_CV_READ");
-				}
-				notifyz21InterfaceCVREAD(packet[6], packet[7]); // CV_MSB, CV_LSB
-			}
-			else if (packet[5] == 0x12) // LAN_X_DCC_WRITE_REGISTER
-			{							// DB0
-				if (m_debug)
-				{
-					ZDebug.println("X_DCC_WRITE");
-				}
-				notifyz21InterfaceDCCWRITE(packet[6], packet[7]);
-			}
-			break;
-		case z21Interface::XHeader::LAN_X_CV_WRITE:
-			if (packet[5] == 0x12) // LAN_X_CV_WRITE
-			{					   // DB0
-				if (m_debug)
-				{
-					ZDebug.println("X_CV_WRITE");
-				}
-				notifyz21InterfaceCVWRITE(packet[6], packet[7], packet[8]); // CV_MSB, CV_LSB, value
-			}
-			else if ((packet[5] == 0xFF) && (packet[6] == 0x00)) // LAN_X_MM_WRITE_BYTE
-			{													 // DB0
-				if (m_debug)
-				{
-					ZDebug.println("_X_MM_WRITE_BYTE");
-				}
-				notifyz21InterfaceMMWRITE(packet[7], packet[8]);
-			}
-			break;
-		case z21Interface::XHeader::LAN_X_DCC_READ_REGISTER:
-			if (packet[5] == 0x11)
-			{ // DB0
-				if (m_debug)
-				{
-					ZDebug.println("X_DCC_READ");
-				}
-				notifyz21InterfaceDCCREAD(packet[6]);
-			}
-			break;
-		case z21Interface::XHeader::LAN_X_CV_POM:
-			if (packet[5] == 0x30)
-			{ // DB0
-				uint16_t Adr = ((packet[6] & 0x3F) << 8) + packet[7];
-				uint16_t CVAdr = ((packet[8] & B11) << 8) + packet[9];
-				uint8_t value = packet[10];
-				if ((packet[8] & 0xFC) == 0xEC)
-				{
-					if (m_debug)
-					{
-						ZDebug.println("LAN_X_CV_POM_WRITE_BYTE");
-					}
-					notifyz21InterfaceCVPOMWRITEBYTE(Adr, CVAdr, value); // set Byte
-				}
-				else if ((packet[8] & 0xFC) == 0xE8)
-				{
-					if (m_debug)
-					{
-						ZDebug.println("LAN_X_CV_POM_WRITE_BIT");
-					}
-					notifyz21InterfaceCVPOMWRITEBIT(Adr, CVAdr, value); // set Bit
-				}
-				else
-				{
-					if (m_debug)
-					{
-						ZDebug.println("LAN_X_CV_POM_READ_BYTE");
-					}
-					notifyz21InterfaceCVPOMREADBYTE(Adr, CVAdr); // read uint8_t
-				}
-			}
-			else if (packet[5] == 0x31)
-			{ // DB0
-				if (m_debug)
-				{
-					ZDebug.println("LAN_X_CV_POM_ACCESSORY");
-				}
-			}
-			break;
-		case z21Interface::XHeader::LAN_X_GET_TURNOUT_INFO:
-		{
-			if (m_debug)
+			ZDebug.print("UNKNOWN_COMMAND");
+			for (uint16_t i = 0; i < length; i++)
 			{
-				ZDebug.println("X_GET_TURNOUT_INFO");
+				ZDebug.print(" 0x");
+				ZDebug.print(packet[i], HEX);
 			}
-			data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_GET_TURNOUT_INFO);
-			data[1] = packet[5]; // High
-			data[2] = packet[6]; // Low
-			notifyz21InterfaceAccessoryInfo((packet[5] << 8) + packet[6], data[3]);
-			EthSend(client, 0x09, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcAll)); // BC new 23.04. !!!(old = 0)
-
-			break;
+			ZDebug.println();
 		}
-		case z21Interface::XHeader::LAN_X_SET_TURNOUT:
+		EthSendFrame(client, frameXUnknownCommand.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+	}
+	else if (length < s_commands[slot].minLength)
+	{
+		m_invalidLengthCounter++;
+		if (m_debug)
 		{
-			// if (m_debug)
-			// {
-			// 	ZDebug.print("X_SET_TURNOUT Adr.:");
-			// 	ZDebug.print((packet[5] << 8) + packet[6]);
-			// 	ZDebug.print(":");
-			// 	ZDebug.print(bitRead(packet[7], 0));
-			// 	ZDebug.print("-");
-			// 	ZDebug.println(bitRead(packet[7], 3));
-			// }
-			// bool TurnOnOff = bitRead(packet[7],3);  //Spule EIN/AUS
-			notifyz21InterfaceAccessory((packet[5] << 8) + packet[6], bitRead(packet[7], 0), bitRead(packet[7], 3));
-			//	Addresse					Links/Rechts			Spule EIN/AUS
-			break;
+			ZDebug.print("INVALID_LENGTH 0x");
+			ZDebug.println(packet[2], HEX);
 		}
-		case z21Interface::XHeader::LAN_X_SET_EXT_ACCESSORY:
-		{
-			if (m_debug)
-			{
-				ZDebug.print("X_SET_EXT_ACCESSORY RAdr.:");
-				ZDebug.print((packet[5] << 8) + packet[6]);
-				ZDebug.print(":0x");
-				ZDebug.println(packet[7], HEX);
-			}
-			setExtACCInfo((packet[5] << 8) + packet[6], packet[7]);
-			break;
-		}
-		case z21Interface::XHeader::LAN_X_GET_EXT_ACCESSORY_INFO:
+	}
+	else
+	{
+		m_commandCounter[slot]++;
+		(this->*s_commands[slot].handler)(client, packet, length);
+	}
+	//---------------------------------------------------------------------------------------
+	// check if IP is still used:
+	unsigned long currentMillis = millis();
+	if ((currentMillis - z21InterfaceIPpreviousMillis) > z21InterfaceIPinterval)
+	{
+		z21InterfaceIPpreviousMillis = currentMillis;
+		for (uint8_t i = 0; i < z21InterfaceclientMAX; i++)
 		{
-			if (m_debug)
-			{
-				ZDebug.print("X_EXT_ACCESSORY_INFO RAdr.:");
-				ZDebug.print((packet[5] << 8) + packet[6]);
-				ZDebug.print(":0x");
-				ZDebug.println(packet[7], HEX); // DB2 Reserviert f�r zuk�nftige Erweiterungen
-			}
-			setExtACCInfo((packet[5] << 8) + packet[6], packet[7]);
-			break;
-		}
-		case z21Interface::XHeader::LAN_X_SET_STOP:
-			if (m_debug)
+			if (ActIP[i].time > 0)
 			{
-				ZDebug.println("X_SET_STOP");
-			}
-			notifyz21InterfaceRailPower(EnergyState::csEmergencyStop);
-			break;
-		case z21Interface::XHeader::LAN_X_GET_LOCO_INFO:
-			if (packet[5] == 0xF0)
-			{ // DB0
-				if (m_debug)
-				{
-					ZDebug.println("X_GET_LOCO_INFO");
-				}
-				// Antwort: LAN_X_LOCO_INFO  Adr_MSB - Adr_LSB
-				returnLocoStateFull(client, word(packet[6] & 0x3F, packet[7]), false);
-			}
-			break;
-		case z21Interface::XHeader::LAN_X_SET_LOCO_DRIVE:
-			// setLocoBusy:
-			addBusySlot(client, word(packet[6] & 0x3F, packet[7]));
-
-			if (static_cast<z21Interface::XHeader>(packet[5]) == z21Interface::XHeader::LAN_X_SET_LOCO_FUNCTION)
-			{ // DB0
-				// LAN_X_SET_LOCO_FUNCTION  Adr_MSB        Adr_LSB            Type (00=AUS/01=EIN/10=UM)      Funktion
-				notifyz21InterfaceLocoFkt(word(packet[6] & 0x3F, packet[7]), packet[8] >> 6, packet[8] & B00111111);
-				// uint16_t Adr, uint8_t type, uint8_t fkt
+				ActIP[i].time--; // Zeit herrunterrechnen
 			}
 			else
-			{ // DB0
-				// ZDebug.print("X_SET_LOCO_DRIVE ");
-				notifyz21InterfaceLocoSpeed(word(packet[6] & 0x3F, packet[7]), packet[8], packet[5] & 0x07);
-			}
-#ifdef directResponse
-			returnLocoStateFull(client, word(packet[6] & 0x3F, packet[7]), true);
-#endif
-			break;
-		case z21Interface::XHeader::LAN_X_GET_FIRMWARE_VERSION:
-			if (m_debug)
 			{
-				ZDebug.println("X_GET_FIRMWARE_VERSION");
-			}
-			data[0] = 0xF3;						 // identify Firmware (not change)
-			data[1] = 0x0A;						 // identify Firmware (not change)
-			data[2] = (m_swVersion >> 8) & 0xFF; // V_MSB
-			data[3] = m_swVersion & 0xFF;		 // V_LSB
-			EthSend(client, 0x09, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-			break;
-			/*
-		  case 0x73:
-			//LAN_X_??? WLANmaus periodische Abfrage:
-			//0x09 0x00 0x40 0x00 0x73 0x00 0xFF 0xFF 0x00
-			//length X-Header	XNet-Msg			  speed?
-			if (m_debug)
-			{
-			ZDebug.println("LAN-X_WLANmaus");
-			}
-			//set Broadcastflags for WLANmaus:
-			if (addIPToSlot(client, 0x00) == 0)
-				addIPToSlot(client, Z21bcAll);
-			break;
-			*/
-		default:
-			if (m_debug)
-			{
-				ZDebug.print("UNKNOWN_LAN-X_COMMAND");
-				// for (uint8_t i = 0; i < packet[0]; i++) {
-				//	ZDebug.print(" 0x");
-				//	ZDebug.print(packet[i], HEX);
-				// }
-				ZDebug.println();
+				clearIP(i); // clear IP DATA
+							// send MESSAGE clear Client
 			}
-			data[0] = 0x61;
-			data[1] = 0x82;
-			EthSend(client, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
 		}
-		//---------------------- LAN X-Header ENDE ---------------------------
-		break;
-	case z21Interface::Header::LAN_SET_BROADCASTFLAGS:
+	}
+}
+
+//--------------------------------------------------------------------------------------------
+uint32_t z21Interface::getCommandCounter(uint16_t header, uint8_t xHeader)
+{
+	if (header > 0xFF)
+	{
+		return 0;
+	}
+	if (static_cast<uint16_t>(z21Interface::Header::LAN_X_HEADER) == header)
+	{
+		uint8_t slot = s_xCommandIndex.slot[xHeader];
+		return (noCommand == slot) ? 0 : m_xCommandCounter[slot];
+	}
+	uint8_t slot = s_commandIndex.slot[header];
+	return (noCommand == slot) ? 0 : m_commandCounter[slot];
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetSerialNumber(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("GET_SERIAL_NUMBER");
+	}
+	if (!m_frameSerialNumberValid)
 	{
-		unsigned long bcflag = packet[7];
-		bcflag = packet[6] | (bcflag << 8);
-		bcflag = packet[5] | (bcflag << 8);
-		bcflag = packet[4] | (bcflag << 8);
-		addIPToSlot(client, getLocalBcFlag(bcflag));
-		// no inside of the protokoll, but good to have:
-		notifyz21InterfaceRailPower(m_railPower); // Zustand Gleisspannung Antworten
+		uint16_t serialNumber = getSerialNumber();
+		m_frameSerialNumber = z21Frame::make(static_cast<uint16_t>(z21Interface::Header::LAN_GET_SERIAL_NUMBER), serialNumber & 0xFF, (serialNumber >> 8) & 0xFF, 0x00, 0x00);
+		m_frameSerialNumberValid = true;
+	}
+	EthSendFrame(client, m_frameSerialNumber.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone)); // Seriennummer 32 Bit (little endian)
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetHwInfo(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("GET_HWINFO");
+	}
+	EthSendFrame(client, m_frameHwInfo.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveLogoff(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("LOGOFF");
+	}
+	clearIPSlot(client);
+	// Antwort von Z21: keine
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetCode(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	// SW Feature-Umfang der Z21
+	/*#define Z21_NO_LOCK        0x00  // keine Features gesperrt
+	  #define z21Interface_START_LOCKED   0x01  // �z21Interface start�: Fahren und Schalten per LAN gesperrt
+	  #define z21Interface_START_UNLOCKED 0x02  // �z21Interface start�: alle Feature-Sperren aufgehoben */
+	EthSendFrame(client, frameGetCode.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveX(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	//---------------------- LAN X-Header BEGIN ---------------------------
+	uint8_t slot = s_xCommandIndex.slot[packet[4]];
+	if (noCommand == slot)
+	{
+		m_unknownCommandCounter++;
 		if (m_debug)
 		{
-			ZDebug.print("SET_BROADCASTFLAGS: ");
-			ZDebug.println(addIPToSlot(client, 0x00), BIN);
-			// 1=BC Power, Loco INFO, Trnt INFO; 2=BC �nderungen der R�ckmelder am R-Bus
+			ZDebug.print("UNKNOWN_LAN-X_COMMAND");
+			// for (uint8_t i = 0; i < length; i++) {
+			//	ZDebug.print(" 0x");
+			//	ZDebug.print(packet[i], HEX);
+			// }
+			ZDebug.println();
 		}
-		break;
+		EthSendFrame(client, frameXUnknownCommand.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
 	}
-	case z21Interface::Header::LAN_GET_BROADCASTFLAGS:
+	else if (length < s_xCommands[slot].minLength)
 	{
-		unsigned long flag = getz21InterfaceBcFlag(addIPToSlot(client, 0x00));
-		data[0] = flag;
-		data[1] = flag >> 8;
-		data[2] = flag >> 16;
-		data[3] = flag >> 24;
-		EthSend(client, 0x08, z21Interface::Header::LAN_GET_BROADCASTFLAGS, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+		m_invalidLengthCounter++;
 		if (m_debug)
 		{
-			ZDebug.print("GET_BROADCASTFLAGS: ");
-			ZDebug.println(flag, BIN);
+			ZDebug.print("INVALID_LENGTH LAN-X 0x");
+			ZDebug.println(packet[4], HEX);
 		}
-		break;
 	}
-	case z21Interface::Header::LAN_GET_LOCOMODE:
-		/*
-		In der Z21 kann das Ausgabeformat (DCC, MM) pro Lok-Adresse persistent gespeichert werden.
-		Es k�nnen maximal 256 verschiedene Lok-Adressen abgelegt werden. Jede Adresse >= 256 ist automatisch DCC.
-		*/
+	else
+	{
+		m_xCommandCounter[slot]++;
+		(this->*s_xCommands[slot].handler)(client, packet, length);
+	}
+	//---------------------- LAN X-Header ENDE ---------------------------
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXGetSetting(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	//---------------------- Switch BD0 BEGIN ---------------------------
+	switch (packet[5])
+	{ // DB0
+	case 0x21:
 		if (m_debug)
 		{
-			Serial.println(F("LAN_GET_LOCOMODE"));
+			ZDebug.println("X_GET_VERSION");
 		}
-		data[0] = packet[4];
-		data[1] = packet[5];
-		handleGetLocoMode(word(packet[4], packet[5]), data[2]);
-		EthSend(client, 0x07, z21Interface::Header::LAN_GET_LOCOMODE, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+		EthSendFrame(client, frameXGetVersion.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
 		break;
-	case z21Interface::Header::LAN_SET_LOCOMODE:
-		// nothing to replay all DCC Format
-		if (m_debug)
-		{
-			Serial.println(F("LAN_SET_LOCOMODE"));
-		}
-		handleSetLocoMode(word(packet[4], packet[5]), packet[6]);
+	case 0x24:
+	{
+		uint8_t data[3];
+		data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_STATUS_CHANGED); // X-Header: 0x62
+		data[1] = 0x22;																 // DB0
+		data[2] = static_cast<uint8_t>(m_railPower);								 // DB1: Status
+		// ZDebug.print("X_GET_STATUS ");
+		// csEmergencyStop  0x01 // Der Nothalt ist eingeschaltet
+		// csTrackVoltageOff  0x02 // Die Gleisspannung ist abgeschaltet
+		// csShortCircuit  0x04 // Kurzschluss
+		// csProgrammingModeActive 0x20 // Der Programmiermodus ist aktiv
+		EthSend(client, 0x08, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
 		break;
-	case z21Interface::Header::LAN_GET_TURNOUTMODE:
-		/*
-		In der Z21 kann das Ausgabeformat (DCC, MM) pro Funktionsdecoder-Adresse persistent gespeichert werden.
-		Es k�nnen maximal 256 verschiedene Funktionsdecoder -Adressen gespeichert werden. Jede Adresse >= 256 ist automatisch DCC.
-		*/
+	}
+	case 0x80:
 		if (m_debug)
 		{
-			ZDebug.println(F("LAN_SET_TURNOUTMODE"));
+			ZDebug.println("X_SET_TRACK_POWER_OFF");
 		}
-		data[0] = packet[4];
-		data[1] = packet[5];
-		// data[2] = 0; // 0=DCC Format; 1=MM Format
-		handleGetTurnOutMode(word(packet[4], packet[5]), data[2]);
-		EthSend(client, 0x07, z21Interface::Header::LAN_GET_LOCOMODE, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+#ifdef directResponse
+		EthSendFrame(client, frameXTrackPowerOff.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+#endif
+		notifyz21InterfaceRailPower(EnergyState::csTrackVoltageOff);
 		break;
-	case z21Interface::Header::LAN_SET_TURNOUTMODE:
+	case 0x81:
 		if (m_debug)
 		{
-			ZDebug.println(F("LAN_SET_TURNOUTMODE"));
+			ZDebug.println("X_SET_TRACK_POWER_ON");
 		}
-		handleSetTurnOutMode(word(packet[4], packet[5]), packet[6]);
+#ifdef directResponse
+		EthSendFrame(client, frameXTrackPowerOn.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+#endif
+		notifyz21InterfaceRailPower(EnergyState::csNormal);
 		break;
-	case z21Interface::Header::LAN_RMBUS_GETDATA:
+	}
+	//---------------------- Switch DB0 ENDE ---------------------------
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXCvRead(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (packet[5] == 0x11) // LAN_X_CV_READ
+	{					   // DB0
 		if (m_debug)
 		{
-			ZDebug.println("RMBUS_GETDATA");
+			ZDebug.println("X_CV_READ");
 		}
-		// ask for group state 'Gruppenindex'
-		notifyz21InterfaceS88Data(packet[4]); // normal Antwort hier nur an den anfragenden Client! (Antwort geht hier an alle!)
-		break;
-	case z21Interface::Header::LAN_RMBUS_PROGRAMMODULE:
-		break;
-	case z21Interface::Header::LAN_SYSTEMSTATE_GETDATA:
-	{ // System state
+		notifyz21InterfaceCVREAD(packet[6], packet[7]); // CV_MSB, CV_LSB
+	}
+	else if (packet[5] == 0x12) // LAN_X_DCC_WRITE_REGISTER
+	{							// DB0
 		if (m_debug)
 		{
-			ZDebug.println("LAN_SYS-State");
+			ZDebug.println("X_DCC_WRITE");
 		}
-		notifyz21InterfacegetSystemInfo(client);
-		break;
+		notifyz21InterfaceDCCWRITE(packet[6], packet[7]);
 	}
-	case z21Interface::Header::LAN_RAILCOM_GETDATA:
-	{
-		uint16_t Adr = 0;
-		if (packet[4] == 0x01)
-		{ // RailCom-Daten f�r die gegebene Lokadresse anfordern
-			Adr = word(packet[6], packet[5]);
-		}
-		Adr = notifyz21InterfaceRailcom(); // return global Railcom Adr
-		data[0] = Adr >> 8;				   // LocoAddress
-		data[1] = Adr & 0xFF;			   // LocoAddress
-		data[2] = 0x00;					   // UINT32 ReceiveCounter Empfangsz�hler in Z21
-		data[3] = 0x00;
-		data[4] = 0x00;
-		data[5] = 0x00;
-		data[6] = 0x00; // UINT32 ErrorCounter Empfangsfehlerz�hler in Z21
-		data[7] = 0x00;
-		data[8] = 0x00;
-		data[9] = 0x00;
-		/*
-		data[10] = 0x00;	//UINT8 Reserved1 experimentell, siehe Anmerkung
-		data[11] = 0x00;	//UINT8 Reserved2 experimentell, siehe Anmerkung
-		data[12] = 0x00;	//UINT8 Reserved3 experimentell, siehe Anmerkung
-		*/
-		EthSend(client, 0x0E, z21Interface::Header::LAN_RAILCOM_DATACHANGED, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		break;
-	}
-	case z21Interface::Header::LAN_LOCONET_FROM_LAN:
-	{
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXCvWrite(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (packet[5] == 0x12) // LAN_X_CV_WRITE
+	{					   // DB0
 		if (m_debug)
 		{
-			ZDebug.println("LOCONET_FROM_LAN");
+			ZDebug.println("X_CV_WRITE");
 		}
-		uint8_t LNdata[packet[0] - 0x04]; // n Bytes
-		for (uint8_t i = 0; i < (packet[0] - 0x04); i++)
-			LNdata[i] = packet[0x04 + i];
-		notifyz21InterfaceLNSendPacket(LNdata, packet[0] - 0x04);
-		// Melden an andere LAN-Client das Meldung auf LocoNet-Bus geschrieben wurde
-		EthSend(client, packet[0], z21Interface::Header::LAN_LOCONET_FROM_LAN, packet, false, static_cast<uint16_t>(BcFlagShort::Z21bcLocoNet)); // LAN_LOCONET_FROM_LAN
-		break;
+		notifyz21InterfaceCVWRITE(packet[6], packet[7], packet[8]); // CV_MSB, CV_LSB, value
 	}
-	case z21Interface::Header::LAN_LOCONET_DISPATCH_ADDR:
-	{
-		data[0] = packet[4];
-		data[1] = packet[5];
-		data[2] = notifyz21InterfaceLNdispatch(word(packet[5], packet[4])); // dispatchSlot
+	else if ((packet[5] == 0xFF) && (packet[6] == 0x00)) // LAN_X_MM_WRITE_BYTE
+	{													 // DB0
 		if (m_debug)
 		{
-			ZDebug.print("LOCONET_DISPATCH_ADDR ");
-			ZDebug.print(word(packet[5], packet[4]));
-			ZDebug.print(",");
-			ZDebug.println(data[2]);
+			ZDebug.println("_X_MM_WRITE_BYTE");
 		}
-		EthSend(client, 0x07, z21Interface::Header::LAN_LOCONET_DISPATCH_ADDR, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		break;
+		notifyz21InterfaceMMWRITE(packet[7], packet[8]);
 	}
-	case z21Interface::Header::LAN_LOCONET_DETECTOR:
-		// if (m_debug)
-		// {
-		// 	ZDebug.println("LOCONET_DETECTOR Abfrage");
-		// }
-		notifyz21InterfaceLNdetector(client, packet[4], word(packet[6], packet[5])); // Anforderung Typ & Reportadresse
-		break;
-	case z21Interface::Header::LAN_CAN_DETECTOR:
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXDccReadRegister(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (packet[5] == 0x11)
+	{ // DB0
 		if (m_debug)
 		{
-			ZDebug.println("CAN_DETECTOR Abfrage");
+			ZDebug.println("X_DCC_READ");
 		}
-		notifyz21InterfaceCANdetector(client, packet[4], word(packet[6], packet[5])); // Anforderung Typ & CAN-ID
-		break;
+		notifyz21InterfaceDCCREAD(packet[6]);
+	}
+}
 
-	case z21Interface::Header::LAN_GET_CONFIG1: // configuration read
-	{
-		// <-- 04 00 12 00
-		// 0e 00 12 00 01 00 01 03 01 00 03 00 00 00
-		std::array<uint8_t, 10> config;
-		if (getConfig1(config))
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXCvPom(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (packet[5] == 0x30)
+	{ // DB0
+		uint16_t Adr = ((packet[6] & 0x3F) << 8) + packet[7];
+		uint16_t CVAdr = ((packet[8] & B11) << 8) + packet[9];
+		uint8_t value = packet[10];
+		if ((packet[8] & 0xFC) == 0xEC)
 		{
-			uint8_t i = 0;
-			for (auto &conf : config)
+			if (m_debug)
 			{
-				data[i++] = conf;
+				ZDebug.println("LAN_X_CV_POM_WRITE_BYTE");
 			}
+			notifyz21InterfaceCVPOMWRITEBYTE(Adr, CVAdr, value); // set Byte
 		}
-		EthSend(client, 0x0e, z21Interface::Header::LAN_GET_CONFIG1, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		if (m_debug)
+		else if ((packet[8] & 0xFC) == 0xE8)
 		{
-			ZDebug.print("Z21 Eins(read) ");
-			ZDebug.print("RailCom: ");
-			ZDebug.print(data[0], HEX);
-			ZDebug.print(", PWR-Button: ");
-			ZDebug.print(data[2], HEX);
-			ZDebug.print(", ProgRead: ");
-			switch (data[3])
+			if (m_debug)
 			{
-			case 0x00:
-				ZDebug.print("nothing");
-				break;
-			case 0x01:
-				ZDebug.print("Bit");
-				break;
-			case 0x02:
-				ZDebug.print("Byte");
-				break;
-			case 0x03:
-				ZDebug.print("both");
-				break;
+				ZDebug.println("LAN_X_CV_POM_WRITE_BIT");
 			}
-			ZDebug.println();
+			notifyz21InterfaceCVPOMWRITEBIT(Adr, CVAdr, value); // set Bit
 		}
-	}
-	break;
-	case z21Interface::Header::LAN_SET_CONFIG1:
-	{ // configuration write
-		//<-- 0e 00 13 00 01 00 01 03 01 00 03 00 00 00
-		// 0x0e = Length; 0x12 = Header
-		// Daten:
-		//(0x01) RailCom: 0=aus/off, 1=ein/on
-		//(0x00)
-		//(0x01) Power-Button: 0=Gleisspannung aus, 1=Nothalt
-		//(0x03) Auslese-Modus: 0=Nichts, 1=Bit, 2=Byte, 3=Beides
-		if (m_debug)
+		else
 		{
-			ZDebug.print("Z21 Eins(write) ");
-			ZDebug.print("RailCom: ");
-			ZDebug.print(packet[4], HEX);
-			ZDebug.print(", PWR-Button: ");
-			ZDebug.print(packet[6], HEX);
-			ZDebug.print(", ProgRead: ");
-			switch (packet[7])
+			if (m_debug)
 			{
-			case 0x00:
-				ZDebug.print("nothing");
-				break;
-			case 0x01:
-				ZDebug.print("Bit");
-				break;
-			case 0x02:
-				ZDebug.print("Byte");
-				break;
-			case 0x03:
-				ZDebug.print("both");
-				break;
+				ZDebug.println("LAN_X_CV_POM_READ_BYTE");
 			}
-			ZDebug.println();
+			notifyz21InterfaceCVPOMREADBYTE(Adr, CVAdr); // read uint8_t
 		}
-
-		std::array<uint8_t, 10> config;
-		uint8_t i = 4;
-		for (auto &conf : config)
+	}
+	else if (packet[5] == 0x31)
+	{ // DB0
+		if (m_debug)
 		{
-			conf = packet[i];
+			ZDebug.println("LAN_X_CV_POM_ACCESSORY");
 		}
-		setConfig1(config);
-		// Request DCC to change
-		notifyz21InterfaceUpdateConf();
 	}
-	break;
-	case z21Interface::Header::LAN_GET_CONFIG2: // configuration read
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXGetTurnoutInfo(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("X_GET_TURNOUT_INFO");
+	}
+	uint8_t data[4];
+	data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_GET_TURNOUT_INFO);
+	data[1] = packet[5]; // High
+	data[2] = packet[6]; // Low
+	data[3] = 0;
+	notifyz21InterfaceAccessoryInfo((packet[5] << 8) + packet[6], data[3]);
+	EthSend(client, 0x09, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcAll)); // BC new 23.04. !!!(old = 0)
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXSetTurnout(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	// if (m_debug)
+	// {
+	// 	ZDebug.print("X_SET_TURNOUT Adr.:");
+	// 	ZDebug.print((packet[5] << 8) + packet[6]);
+	// 	ZDebug.print(":");
+	// 	ZDebug.print(bitRead(packet[7], 0));
+	// 	ZDebug.print("-");
+	// 	ZDebug.println(bitRead(packet[7], 3));
+	// }
+	// bool TurnOnOff = bitRead(packet[7],3);  //Spule EIN/AUS
+	notifyz21InterfaceAccessory((packet[5] << 8) + packet[6], bitRead(packet[7], 0), bitRead(packet[7], 3));
+	//	Addresse					Links/Rechts			Spule EIN/AUS
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXSetExtAccessory(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.print("X_SET_EXT_ACCESSORY RAdr.:");
+		ZDebug.print((packet[5] << 8) + packet[6]);
+		ZDebug.print(":0x");
+		ZDebug.println(packet[7], HEX);
+	}
+	setExtACCInfo((packet[5] << 8) + packet[6], packet[7]);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXGetExtAccessoryInfo(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.print("X_EXT_ACCESSORY_INFO RAdr.:");
+		ZDebug.print((packet[5] << 8) + packet[6]);
+		ZDebug.print(":0x");
+		ZDebug.println(packet[7], HEX); // DB2 Reserviert f�r zuk�nftige Erweiterungen
+	}
+	setExtACCInfo((packet[5] << 8) + packet[6], packet[7]);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXSetStop(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
 	{
-		//<-- 04 00 16 00
-		// 14 00 16 00 19 06 07 01 05 14 88 13 10 27 32 00 50 46 20 4e
+		ZDebug.println("X_SET_STOP");
+	}
+	notifyz21InterfaceRailPower(EnergyState::csEmergencyStop);
+}
 
-		std::array<uint8_t, 16> config;
-		if (getConfig2(config))
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXGetLocoInfo(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (packet[5] == 0xF0)
+	{ // DB0
+		if (m_debug)
 		{
-			uint8_t i = 0;
-			for (auto &conf : config)
-			{
-				data[i++] = conf;
-			}
+			ZDebug.println("X_GET_LOCO_INFO");
 		}
-		// check range of MainV:
-		if ((word(data[13], data[12]) > 0x59D8) || (word(data[13], data[12]) < 0x2A8F))
+		// Antwort: LAN_X_LOCO_INFO  Adr_MSB - Adr_LSB
+		returnLocoStateFull(client, word(packet[6] & 0x3F, packet[7]), false);
+	}
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXSetLocoDrive(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	// setLocoBusy:
+	addBusySlot(client, word(packet[6] & 0x3F, packet[7]));
+
+	if (static_cast<z21Interface::XHeader>(packet[5]) == z21Interface::XHeader::LAN_X_SET_LOCO_FUNCTION)
+	{ // DB0
+		// LAN_X_SET_LOCO_FUNCTION  Adr_MSB        Adr_LSB            Type (00=AUS/01=EIN/10=UM)      Funktion
+		notifyz21InterfaceLocoFkt(word(packet[6] & 0x3F, packet[7]), packet[8] >> 6, packet[8] & B00111111);
+		// uint16_t Adr, uint8_t type, uint8_t fkt
+	}
+	else
+	{ // DB0
+		// ZDebug.print("X_SET_LOCO_DRIVE ");
+		notifyz21InterfaceLocoSpeed(word(packet[6] & 0x3F, packet[7]), packet[8], packet[5] & 0x07);
+	}
+#ifdef directResponse
+	returnLocoStateFull(client, word(packet[6] & 0x3F, packet[7]), true);
+#endif
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveXGetFirmwareVersion(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("X_GET_FIRMWARE_VERSION");
+	}
+	EthSendFrame(client, m_frameFirmwareVersion.data, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSetBroadcastFlags(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	unsigned long bcflag = packet[7];
+	bcflag = packet[6] | (bcflag << 8);
+	bcflag = packet[5] | (bcflag << 8);
+	bcflag = packet[4] | (bcflag << 8);
+	uint16_t localBcFlag = getLocalBcFlag(bcflag);
+	addIPToSlot(client, localBcFlag);
+	// no inside of the protokoll, but good to have:
+	notifyz21InterfaceRailPower(m_railPower); // Zustand Gleisspannung Antworten
+	notifyz21InterfaceBroadcastFlags(client, localBcFlag);
+	if (m_debug)
+	{
+		ZDebug.print("SET_BROADCASTFLAGS: ");
+		ZDebug.println(addIPToSlot(client, 0x00), BIN);
+		// 1=BC Power, Loco INFO, Trnt INFO; 2=BC �nderungen der R�ckmelder am R-Bus
+	}
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetBroadcastFlags(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	unsigned long flag = getz21InterfaceBcFlag(addIPToSlot(client, 0x00));
+	uint8_t data[4];
+	data[0] = flag;
+	data[1] = flag >> 8;
+	data[2] = flag >> 16;
+	data[3] = flag >> 24;
+	EthSend(client, 0x08, z21Interface::Header::LAN_GET_BROADCASTFLAGS, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+	if (m_debug)
+	{
+		ZDebug.print("GET_BROADCASTFLAGS: ");
+		ZDebug.println(flag, BIN);
+	}
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetLocoMode(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	/*
+	In der Z21 kann das Ausgabeformat (DCC, MM) pro Lok-Adresse persistent gespeichert werden.
+	Es k�nnen maximal 256 verschiedene Lok-Adressen abgelegt werden. Jede Adresse >= 256 ist automatisch DCC.
+	*/
+	if (m_debug)
+	{
+		Serial.println(F("LAN_GET_LOCOMODE"));
+	}
+	uint8_t data[3];
+	data[0] = packet[4];
+	data[1] = packet[5];
+	data[2] = 0;
+	handleGetLocoMode(word(packet[4], packet[5]), data[2]);
+	EthSend(client, 0x07, z21Interface::Header::LAN_GET_LOCOMODE, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSetLocoMode(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	// nothing to replay all DCC Format
+	if (m_debug)
+	{
+		Serial.println(F("LAN_SET_LOCOMODE"));
+	}
+	handleSetLocoMode(word(packet[4], packet[5]), packet[6]);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetTurnOutMode(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	/*
+	In der Z21 kann das Ausgabeformat (DCC, MM) pro Funktionsdecoder-Adresse persistent gespeichert werden.
+	Es k�nnen maximal 256 verschiedene Funktionsdecoder -Adressen gespeichert werden. Jede Adresse >= 256 ist automatisch DCC.
+	*/
+	if (m_debug)
+	{
+		ZDebug.println(F("LAN_SET_TURNOUTMODE"));
+	}
+	uint8_t data[3];
+	data[0] = packet[4];
+	data[1] = packet[5];
+	data[2] = 0; // 0=DCC Format; 1=MM Format
+	handleGetTurnOutMode(word(packet[4], packet[5]), data[2]);
+	EthSend(client, 0x07, z21Interface::Header::LAN_GET_LOCOMODE, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSetTurnOutMode(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println(F("LAN_SET_TURNOUTMODE"));
+	}
+	handleSetTurnOutMode(word(packet[4], packet[5]), packet[6]);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveRmBusGetData(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("RMBUS_GETDATA");
+	}
+	// ask for group state 'Gruppenindex'
+	notifyz21InterfaceS88Data(packet[4]); // normal Antwort hier nur an den anfragenden Client! (Antwort geht hier an alle!)
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveIgnore(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSystemStateGetData(uint8_t client, const uint8_t *packet, uint16_t length)
+{ // System state
+	if (m_debug)
+	{
+		ZDebug.println("LAN_SYS-State");
+	}
+	notifyz21InterfacegetSystemInfo(client);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveRailcomGetData(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	uint16_t Adr = 0;
+	if ((packet[4] == 0x01) && (length >= 0x07))
+	{ // RailCom-Daten f�r die gegebene Lokadresse anfordern
+		Adr = word(packet[6], packet[5]);
+	}
+	Adr = notifyz21InterfaceRailcom(); // return global Railcom Adr
+	uint8_t data[10];
+	data[0] = Adr >> 8;	  // LocoAddress
+	data[1] = Adr & 0xFF; // LocoAddress
+	data[2] = 0x00;		  // UINT32 ReceiveCounter Empfangsz�hler in Z21
+	data[3] = 0x00;
+	data[4] = 0x00;
+	data[5] = 0x00;
+	data[6] = 0x00; // UINT32 ErrorCounter Empfangsfehlerz�hler in Z21
+	data[7] = 0x00;
+	data[8] = 0x00;
+	data[9] = 0x00;
+	/*
+	data[10] = 0x00;	//UINT8 Reserved1 experimentell, siehe Anmerkung
+	data[11] = 0x00;	//UINT8 Reserved2 experimentell, siehe Anmerkung
+	data[12] = 0x00;	//UINT8 Reserved3 experimentell, siehe Anmerkung
+	*/
+	EthSend(client, 0x0E, z21Interface::Header::LAN_RAILCOM_DATACHANGED, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveLocoNetFromLan(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("LOCONET_FROM_LAN");
+	}
+	const uint8_t maxLength = 24; // size of EthSend storage
+	if (length > maxLength)
+	{
+		m_invalidLengthCounter++;
+		return;
+	}
+	uint8_t LNdata[maxLength - 0x04]; // n Bytes
+	for (uint8_t i = 0; i < (length - 0x04); i++)
+		LNdata[i] = packet[0x04 + i];
+	notifyz21InterfaceLNSendPacket(LNdata, length - 0x04);
+	// Melden an andere LAN-Client das Meldung auf LocoNet-Bus geschrieben wurde
+	EthSend(client, length, z21Interface::Header::LAN_LOCONET_FROM_LAN, LNdata, false, static_cast<uint16_t>(BcFlagShort::Z21bcLocoNet)); // LAN_LOCONET_FROM_LAN
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveLocoNetDispatchAddr(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	uint8_t data[3];
+	data[0] = packet[4];
+	data[1] = packet[5];
+	data[2] = notifyz21InterfaceLNdispatch(word(packet[5], packet[4])); // dispatchSlot
+	if (m_debug)
+	{
+		ZDebug.print("LOCONET_DISPATCH_ADDR ");
+		ZDebug.print(word(packet[5], packet[4]));
+		ZDebug.print(",");
+		ZDebug.println(data[2]);
+	}
+	EthSend(client, 0x07, z21Interface::Header::LAN_LOCONET_DISPATCH_ADDR, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveLocoNetDetector(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	// if (m_debug)
+	// {
+	// 	ZDebug.println("LOCONET_DETECTOR Abfrage");
+	// }
+	notifyz21InterfaceLNdetector(client, packet[4], word(packet[6], packet[5])); // Anforderung Typ & Reportadresse
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveCanDetector(uint8_t client, const uint8_t *packet, uint16_t length)
+{
+	if (m_debug)
+	{
+		ZDebug.println("CAN_DETECTOR Abfrage");
+	}
+	notifyz21InterfaceCANdetector(client, packet[4], word(packet[6], packet[5])); // Anforderung Typ & CAN-ID
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetConfig1(uint8_t client, const uint8_t *packet, uint16_t length)
+{ // configuration read
+	// <-- 04 00 12 00
+	// 0e 00 12 00 01 00 01 03 01 00 03 00 00 00
+	uint8_t data[10];
+	memset(data, 0, sizeof(data));
+	std::array<uint8_t, 10> config;
+	if (getConfig1(config))
+	{
+		uint8_t i = 0;
+		for (auto &conf : config)
 		{
-			// set to 20V default:
-			data[13] = highByte(0x4e20);
-			data[12] = lowByte(0x4e20);
+			data[i++] = conf;
 		}
-		// check range of ProgV:
-		if ((word(data[15], data[14]) > 0x59D8) || (word(data[15], data[14]) < 0x2A8F))
+	}
+	EthSend(client, 0x0e, z21Interface::Header::LAN_GET_CONFIG1, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+	if (m_debug)
+	{
+		ZDebug.print("Z21 Eins(read) ");
+		ZDebug.print("RailCom: ");
+		ZDebug.print(data[0], HEX);
+		ZDebug.print(", PWR-Button: ");
+		ZDebug.print(data[2], HEX);
+		ZDebug.print(", ProgRead: ");
+		switch (data[3])
 		{
-			// set to 20V default:
-			data[15] = highByte(0x4e20);
-			data[14] = lowByte(0x4e20);
+		case 0x00:
+			ZDebug.print("nothing");
+			break;
+		case 0x01:
+			ZDebug.print("Bit");
+			break;
+		case 0x02:
+			ZDebug.print("Byte");
+			break;
+		case 0x03:
+			ZDebug.print("both");
+			break;
 		}
+		ZDebug.println();
+	}
+}
 
-		EthSend(client, 0x14, z21Interface::Header::LAN_GET_CONFIG2, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
-		if (m_debug)
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSetConfig1(uint8_t client, const uint8_t *packet, uint16_t length)
+{ // configuration write
+	//<-- 0e 00 13 00 01 00 01 03 01 00 03 00 00 00
+	// 0x0e = Length; 0x12 = Header
+	// Daten:
+	//(0x01) RailCom: 0=aus/off, 1=ein/on
+	//(0x00)
+	//(0x01) Power-Button: 0=Gleisspannung aus, 1=Nothalt
+	//(0x03) Auslese-Modus: 0=Nichts, 1=Bit, 2=Byte, 3=Beides
+	if (m_debug)
+	{
+		ZDebug.print("Z21 Eins(write) ");
+		ZDebug.print("RailCom: ");
+		ZDebug.print(packet[4], HEX);
+		ZDebug.print(", PWR-Button: ");
+		ZDebug.print(packet[6], HEX);
+		ZDebug.print(", ProgRead: ");
+		switch (packet[7])
 		{
-			ZDebug.print("Z21 Eins(read) ");
-			ZDebug.print("RstP(s): ");
-			ZDebug.print(data[0]); // EEPROM Adr 60
-			ZDebug.print(", RstP(f): ");
-			ZDebug.print(data[1]); // EEPROM Adr 61
-			ZDebug.print(", ProgP: ");
-			ZDebug.print(data[2]); // EEPROM Adr 62
-			ZDebug.print(", MainV: ");
-			ZDebug.print(word(data[13], data[12])); // Value only: 11000 - 23000
-			ZDebug.print(", ProgV: ");
-			ZDebug.print(word(data[15], data[14])); // Value only: 11000=0x2A8F - 23000=0x59D8
-			ZDebug.println();
+		case 0x00:
+			ZDebug.print("nothing");
+			break;
+		case 0x01:
+			ZDebug.print("Bit");
+			break;
+		case 0x02:
+			ZDebug.print("Byte");
+			break;
+		case 0x03:
+			ZDebug.print("both");
+			break;
 		}
+		ZDebug.println();
 	}
-	break;
-	case z21Interface::Header::LAN_SET_CONFIG2:
-	{ // configuration write
-		//<-- 14 00 17 00 19 06 07 01 05 14 88 13 10 27 32 00 50 46 20 4e
-		// 0x14 = Length; 0x16 = Header(read), 0x17 = Header(write)
-		// Daten:
-		// (0x19) Reset Packet (starten) (25-255)
-		// (0x06) Reset Packet (fortsetzen) (6-64)
-		// (0x07) Programmier-Packete (7-64)
-		// (0x01) ?
-		// (0x05) ?
-		// (0x14) ?
-		// (0x88) ?
-		// (0x13) ?
-		// (0x10) ?
-		// (0x27) ?
-		// (0x32) ?
-		// (0x00) ?
-		// (0x50) Hauptgleis (LSB) (11-23V)
-		// (0x46) Hauptgleis (MSB)
-		// (0x20) Programmiergleis (LSB) (11-23V): 20V=0x4e20, 21V=0x5208, 22V=0x55F0
-		// (0x4e) Programmiergleis (MSB)
-		if (m_debug)
-		{
-			ZDebug.print("Z21 Eins(write) ");
-			ZDebug.print("RstP(s): ");
-			ZDebug.print(packet[4]); // EEPROM Adr 60
-			ZDebug.print(", RstP(f): ");
-			ZDebug.print(packet[5]); // EEPROM Adr 61
-			ZDebug.print(", ProgP: ");
-			ZDebug.print(packet[6]); // EEPROM Adr 62
-			ZDebug.print(", MainV: ");
-			ZDebug.print(word(packet[17], packet[16]));
-			ZDebug.print(", ProgV: ");
-			ZDebug.print(word(packet[19], packet[18]));
-			ZDebug.println();
-		}
-		std::array<uint8_t, 16> config;
-		uint8_t i = 4;
+
+	std::array<uint8_t, 10> config;
+	uint8_t i = 4;
+	for (auto &conf : config)
+	{
+		conf = packet[i++];
+	}
+	setConfig1(config);
+	// Request DCC to change
+	notifyz21InterfaceUpdateConf();
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveGetConfig2(uint8_t client, const uint8_t *packet, uint16_t length)
+{ // configuration read
+	//<-- 04 00 16 00
+	// 14 00 16 00 19 06 07 01 05 14 88 13 10 27 32 00 50 46 20 4e
+	uint8_t data[16];
+	memset(data, 0, sizeof(data));
+	std::array<uint8_t, 16> config;
+	if (getConfig2(config))
+	{
+		uint8_t i = 0;
 		for (auto &conf : config)
 		{
-			conf = packet[i];
+			data[i++] = conf;
 		}
-		setConfig2(config);
+	}
+	// check range of MainV:
+	if ((word(data[13], data[12]) > 0x59D8) || (word(data[13], data[12]) < 0x2A8F))
+	{
+		// set to 20V default:
+		data[13] = highByte(0x4e20);
+		data[12] = lowByte(0x4e20);
+	}
+	// check range of ProgV:
+	if ((word(data[15], data[14]) > 0x59D8) || (word(data[15], data[14]) < 0x2A8F))
+	{
+		// set to 20V default:
+		data[15] = highByte(0x4e20);
+		data[14] = lowByte(0x4e20);
+	}
 
-		// Request DCC to change
-		notifyz21InterfaceUpdateConf();
-		break;
+	EthSend(client, 0x14, z21Interface::Header::LAN_GET_CONFIG2, data, false, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+	if (m_debug)
+	{
+		ZDebug.print("Z21 Eins(read) ");
+		ZDebug.print("RstP(s): ");
+		ZDebug.print(data[0]); // EEPROM Adr 60
+		ZDebug.print(", RstP(f): ");
+		ZDebug.print(data[1]); // EEPROM Adr 61
+		ZDebug.print(", ProgP: ");
+		ZDebug.print(data[2]); // EEPROM Adr 62
+		ZDebug.print(", MainV: ");
+		ZDebug.print(word(data[13], data[12])); // Value only: 11000 - 23000
+		ZDebug.print(", ProgV: ");
+		ZDebug.print(word(data[15], data[14])); // Value only: 11000=0x2A8F - 23000=0x59D8
+		ZDebug.println();
 	}
+}
 
-	default:
-		if (m_debug)
-		{
-			ZDebug.print("UNKNOWN_COMMAND");
-			for (uint8_t i = 0; i < packet[0]; i++)
-			{
-				ZDebug.print(" 0x");
-				ZDebug.print(packet[i], HEX);
-			}
-			ZDebug.println();
-		}
-		data[0] = 0x61;
-		data[1] = 0x82;
-		EthSend(client, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone));
+//--------------------------------------------------------------------------------------------
+void z21Interface::receiveSetConfig2(uint8_t client, const uint8_t *packet, uint16_t length)
+{ // configuration write
+	//<-- 14 00 17 00 19 06 07 01 05 14 88 13 10 27 32 00 50 46 20 4e
+	// 0x14 = Length; 0x16 = Header(read), 0x17 = Header(write)
+	// Daten:
+	// (0x19) Reset Packet (starten) (25-255)
+	// (0x06) Reset Packet (fortsetzen) (6-64)
+	// (0x07) Programmier-Packete (7-64)
+	// (0x01) ?
+	// (0x05) ?
+	// (0x14) ?
+	// (0x88) ?
+	// (0x13) ?
+	// (0x10) ?
+	// (0x27) ?
+	// (0x32) ?
+	// (0x00) ?
+	// (0x50) Hauptgleis (LSB) (11-23V)
+	// (0x46) Hauptgleis (MSB)
+	// (0x20) Programmiergleis (LSB) (11-23V): 20V=0x4e20, 21V=0x5208, 22V=0x55F0
+	// (0x4e) Programmiergleis (MSB)
+	if (m_debug)
+	{
+		ZDebug.print("Z21 Eins(write) ");
+		ZDebug.print("RstP(s): ");
+		ZDebug.print(packet[4]); // EEPROM Adr 60
+		ZDebug.print(", RstP(f): ");
+		ZDebug.print(packet[5]); // EEPROM Adr 61
+		ZDebug.print(", ProgP: ");
+		ZDebug.print(packet[6]); // EEPROM Adr 62
+		ZDebug.print(", MainV: ");
+		ZDebug.print(word(packet[17], packet[16]));
+		ZDebug.print(", ProgV: ");
+		ZDebug.print(word(packet[19], packet[18]));
+		ZDebug.println();
 	}
-	//---------------------------------------------------------------------------------------
-	// check if IP is still used:
-	unsigned long currentMillis = millis();
-	if ((currentMillis - z21InterfaceIPpreviousMillis) > z21InterfaceIPinterval)
+	std::array<uint8_t, 16> config;
+	uint8_t i = 4;
+	for (auto &conf : config)
 	{
-		z21InterfaceIPpreviousMillis = currentMillis;
-		for (uint8_t i = 0; i < z21InterfaceclientMAX; i++)
-		{
-			if (ActIP[i].time > 0)
-			{
-				ActIP[i].time--; // Zeit herrunterrechnen
-			}
-			else
-			{
-				clearIP(i); // clear IP DATA
-							// send MESSAGE clear Client
-			}
-		}
+		conf = packet[i++];
 	}
+	setConfig2(config);
+
+	// Request DCC to change
+	notifyz21InterfaceUpdateConf();
 }
 
 //--------------------------------------------------------------------------------------------
 // Zustand der Gleisversorgung setzten
 void z21Interface::setPower(EnergyState state)
 {
-	uint8_t data[] = {static_cast<uint8_t>(z21Interface::XHeader::LAN_X_BC_TRACK_POWER), 0x00};
+	const uint8_t *data = frameXTrackPowerOff.data;
 	m_railPower = state;
 	switch (state)
 	{
 	case EnergyState::csNormal:
-		data[1] = 0x01;
+		data = frameXTrackPowerOn.data;
 		break;
 	case EnergyState::csTrackVoltageOff:
-		data[1] = 0x00;
+		data = frameXTrackPowerOff.data;
 		break;
 	case EnergyState::csServiceMode:
-		data[1] = 0x02;
+		data = frameXProgrammingMode.data;
 		break;
 	case EnergyState::csShortCircuit:
-		data[1] = 0x08;
+		data = frameXTrackShortCircuit.data;
 		break;
 	case EnergyState::csEmergencyStop:
-		data[0] = 0x81;
-		data[1] = 0x00;
+		data = frameXStopped.data;
 		break;
 	}
-	EthSend(0, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
+	EthSendFrame(0, data, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
 	if (m_debug)
 	{
 		ZDebug.print("set_X_BC_TRACK_POWER ");
@@ -863,6 +1041,8 @@ void z21Interface::returnLocoStateFull(uint8_t client, uint16_t Adr, bool bc)
 	data[8] = (char)ldata[5]; // F21-F28
 
 	// Info to all:
+	uint8_t clients[z21InterfaceclientMAX];
+	uint8_t numberOfClients = 0;
 	for (uint8_t i = 0; i < z21InterfaceclientMAX; i++)
 	{
 		if (ActIP[i].client != client)
@@ -870,7 +1050,7 @@ void z21Interface::returnLocoStateFull(uint8_t client, uint16_t Adr, bool bc)
 			if ((ActIP[i].BCFlag & (static_cast<uint16_t>(BcFlagShort::Z21bcAll) | static_cast<uint16_t>(BcFlagShort::Z21bcNetAll))) > 0)
 			{
 				if (bc == true)
-					EthSend(ActIP[i].client, 14, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcNone)); // Send Loco status und Funktions to BC Apps
+					clients[numberOfClients++] = ActIP[i].client;
 			}
 		}
 		else
@@ -883,6 +1063,10 @@ void z21Interface::returnLocoStateFull(uint8_t client, uint16_t Adr, bool bc)
 			data[3] = data[3] | 0x08;																							// BUSY!
 		}
 	}
+	if (numberOfClients > 0)
+	{
+		EthSend(clients, numberOfClients, 14, z21Interface::Header::LAN_X_HEADER, data, true); // Send Loco status und Funktions to BC Apps
+	}
 }
 
 //--------------------------------------------------------------------------------------------
@@ -981,10 +1165,7 @@ void z21Interface::setCVNack()
 	{
 	  Serial.println("setCVNack");
 	}
-	uint8_t data[2];
-	data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_CV_NACK); // 0x61 X-Header
-	data[1] = 0x13;														  // DB0
-	EthSend(0, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
+	EthSendFrame(0, frameXCVNack.data, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
 }
 
 //--------------------------------------------------------------------------------------------
@@ -995,10 +1176,7 @@ void z21Interface::setCVNackSC()
 	{
 	  Serial.println("setCVNackSC");
 	}
-	uint8_t data[2];
-	data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_CV_NACK_SC); // 0x61 X-Header
-	data[1] = 0x12;															 // DB0
-	EthSend(0, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
+	EthSendFrame(0, frameXCVNackSC.data, static_cast<uint16_t>(BcFlagShort::Z21bcAll));
 }
 
 //--------------------------------------------------------------------------------------------
@@ -1057,10 +1235,8 @@ void z21Interface::sendSystemInfo(uint8_t client, uint16_t maincurrent, uint16_t
 // Functions only available to other functions in this library *******************************************************
 
 //--------------------------------------------------------------------------------------------
-void z21Interface::EthSend(uint8_t client, unsigned int DataLen, z21Interface::Header Header, uint8_t *dataString, boolean withXOR, uint16_t BC)
+void z21Interface::EthBuild(uint8_t *data, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR)
 {
-	uint8_t data[24]; // z21Interface send storage
-
 	//--------------------------------------------
 	// XOR bestimmen:
 	data[0] = DataLen & 0xFF;
@@ -1076,7 +1252,44 @@ void z21Interface::EthSend(uint8_t client, unsigned int DataLen, z21Interface::H
 		data[i + 4] = *dataString;
 		dataString++;
 	}
-	//--------------------------------------------
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data, uint16_t length)
+{
+	// without support of the transport every dataset is sent on its own
+	uint16_t offset = 0;
+	while ((offset + 4) <= length)
+	{
+		uint16_t datasetLength = word(data[offset + 1], data[offset]);
+		if ((datasetLength < 4) || (datasetLength > (length - offset)))
+		{
+			break;
+		}
+		notifyz21InterfaceEthSend(client, &data[offset]);
+		offset += datasetLength;
+	}
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::EthSend(const uint8_t *clients, uint8_t numberOfClients, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR)
+{
+	uint8_t data[24]; // z21Interface send storage
+	EthBuild(data, DataLen, Header, dataString, withXOR);
+	notifyz21InterfaceEthSend(clients, numberOfClients, data);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::EthSend(uint8_t client, unsigned int DataLen, z21Interface::Header Header, const uint8_t *dataString, boolean withXOR, uint16_t BC)
+{
+	uint8_t data[24]; // z21Interface send storage
+	EthBuild(data, DataLen, Header, dataString, withXOR);
+	EthSendFrame(client, data, BC);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21Interface::EthSendFrame(uint8_t client, const uint8_t *data, uint16_t BC)
+{
 	if (client > 0)
 	{
 		notifyz21InterfaceEthSend(client, data);
@@ -1112,29 +1325,24 @@ void z21Interface::EthSend(uint8_t client, unsigned int DataLen, z21Interface::H
 		}
 		else
 		{
-
-			uint8_t clientOut = client;
+			uint8_t clients[z21InterfaceclientMAX];
+			uint8_t numberOfClients = 0;
 			for (uint8_t i = 0; i < z21InterfaceclientMAX; i++)
 			{
 				if ((ActIP[i].time > 0) && ((BC & ActIP[i].BCFlag) > 0))
 				{ // Boradcast & Noch aktiv
-
-					if (BC != 0)
+					if (BC == static_cast<uint16_t>(BcFlagShort::Z21bcAll))
 					{
-						if (BC == static_cast<uint16_t>(BcFlagShort::Z21bcAll))
-							clientOut = 0; // ALL
-						else
-							clientOut = ActIP[i].client;
+						notifyz21InterfaceEthSend(0, data); // ALL
+						return;
 					}
-
-					//--------------------------------------------
-					notifyz21InterfaceEthSend(clientOut, data);
+					clients[numberOfClients++] = ActIP[i].client;
 #ifdef DEBUG_SENDING
 					if (m_debug)
 					{
 						ZDebug.print(i);
 						ZDebug.print("BTX ");
-						ZDebug.print(clientOut);
+						ZDebug.print(ActIP[i].client);
 						ZDebug.print(" BC:");
 						ZDebug.print(BC & ActIP[i].BCFlag, BIN);
 						ZDebug.print(" : ");
@@ -1146,10 +1354,12 @@ void z21Interface::EthSend(uint8_t client, unsigned int DataLen, z21Interface::H
 						ZDebug.println();
 					}
 #endif
-					if (clientOut == 0)
-						return;
 				}
 			}
+			if (numberOfClients > 0)
+			{
+				notifyz21InterfaceEthSend(clients, numberOfClients, data);
+			}
 		}
 	}
 }
@@ -24,14 +24,29 @@ void z21InterfaceObserver::update(Observable<Udp::Message> &observable, Udp::Mes
     if (nullptr != data)
     {
       Udp::Message *message = data;
-      receive(message->client, message->data); // Auswertung
+      receive(message->client, message->data, message->length); // Auswertung
     }
   }
 }
 
 //--------------------------------------------------------------------------------------------
-void z21InterfaceObserver::notifyz21InterfaceEthSend(uint8_t client, uint8_t *data)
+void z21InterfaceObserver::notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data)
 {
-  Udp::Message message{client, data};
+  Udp::Message message{client, data, word(data[1], data[0]), 0};
+  m_udpInterface->transmit(message);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21InterfaceObserver::notifyz21InterfaceEthSend(const uint8_t *clients, uint8_t numberOfClients, const uint8_t *data)
+{
+  Udp::Message message{0, data, word(data[1], data[0]), 0};
+  m_udpInterface->transmit(message, clients, numberOfClients);
+}
+
+//--------------------------------------------------------------------------------------------
+void z21InterfaceObserver::notifyz21InterfaceEthSend(uint8_t client, const uint8_t *data, uint16_t length)
+{
+  // all datasets in one datagram
+  Udp::Message message{client, data, length, 0};
   m_udpInterface->transmit(message);
 }
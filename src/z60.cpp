@@ -15,6 +15,129 @@
  */
 
 #include "z60.h"
+#include <algorithm>
+
+namespace
+{
+  // speed conversion between z21 speed byte (DSSS SSSS) and trainbox speed (0-1000)
+  // mode is the z21 step config (DB0 & 0x03 of LAN_X_SET_LOCO_DRIVE): 0 = 14, 2 = 28, 3 = 128 steps
+  constexpr uint8_t numberOfStepModes{4};
+  constexpr uint16_t maxTrainboxSpeed{1000};
+  constexpr uint16_t speedEmergencyStop{0xFFFF};
+  constexpr uint8_t stepConfig28{0x02};  // z21Interface::StepConfig::Step28
+  constexpr uint8_t stepConfig128{0x03}; // z21Interface::StepConfig::Step128
+
+  // divisor used for trainbox speed
+  constexpr uint16_t stepDivisor(uint8_t mode)
+  {
+    return (stepConfig128 == mode) ? 128 : ((stepConfig28 == mode) ? 28 : 14);
+  }
+
+  constexpr uint8_t maxStep(uint8_t mode)
+  {
+    return (stepConfig128 == mode) ? 126 : static_cast<uint8_t>(stepDivisor(mode));
+  }
+
+  // speed step of z21 speed byte (without direction bit) or speedEmergencyStop
+  constexpr uint16_t z21ToStep(uint8_t mode, uint8_t data)
+  {
+    if (stepConfig28 == mode)
+    {
+      // 0 0000 = stop, 1 0000 = stop (I), 0 0001 = emergency stop, 1 0001 = emergency stop (I), then step 1 - 28
+      uint8_t step28 = static_cast<uint8_t>(((data & 0x0F) << 1) | ((data & 0x10) >> 4));
+      return (step28 < 2) ? 0 : ((step28 < 4) ? speedEmergencyStop : step28 - 3);
+    }
+    if (stepConfig128 != mode)
+    {
+      data &= 0x0F;
+    }
+    return (0 == data) ? 0 : ((1 == data) ? speedEmergencyStop : data - 1);
+  }
+
+  constexpr uint8_t stepToZ21(uint8_t mode, uint8_t step)
+  {
+    if (0 == step)
+    {
+      return 0;
+    }
+    if (stepConfig28 == mode)
+    {
+      uint8_t buf = step + 3;
+      return static_cast<uint8_t>(((buf & 0x1E) >> 1) | ((buf & 0x01) << 4));
+    }
+    return step + 1;
+  }
+
+  struct SpeedTables
+  {
+    uint16_t z21ToTrainbox[numberOfStepModes][128];
+    uint8_t trainboxToZ21[numberOfStepModes][maxTrainboxSpeed + 1];
+  };
+
+  // step to trainbox is rounded down, trainbox to step to the nearest step
+  // the rounding error of both is below half a step, so every step survives the way to trainbox and back
+  constexpr SpeedTables makeSpeedTables()
+  {
+    SpeedTables tables{};
+    for (uint8_t mode = 0; mode < numberOfStepModes; mode++)
+    {
+      uint32_t divisor = stepDivisor(mode);
+      for (uint8_t data = 0; data < 128; data++)
+      {
+        uint16_t step = z21ToStep(mode, data);
+        tables.z21ToTrainbox[mode][data] = (speedEmergencyStop == step) ? speedEmergencyStop : static_cast<uint16_t>(step * maxTrainboxSpeed / divisor);
+      }
+      for (uint32_t speed = 0; speed <= maxTrainboxSpeed; speed++)
+      {
+        uint32_t step = (speed * divisor + maxTrainboxSpeed / 2) / maxTrainboxSpeed;
+        if (step > maxStep(mode))
+        {
+          step = maxStep(mode);
+        }
+        tables.trainboxToZ21[mode][speed] = stepToZ21(mode, static_cast<uint8_t>(step));
+      }
+    }
+    return tables;
+  }
+
+  constexpr SpeedTables speedTables = makeSpeedTables();
+
+  constexpr bool speedTablesRoundTrip()
+  {
+    for (uint8_t mode = 0; mode < numberOfStepModes; mode++)
+    {
+      uint16_t lastSpeed = 0;
+      for (uint8_t step = 0; step <= maxStep(mode); step++)
+      {
+        uint8_t data = stepToZ21(mode, step);
+        uint16_t speed = speedTables.z21ToTrainbox[mode][data];
+        // z21 -> trainbox -> z21 returns the same speed byte
+        if ((speed > maxTrainboxSpeed) || (speedTables.trainboxToZ21[mode][speed] != data))
+        {
+          return false;
+        }
+        // speed is strictly increasing with the step
+        if ((0 != step) && (speed <= lastSpeed))
+        {
+          return false;
+        }
+        lastSpeed = speed;
+      }
+      // every trainbox speed maps to a valid speed byte
+      for (uint16_t speed = 0; speed <= maxTrainboxSpeed; speed++)
+      {
+        uint16_t step = z21ToStep(mode, speedTables.trainboxToZ21[mode][speed]);
+        if ((speedEmergencyStop == step) || (step > maxStep(mode)))
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  static_assert(speedTablesRoundTrip(), "speed tables do not round-trip");
+}
 
 z60::z60(uint16_t hash, uint32_t serialNumber, HwType hwType, uint32_t swVersion, bool debugZ60, bool debugZ21, bool debugTrainbox)
     : MaerklinCanInterfaceObserver(hash, debugTrainbox),
@@ -24,10 +147,13 @@ z60::z60(uint16_t hash, uint32_t serialNumber, HwType hwType, uint32_t swVersion
       m_directProgramming(false),
       m_debug(debugZ60)
 {
+  m_locos.reserve(m_maxNumberOfLoco);
 }
 
 z60::~z60()
 {
+  flushLocoConfig();
+  flushTurnouts();
 }
 
 void z60::begin()
@@ -44,6 +170,10 @@ void z60::begin()
     size_t readSize = 0;
     Serial.print(F("sizeLocoMode "));
     Serial.println(sizeLocoMode);
+    if (sizeLocoMode > sizeof(buffer))
+    {
+      sizeLocoMode = sizeof(buffer);
+    }
     if (0 != sizeLocoMode)
     {
       readSize = m_preferences.getBytes(m_keyLocoMode, buffer, sizeLocoMode);
@@ -55,10 +185,25 @@ void z60::begin()
     Serial.print(F("readSize "));
     Serial.println(readSize);
     readSize /= sizeof(ConfigLoco);
-    for (size_t i = 0; i < readSize; i++)
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(buffer);
+    m_savedLocoConfig.assign(bytes, bytes + readSize * sizeof(ConfigLoco));
+    // stored newest first, so the oldest loco is inserted first
+    for (size_t i = readSize; i > 0; i--)
     {
+      ConfigLoco &config = buffer[i - 1];
+      if (nullptr == findLoco(config.adrZ21))
+      {
+        insertLoco(DataLoco{config.adrZ21, fromZ21AdrToTrainboxAdr(config.adrZ21, config.mode), config.mode, false, 0, true, {config.steps, 0, 0, 0, 0, 0}});
+      }
+    }
 
-      m_locos.emplace_back(DataLoco{buffer[i].adrZ21, fromZ21AdrToTrainboxAdr(buffer[i].adrZ21, buffer[i].mode), buffer[i].mode, false, 0, true, {buffer[i].steps, 0, 0, 0, 0, 0}});
+    if (m_turnoutPersistence && (m_preferences.getBytesLength(m_keyTurnouts) == m_turnouts.byteSize()))
+    {
+      if (m_preferences.getBytes(m_keyTurnouts, m_turnouts.data(), m_turnouts.byteSize()) != m_turnouts.byteSize())
+      {
+        Serial.println(F(" Failed to read turnouts"));
+        m_turnouts.clear();
+      }
     }
 
     // if (preferences.getBytes(keyTurnOutMode, turnOutMode, sizeof(turnOutMode)) != sizeof(turnOutMode))
@@ -76,19 +221,12 @@ void z60::begin()
   MaerklinCanInterfaceObserver::begin();
   z21InterfaceObserver::begin();
 
-  delay(1000);
+  // check for train box or mobile station, pings are sent by cyclic while z21 clients are already served
   m_trainboxIdList.clear();
   m_stationList.clear();
-  // check for train box or mobile station
-  for (uint8_t i = 0; i < 5; i++)
-  {
-    sendPing();
-    delay(500);
-    if (m_trainboxIdList.size() != 0)
-    {
-      break;
-    }
-  }
+  m_discoveryPingCounter = 0;
+  m_nextDiscoveryPingTimeINms = millis() + m_discoveryStartDelayINms;
+  m_discoveryState = DiscoveryState::Pinging;
 
   // Disable track voltage
   // z21InterfaceObserver::setPower(EnergyState::csTrackVoltageOff);
@@ -113,15 +251,36 @@ void z60::begin()
 void z60::cyclic()
 {
   uint32_t currentTimeINms = millis();
-  if (m_programmingCmdActive)
+  MaerklinCanInterface::cyclic();
+
+  if (DiscoveryState::Pinging == m_discoveryState)
+  {
+    handleDiscovery(currentTimeINms);
+  }
+
+  sendScheduledLocoSpeeds(currentTimeINms);
+
+  if (!m_accessoryQueue.empty() || !m_activeCoils.empty())
   {
-    if ((m_lastProgrammingCmdSentTimeINms + m_currentProgrammingCmd.timeoutINms) < currentTimeINms)
+    handleAccessoryQueue(currentTimeINms);
+  }
+
+  // loco config is written once changes settled, but not later than m_maxLocoConfigSaveDelayINms after the first change
+  if (m_locoConfigDirty)
+  {
+    if (((currentTimeINms - m_locoConfigChangedTimeINms) >= m_locoConfigSaveDelayINms) ||
+        ((currentTimeINms - m_locoConfigDirtyTimeINms) >= m_maxLocoConfigSaveDelayINms))
     {
-      if(m_debug)
-      {
-      Serial.println("Timeout ProgrammingCmd");
-      }
-      sendNextProgrammingCmd();
+      flushLocoConfig();
+    }
+  }
+
+  if (m_turnoutsDirty)
+  {
+    if (((currentTimeINms - m_turnoutsChangedTimeINms) >= m_locoConfigSaveDelayINms) ||
+        ((currentTimeINms - m_turnoutsDirtyTimeINms) >= m_maxLocoConfigSaveDelayINms))
+    {
+      flushTurnouts();
     }
   }
 
@@ -154,11 +313,29 @@ void z60::cyclic()
 
 void z60::saveLocoConfig()
 {
+  unsigned long currentTimeINms = millis();
+  if (!m_locoConfigDirty)
+  {
+    m_locoConfigDirty = true;
+    m_locoConfigDirtyTimeINms = currentTimeINms;
+  }
+  m_locoConfigChangedTimeINms = currentTimeINms;
+}
+
+void z60::flushLocoConfig()
+{
+  if (!m_locoConfigDirty)
+  {
+    return;
+  }
+
   ConfigLoco buffer[256];
 
   size_t index = 0;
-  for (DataLoco n : m_locos)
+  // newest loco first
+  for (size_t i = m_locos.size(); i > 0; i--)
   {
+    DataLoco &n = m_locos[(m_oldestLoco + i - 1) % m_locos.size()];
     // only locos where trainbox adress is determent by mode are saved
     if (n.adrZ21 < m_startAdressDcc14)
     {
@@ -169,18 +346,42 @@ void z60::saveLocoConfig()
     }
   }
 
+  size_t length = index * sizeof(ConfigLoco);
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(buffer);
+  // e.g. a step config toggled forth and back, nothing to write
+  if ((m_savedLocoConfig.size() == length) && std::equal(bytes, bytes + length, m_savedLocoConfig.begin()))
+  {
+    m_locoConfigDirty = false;
+    return;
+  }
+
+  if (m_debug)
+  {
+    Serial.printf("Save loco config: %u locos\n", static_cast<unsigned>(index));
+  }
+
   if (!m_preferences.begin(m_namespaceZ21, false))
   {
     Serial.println(F("Access preferences failed"));
   }
   else
   {
-    if (m_preferences.putBytes(m_keyLocoMode, buffer, m_locos.size() * sizeof(ConfigLoco)) != m_locos.size() * sizeof(ConfigLoco))
+    if (m_preferences.putBytes(m_keyLocoMode, buffer, length) != length)
     {
       Serial.println(F(" Failed to write locoMode"));
     }
+    else
+    {
+      m_savedLocoConfig.assign(bytes, bytes + length);
+      m_locoConfigDirty = false;
+    }
     m_preferences.end();
   }
+  // config stays dirty after a failed write and is written again after the save delay
+  if (m_locoConfigDirty)
+  {
+    m_locoConfigDirtyTimeINms = m_locoConfigChangedTimeINms = millis();
+  }
 }
 
 void z60::deleteLocoConfig()
@@ -199,54 +400,31 @@ void z60::deleteLocoConfig()
     {
       // delete all locos currently in memory to prevent writing again
       m_locos.clear();
+      m_locoIndexZ21.clear();
+      m_locoIndexTrainbox.clear();
+      m_oldestLoco = 0;
+      m_speedSchedule = decltype(m_speedSchedule)();
+      m_locoConfigDirty = false;
+      m_savedLocoConfig.clear();
     }
     m_preferences.end();
   }
 }
 
-bool z60::calcSpeedZ21toTrainbox(uint8_t data, uint8_t speedConfig, uint8_t &speed)
+bool z60::calcSpeedZ21toTrainbox(uint8_t data, uint8_t speedConfig, uint16_t &speed)
 {
-  bool emergencyStop = false;
-  if (0 == data)
+  uint16_t value = speedTables.z21ToTrainbox[speedConfig & 0x03][data & 0x7F];
+  if (speedEmergencyStop == value)
   {
-    speed = 0;
+    return true;
   }
-  else if (1 == data)
-  {
-    emergencyStop = true;
-  }
-  else
-  {
-    if (static_cast<uint8_t>(StepConfig::Step28) == speedConfig)
-    {
-      speed = (((data & 0x0F) << 1) | ((data & 0x10) >> 4)) - 3;
-    }
-    else
-    {
-      speed = data - 1;
-    }
-  }
-  return emergencyStop;
+  speed = value;
+  return false;
 }
 
-void z60::calcSpeedTrainboxToZ21(uint8_t speed, uint8_t speedConfig, uint8_t &data)
+void z60::calcSpeedTrainboxToZ21(uint16_t speed, uint8_t speedConfig, uint8_t &data)
 {
-  if (0 == speed)
-  {
-    data = 0;
-  }
-  else
-  {
-    if (static_cast<uint8_t>(StepConfig::Step28) == speedConfig)
-    {
-      uint8_t buf = speed + 3;
-      data = ((buf & 0x1E) >> 1) | ((buf & 0x01) << 4);
-    }
-    else
-    {
-      data = speed + 1;
-    }
-  }
+  data = speedTables.trainboxToZ21[speedConfig & 0x03][std::min(speed, maxTrainboxSpeed)];
 }
 
 bool z60::getConfig1(std::array<uint8_t, 10> &config)
@@ -334,9 +512,47 @@ uint16_t z60::getSerialNumber()
   return m_serialNumber;
 }
 
-void z60::notifyProgrammingCmdSent()
+// responses are reported by onReadConfig and onWriteConfig, only a missing response is handled here
+MaerklinCanInterface::ProgrammingCallback z60::nackOnTimeout()
 {
-  m_lastProgrammingCmdSentTimeINms = millis();
+  return [this](const TrackMessage *response)
+  {
+    if (nullptr == response)
+    {
+      setCVNack();
+    }
+  };
+}
+
+void z60::handleDiscovery(unsigned long currentTimeINms)
+{
+  if (static_cast<long>(currentTimeINms - m_nextDiscoveryPingTimeINms) < 0)
+  {
+    return;
+  }
+  if ((0 != m_trainboxIdList.size()) || (m_discoveryPingCounter >= m_maxDiscoveryPings))
+  {
+    m_discoveryState = DiscoveryState::Finished;
+    if (m_debug)
+    {
+      Serial.print(F("Discovery finished, trainboxes:"));
+      Serial.print(m_trainboxIdList.size());
+      Serial.print(F(" stations:"));
+      Serial.println(m_stationList.size());
+    }
+    return;
+  }
+  sendPing();
+  m_discoveryPingCounter++;
+  m_nextDiscoveryPingTimeINms = currentTimeINms + m_discoveryPingIntervalINms;
+}
+
+void z60::notifyHashNegotiated()
+{
+  if (nullptr != m_configDataStream)
+  {
+    m_configDataStream->setHash(m_hash);
+  }
 }
 
 void z60::setLocoManagment(MaerklinConfigDataStream *configDataStream)
@@ -410,15 +626,13 @@ bool z60::onLocoStop(uint32_t id)
   //  data[1] = 0x00;
   //  EthSend(0x00, 0x07, z21Interface::Header::LAN_X_HEADER, data, true, 0);
 
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
-  // for (dataLoco finding : locos)
+  auto range = m_locoIndexTrainbox.equal_range(id);
+  for (auto index = range.first; index != range.second; ++index)
   {
-    if (finding->adrTrainbox == id)
-    {
-      uint8_t emergencyStop = 0x01;
-      finding->data[1] = emergencyStop + (finding->data[1] & 0x80);
-      notifyLocoState(0, finding->adrZ21, finding->data);
-    }
+    DataLoco *finding = &m_locos[index->second];
+    uint8_t emergencyStop = 0x01;
+    finding->data[1] = emergencyStop + (finding->data[1] & 0x80);
+    notifyLocoState(0, *finding);
   }
   return true;
 }
@@ -435,6 +649,11 @@ bool z60::onLocoDataProtocol(uint32_t id, ProtocolLoco protocol)
 
 bool z60::onAccTime(uint32_t id, uint16_t accTimeIN10ms)
 {
+  // switch time of accessory decoders set by another device
+  if (0 != accTimeIN10ms)
+  {
+    m_defaultSwitchTimeIN10ms = accTimeIN10ms;
+  }
   return false;
 }
 
@@ -631,36 +850,28 @@ bool z60::onLocoSpeed(uint32_t id)
 
 bool z60::onLocoSpeed(uint32_t id, uint16_t speed)
 {
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
-  // for (dataLoco finding : locos)
+  auto range = m_locoIndexTrainbox.equal_range(id);
+  for (auto index = range.first; index != range.second; ++index)
   {
-    if (finding->adrTrainbox == id)
+    DataLoco *finding = &m_locos[index->second];
+    finding->speedResponseReceived = true;
+    if (finding->speedPending)
     {
-      finding->speedResponseReceived = true;
-      uint8_t divider = 71; // 14 steps
-      uint8_t stepConfig = (finding->data[0] & 0x03);
-      if (stepConfig == static_cast<uint8_t>(StepConfig::Step128))
-      {
-        divider = 8;
-      }
-      else if (stepConfig == static_cast<uint8_t>(StepConfig::Step28))
-      {
-        divider = 35;
-      }
-      if (m_debug)
-      {
-        Serial.print(F("Id:"));
-        Serial.print(finding->adrZ21);
-        Serial.print(F(" onLS:"));
-        Serial.println(speed);
-      }
-
-      uint8_t locoSpeed = static_cast<uint8_t>(speed / divider);
-      uint8_t locoSpeedDcc = 0;
-      calcSpeedTrainboxToZ21(locoSpeed, stepConfig, locoSpeedDcc);
-      finding->data[1] = locoSpeedDcc | (finding->data[1] & 0x80);
-      notifyLocoState(0, finding->adrZ21, finding->data);
+      // trainbox is ready for the speed that came in meanwhile
+      sendPendingLocoSpeed(*finding, millis());
     }
+    if (m_debug)
+    {
+      Serial.print(F("Id:"));
+      Serial.print(finding->adrZ21);
+      Serial.print(F(" onLS:"));
+      Serial.println(speed);
+    }
+
+    uint8_t locoSpeedDcc = 0;
+    calcSpeedTrainboxToZ21(speed, finding->data[0], locoSpeedDcc);
+    finding->data[1] = locoSpeedDcc | (finding->data[1] & 0x80);
+    notifyLocoState(0, *finding);
   }
   return true;
 }
@@ -677,13 +888,20 @@ bool z60::onLocoDir(uint32_t id, uint8_t dir)
   // Serial.print(" onLocoDir:");
   // Serial.println(dir);
 
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  auto range = m_locoIndexTrainbox.equal_range(id);
+  for (auto index = range.first; index != range.second; ++index)
   {
-    if (finding->adrTrainbox == id)
+    DataLoco *finding = &m_locos[index->second];
+    finding->data[1] = (finding->data[1] & 0x7F) + (2 == dir ? 0x00 : 0x80);
+    if ((1 == dir) || (2 == dir))
     {
-      finding->data[1] = (finding->data[1] & 0x7F) + (2 == dir ? 0x00 : 0x80);
-      // notifyLocoState(0, static_cast<uint16_t>(id), finding->second);
+      finding->direction = dir;
     }
+    else if (3 == dir)
+    {
+      finding->direction = 0;
+    }
+    // notifyLocoState(0, static_cast<uint16_t>(id), finding->second);
   }
   return true;
 }
@@ -700,40 +918,39 @@ bool z60::onLocoFunc(uint32_t id, uint8_t function, uint8_t value)
     Serial.println(value);
   }
 
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  auto range = m_locoIndexTrainbox.equal_range(id);
+  for (auto index = range.first; index != range.second; ++index)
   {
-    if (finding->adrTrainbox == id)
+    DataLoco *finding = &m_locos[index->second];
+    if (0 == function)
     {
-      if (0 == function)
-      {
-        bitWrite(finding->data[2], 4, 0 == value ? 0 : 1);
-      }
-      else if (function < 5)
-      {
-        bitWrite(finding->data[2], function - 1, 0 == value ? 0 : 1);
-      }
-      else if (function < 13)
-      {
-        bitWrite(finding->data[3], function - 5, 0 == value ? 0 : 1);
-      }
-      else if (function < 21)
-      {
-        bitWrite(finding->data[4], function - 13, 0 == value ? 0 : 1);
-      }
-      else if (function < 29)
-      {
-        bitWrite(finding->data[5], function - 21, 0 == value ? 0 : 1);
-      }
-      else if (function < 32)
-      {
-        bitWrite(finding->data[6], function - 29, 0 == value ? 0 : 1);
-      }
-      else
-      {
-        Serial.println(F("### ERROR: Function number to big"));
-      }
-      notifyLocoState(0, finding->adrZ21, finding->data);
+      bitWrite(finding->data[2], 4, 0 == value ? 0 : 1);
+    }
+    else if (function < 5)
+    {
+      bitWrite(finding->data[2], function - 1, 0 == value ? 0 : 1);
+    }
+    else if (function < 13)
+    {
+      bitWrite(finding->data[3], function - 5, 0 == value ? 0 : 1);
+    }
+    else if (function < 21)
+    {
+      bitWrite(finding->data[4], function - 13, 0 == value ? 0 : 1);
+    }
+    else if (function < 29)
+    {
+      bitWrite(finding->data[5], function - 21, 0 == value ? 0 : 1);
     }
+    else if (function < 32)
+    {
+      bitWrite(finding->data[6], function - 29, 0 == value ? 0 : 1);
+    }
+    else
+    {
+      Serial.println(F("### ERROR: Function number to big"));
+    }
+    notifyLocoState(0, *finding);
   }
   return true;
 }
@@ -804,34 +1021,13 @@ bool z60::onAccSwitch(uint32_t id, uint8_t position, uint8_t current)
     Serial.println(current);
   }
   uint8_t data[16];
-  if (static_cast<uint32_t>(AddrOffset::DCCAcc) <= id)
-  {
-    id -= static_cast<uint32_t>(AddrOffset::DCCAcc);
-    id += m_startAdressAccDCC;
-  }
-  else if (static_cast<uint32_t>(AddrOffset::MM2Acc) <= id)
-  {
-    id -= static_cast<uint32_t>(AddrOffset::MM2Acc);
-  }
+  id = fromTrainboxAccAdrToZ21Adr(id);
 
-  auto finding = m_turnouts.find(id);
-  if (finding == m_turnouts.end())
+  setTurnoutPosition(static_cast<uint16_t>(id), position ? 0x02 : 0x01);
+  if (m_debug)
   {
-    // delete all if buffer is to big
-    if (m_maxNumberOfTurnout < m_turnouts.size())
-    {
-      Serial.println(F("clear turnoutlist"));
-      m_turnouts.clear();
-    }
-    m_turnouts.insert({id, position ? 0x02 : 0x01});
-    Serial.print(F("Turnout not found:"));
     Serial.println(id);
   }
-  else
-  {
-    finding->second = position ? 0x02 : 0x01;
-  }
-  Serial.println(id);
   data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_GET_TURNOUT_INFO);
   data[1] = highByte(static_cast<uint16_t>(id));
   data[2] = lowByte(static_cast<uint16_t>(id));
@@ -840,6 +1036,18 @@ bool z60::onAccSwitch(uint32_t id, uint8_t position, uint8_t current)
   return true;
 }
 
+bool z60::onAccSwitch(uint32_t id, uint8_t position, uint8_t current, uint16_t switchTimeIN10ms)
+{
+  // remember switch times differing from the default, e.g. set for an article on a MS2,
+  // answers to our own commands carry the time we sent and change nothing
+  if (0 != current)
+  {
+    uint16_t adrZ21 = fromTrainboxAccAdrToZ21Adr(id);
+    setTurnoutSwitchTime(adrZ21, (m_defaultSwitchTimeIN10ms == switchTimeIN10ms) ? 0 : switchTimeIN10ms);
+  }
+  return onAccSwitch(id, position, current);
+}
+
 bool z60::onPing(uint16_t hash, uint32_t id, uint16_t swVersion, uint16_t hwIdent)
 {
   Serial.println("Ping received");
@@ -945,30 +1153,28 @@ bool z60::onConfigDataSteamError(uint16_t hash)
   return false;
 }
 
-void z60::notifyLocoState(uint8_t client, uint16_t Adr, std::array<uint8_t, 7> &locoData)
+void z60::notifyLocoState(uint8_t client, DataLoco &loco)
 {
-
-  uint8_t data[10];
-  data[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_LOCO_INFO); // 0xEF X-HEADER
-  data[1] = (Adr >> 8) & 0x3F;
-  data[2] = Adr & 0xFF;
+  // the cached LAN_X_LOCO_INFO only touches the bytes that changed, XOR is kept up to date by the frame
+  z21Frame::LocoInfo &info = loco.locoInfo;
+  info.setAddress(loco.adrZ21);
   // Fahrstufeninformation: 0=14, 2=28, 4=128
-  if ((locoData[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step14))
-    data[3] = 1; // 14 steps
-  if ((locoData[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step28))
-    data[3] = 2; // 28 steps
-  if ((locoData[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step128))
-    data[3] = 4; // 128 steps
-  // data[3] = data[3] | 0x08; //BUSY!
+  uint8_t steps = 0;
+  if ((loco.data[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step14))
+    steps = 1; // 14 steps
+  if ((loco.data[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step28))
+    steps = 2; // 28 steps
+  if ((loco.data[0] & 0x03) == static_cast<uint8_t>(StepConfig::Step128))
+    steps = 4; // 128 steps
+  info.set(z21Frame::LocoInfo::Steps, steps);
 
-  data[4] = (char)locoData[1]; // DSSS SSSS
-  data[5] = (char)locoData[2]; // F0, F4, F3, F2, F1
-  data[6] = (char)locoData[3]; // F5 - F12; Funktion F5 ist bit0 (LSB)
-  data[7] = (char)locoData[4]; // F13-F20
-  data[8] = (char)locoData[5]; // F21-F28
-  data[9] = (char)locoData[6]; // F29-F31
+  info.set(z21Frame::LocoInfo::Speed, loco.data[1]); // DSSS SSSS
+  for (uint8_t group = 0; group < 5; group++)
+  {
+    info.setFunctions(group, loco.data[group + 2]); // F0-F4, F5-F12, F13-F20, F21-F28, F29-F31
+  }
 
-  EthSend(0, 15, z21Interface::Header::LAN_X_HEADER, data, true, (static_cast<uint16_t>(BcFlagShort::Z21bcAll) | static_cast<uint16_t>(BcFlagShort::Z21bcNetAll)));
+  EthSendFrame(client, info.data(), (static_cast<uint16_t>(BcFlagShort::Z21bcAll) | static_cast<uint16_t>(BcFlagShort::Z21bcNetAll)));
 }
 
 // Z21
@@ -980,34 +1186,80 @@ void z60::addToLocoList(uint16_t adrZ21, uint8_t mode, uint8_t steps)
     if (adrZ21 > m_startAdressDcc128) // DCC 128 steps
     {
       // mode = 0 = DCC
-      m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
+      insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
     }
     else if (adrZ21 > m_startAdressDcc28) // DCC 28 steps
     {
       // mode = 0 = DCC
-      m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step28), 0, 0, 0, 0, 0}});
+      insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step28), 0, 0, 0, 0, 0}});
     }
     else if (adrZ21 > m_startAdressMfx) // MFX (handled like 128 steps DCC)
     {
       // mode = 0 = DCC
-      m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
+      insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
     }
     else if (adrZ21 > m_startAdressMoto) // Motorola
     {
       // mode = 1 = Motorola
-      m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Motorola)), static_cast<uint8_t>(AdrMode::Motorola), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
+      insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Motorola)), static_cast<uint8_t>(AdrMode::Motorola), true, 0, true, {static_cast<uint8_t>(StepConfig::Step128), 0, 0, 0, 0, 0}});
     }
     else // DCC 14 steps
     {
       // mode = 0 = DCC
-      m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step14), 0, 0, 0, 0, 0}});
+      insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, static_cast<uint8_t>(AdrMode::Dcc)), static_cast<uint8_t>(AdrMode::Dcc), true, 0, true, {static_cast<uint8_t>(StepConfig::Step14), 0, 0, 0, 0, 0}});
     }
   }
   else
   {
     // adressing is based on z21 managment
-    m_locos.push_front(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, mode), mode, false, 0, true, {static_cast<uint8_t>(steps), 0, 0, 0, 0, 0}});
+    insertLoco(DataLoco{adrZ21, fromZ21AdrToTrainboxAdr(adrZ21, mode), mode, false, 0, true, {static_cast<uint8_t>(steps), 0, 0, 0, 0, 0}});
+  }
+}
+
+z60::DataLoco *z60::findLoco(uint16_t adrZ21)
+{
+  auto finding = m_locoIndexZ21.find(adrZ21);
+  if (finding == m_locoIndexZ21.end())
+  {
+    return nullptr;
+  }
+  return &m_locos[finding->second];
+}
+
+void z60::insertLoco(const DataLoco &loco)
+{
+  size_t slot = m_locos.size();
+  if (slot < m_maxNumberOfLoco)
+  {
+    m_locos.push_back(loco);
+    m_locoIndexTrainbox.emplace(loco.adrTrainbox, slot);
+  }
+  else
+  {
+    // overwrite oldest loco
+    slot = m_oldestLoco;
+    m_oldestLoco = (m_oldestLoco + 1) % m_maxNumberOfLoco;
+    m_locoIndexZ21.erase(m_locos[slot].adrZ21);
+    setLocoTrainboxAdr(m_locos[slot], loco.adrTrainbox);
+    m_locos[slot] = loco;
   }
+  m_locoIndexZ21[loco.adrZ21] = slot;
+}
+
+void z60::setLocoTrainboxAdr(DataLoco &loco, uint16_t adrTrainbox)
+{
+  size_t slot = static_cast<size_t>(&loco - m_locos.data());
+  auto range = m_locoIndexTrainbox.equal_range(loco.adrTrainbox);
+  for (auto index = range.first; index != range.second; ++index)
+  {
+    if (index->second == slot)
+    {
+      m_locoIndexTrainbox.erase(index);
+      break;
+    }
+  }
+  loco.adrTrainbox = adrTrainbox;
+  m_locoIndexTrainbox.emplace(adrTrainbox, slot);
 }
 
 uint16_t z60::fromZ21AdrToTrainboxAdr(uint16_t adr, uint8_t mode)
@@ -1050,13 +1302,11 @@ uint16_t z60::fromZ21AdrToTrainboxAdr(uint16_t adr, uint8_t mode)
 void z60::handleGetLocoMode(uint16_t adr, uint8_t &mode)
 {
   mode = 0;
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  DataLoco *finding = findLoco(adr);
+  if (nullptr != finding)
   {
-    if (finding->adrZ21 == adr)
-    {
-      mode = finding->mode;
-      return;
-    }
+    mode = finding->mode;
+    return;
   }
   if (m_debug)
   {
@@ -1067,30 +1317,25 @@ void z60::handleGetLocoMode(uint16_t adr, uint8_t &mode)
 
 void z60::handleSetLocoMode(uint16_t adr, uint8_t mode)
 {
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  DataLoco *finding = findLoco(adr);
+  if (nullptr != finding)
   {
-    if (finding->adrZ21 == adr)
+    if (finding->mode != mode)
     {
-      if (finding->mode != mode)
-      {
-        finding->mode = mode;
-        finding->adrTrainbox = fromZ21AdrToTrainboxAdr(adr, mode);
-        // Write to flash
-        saveLocoConfig();
-        // speed is send again in next cycle
-        finding->isActive = false;
-      }
-      return;
+      finding->mode = mode;
+      setLocoTrainboxAdr(*finding, fromZ21AdrToTrainboxAdr(adr, mode));
+      finding->direction = 0;
+      // Write to flash
+      saveLocoConfig();
+      // speed is send again in next cycle
+      finding->isActive = false;
     }
+    return;
   }
   if (m_debug)
   {
     Serial.printf("handleSetLocoMode: %d, %d\n", adr, mode);
   }
-  if (m_locos.size() >= m_maxNumberOfLoco)
-  {
-    m_locos.pop_back();
-  }
   addToLocoList(adr, mode, static_cast<uint8_t>(StepConfig::Step128));
   saveLocoConfig();
 }
@@ -1145,31 +1390,25 @@ void z60::notifyz21InterfaceS88Data(uint8_t gIndex)
 
 void z60::notifyz21InterfaceLocoState(uint16_t Adr, uint8_t data[])
 {
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  DataLoco *finding = findLoco(Adr);
+  if (nullptr != finding)
   {
-    if (finding->adrZ21 == Adr)
+    uint8_t index = 0;
+    for (auto i : finding->data)
     {
-      uint8_t index = 0;
-      for (auto i : finding->data)
-      {
-        data[index++] = i;
-      }
-      // if (finding->data[0] == static_cast<uint8_t>(StepConfig::Step128))
-      // {
-      //   data[0] = 4;
-      // }
-      return;
+      data[index++] = i;
     }
+    // if (finding->data[0] == static_cast<uint8_t>(StepConfig::Step128))
+    // {
+    //   data[0] = 4;
+    // }
+    return;
   }
   if (m_debug)
   {
     Serial.print("notifyz21InterfaceLocoState:");
     Serial.println(Adr);
   }
-  if (m_locos.size() >= m_maxNumberOfLoco)
-  {
-    m_locos.pop_back();
-  }
   addToLocoList(Adr, static_cast<uint8_t>(AdrMode::Motorola), static_cast<uint8_t>(StepConfig::Step128));
   saveLocoConfig();
   data[0] = static_cast<uint8_t>(StepConfig::Step128);
@@ -1179,17 +1418,11 @@ void z60::notifyz21InterfaceLocoState(uint16_t Adr, uint8_t data[])
 
 void z60::notifyz21InterfaceLocoFkt(uint16_t Adr, uint8_t type, uint8_t fkt)
 {
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  DataLoco *finding = findLoco(Adr);
+  if (nullptr != finding)
   {
-    if (finding->adrZ21 == Adr)
-    {
-      setLocoFunc(finding->adrTrainbox, fkt, type);
-      return;
-    }
-  }
-  if (m_locos.size() >= m_maxNumberOfLoco)
-  {
-    m_locos.pop_back();
+    setLocoFunc(finding->adrTrainbox, fkt, type);
+    return;
   }
   if (m_debug)
   {
@@ -1203,118 +1436,161 @@ void z60::notifyz21InterfaceLocoFkt(uint16_t Adr, uint8_t type, uint8_t fkt)
 //--------------------------------------------------------------------------------------------
 void z60::notifyz21InterfaceLocoSpeed(uint16_t Adr, uint8_t speed, uint8_t stepConfig)
 {
-  for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+  DataLoco *finding = findLoco(Adr);
+  if (nullptr != finding)
   {
-    if (finding->adrZ21 == Adr)
-    {
-      // adapt adress for trainbox
-      uint32_t id = finding->adrTrainbox;
+    // adapt adress for trainbox
+    uint32_t id = finding->adrTrainbox;
 
-      if (finding->data[0] != stepConfig)
-      {
-        finding->data[0] = stepConfig;
-        // safe config to flash
-        saveLocoConfig();
-        finding->isActive = true;
-      }
-      if (!finding->isActive)
+    if (finding->data[0] != stepConfig)
+    {
+      finding->data[0] = stepConfig;
+      // safe config to flash
+      saveLocoConfig();
+      finding->isActive = true;
+    }
+    if (!finding->isActive)
+    {
+      // set data protocol
+      if (0 == finding->mode) // DCC
       {
-        // set data protocol
-        if (0 == finding->mode) // DCC
+        switch (stepConfig)
         {
-          switch (stepConfig)
+        case static_cast<uint8_t>(StepConfig::Step14):
+          sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_14);
+          break;
+        case static_cast<uint8_t>(StepConfig::Step28):
+          if (m_longDccAddressStart > (Adr & 0x0FFF))
           {
-          case static_cast<uint8_t>(StepConfig::Step14):
-            sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_14);
-            break;
-          case static_cast<uint8_t>(StepConfig::Step28):
-            if (m_longDccAddressStart > (Adr & 0x0FFF))
-            {
-              sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_28);
-            }
-            else
-            {
-              sendLocoDataProtocol(id, ProtocolLoco::DCC_LONG_28);
-            }
-            break;
-          case static_cast<uint8_t>(StepConfig::Step128):
-            if (m_longDccAddressStart > (Adr & 0x0FFF))
-            {
-              sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_128);
-            }
-            else
-            {
-              sendLocoDataProtocol(id, ProtocolLoco::DCC_LONG_128);
-            }
-            break;
-          default:
             sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_28);
-            break;
           }
-        }
-        finding->isActive = true;
-      }
-
-      uint8_t locoSpeedAdapted = 0;
-      if (calcSpeedZ21toTrainbox(speed & 0x7F, stepConfig, locoSpeedAdapted))
-      {
-        // emergency break
-        if (m_debug)
-        {
-          Serial.print("Emergency Break:");
-          Serial.println(id);
-        }
-        sendLocoStop(id);
-      }
-      else
-      {
-        unsigned long currentTimeINms = millis();
-        // we are sending speed in case that we already received an answer for the last command or the time is up
-        if (((finding->lastSpeedCmdTimeINms + minimumCmdIntervalINms) < currentTimeINms) || (finding->speedResponseReceived))
-        {
-          finding->lastSpeedCmdTimeINms = currentTimeINms;
-          uint8_t steps = 1;
-          if (static_cast<uint8_t>(StepConfig::Step14) == stepConfig)
+          else
           {
-            steps = 14;
+            sendLocoDataProtocol(id, ProtocolLoco::DCC_LONG_28);
           }
-          else if (static_cast<uint8_t>(StepConfig::Step28) == stepConfig)
+          break;
+        case static_cast<uint8_t>(StepConfig::Step128):
+          if (m_longDccAddressStart > (Adr & 0x0FFF))
           {
-            steps = 28;
+            sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_128);
           }
           else
           {
-            steps = 128;
+            sendLocoDataProtocol(id, ProtocolLoco::DCC_LONG_128);
           }
-          uint16_t locoSpeedTrainBox = static_cast<uint16_t>(static_cast<uint32_t>(locoSpeedAdapted) * 1000 / static_cast<uint32_t>(steps));
-          if (m_debug)
-          {
-            Serial.print(F("SetV:"));
-            Serial.print(locoSpeedTrainBox);
-            Serial.print(F(" D:"));
-            Serial.println(speed & 0x80 ? 1 : 2);
-          }
-          setLocoDir(id, speed & 0x80 ? 1 : 2);
-          setLocoSpeed(id, locoSpeedTrainBox);
-          finding->speedResponseReceived = false;
+          break;
+        default:
+          sendLocoDataProtocol(id, ProtocolLoco::DCC_SHORT_28);
+          break;
         }
       }
-      return;
+      finding->isActive = true;
     }
+
+    uint16_t locoSpeedTrainBox = 0;
+    if (calcSpeedZ21toTrainbox(speed, stepConfig, locoSpeedTrainBox))
+    {
+      // emergency break
+      if (m_debug)
+      {
+        Serial.print("Emergency Break:");
+        Serial.println(id);
+      }
+      // emergency break is never delayed and drops a speed still waiting
+      finding->speedPending = false;
+      sendLocoStop(id);
+    }
+    else
+    {
+      // only the latest speed is kept, a value still waiting is replaced
+      finding->pendingSpeed = speed;
+      finding->pendingStepConfig = stepConfig;
+      finding->speedPending = true;
+      unsigned long currentTimeINms = millis();
+      unsigned long deadlineINms = finding->lastSpeedCmdTimeINms + minimumCmdIntervalINms;
+      // we are sending speed in case that we already received an answer for the last command or the time is up
+      if ((static_cast<long>(currentTimeINms - deadlineINms) > 0) || (finding->speedResponseReceived))
+      {
+        sendPendingLocoSpeed(*finding, currentTimeINms);
+      }
+      else if (!finding->speedScheduled)
+      {
+        // sent by cyclic as soon as the interval is over
+        finding->speedScheduled = true;
+        m_speedSchedule.push(SpeedDeadline{deadlineINms + 1, static_cast<size_t>(finding - m_locos.data()), finding->adrZ21});
+      }
+    }
+    return;
   }
   if (m_debug)
   {
     Serial.print(F("Loco not found:"));
     Serial.println(Adr);
   }
-  if (m_locos.size() >= m_maxNumberOfLoco)
-  {
-    m_locos.pop_back();
-  }
   addToLocoList(Adr, static_cast<uint8_t>(AdrMode::Motorola), stepConfig);
   saveLocoConfig();
 }
 
+void z60::sendPendingLocoSpeed(DataLoco &loco, unsigned long currentTimeINms)
+{
+  loco.speedPending = false;
+  loco.lastSpeedCmdTimeINms = currentTimeINms;
+  uint16_t locoSpeedTrainBox = 0;
+  calcSpeedZ21toTrainbox(loco.pendingSpeed, loco.pendingStepConfig, locoSpeedTrainBox);
+  uint8_t direction = loco.pendingSpeed & 0x80 ? 1 : 2;
+  if (m_debug)
+  {
+    Serial.print(F("SetV:"));
+    Serial.print(locoSpeedTrainBox);
+    Serial.print(F(" D:"));
+    Serial.println(direction);
+  }
+  // direction is only sent if it changed, since a direction command also stops the loco
+  if (loco.direction != direction)
+  {
+    setLocoDir(loco.adrTrainbox, direction);
+    loco.direction = direction;
+  }
+  setLocoSpeed(loco.adrTrainbox, locoSpeedTrainBox);
+  loco.speedResponseReceived = false;
+}
+
+void z60::sendScheduledLocoSpeeds(unsigned long currentTimeINms)
+{
+  while (!m_speedSchedule.empty() && (static_cast<long>(currentTimeINms - m_speedSchedule.top().timeINms) >= 0))
+  {
+    SpeedDeadline deadline = m_speedSchedule.top();
+    m_speedSchedule.pop();
+    // slot may have been reused for another loco in the meantime
+    if (deadline.slot < m_locos.size())
+    {
+      DataLoco &loco = m_locos[deadline.slot];
+      if (loco.adrZ21 == deadline.adrZ21)
+      {
+        // a speed sent early after an answer of the trainbox leaves an entry behind whose deadline is too early now
+        unsigned long earliestINms = loco.lastSpeedCmdTimeINms + minimumCmdIntervalINms;
+        if (static_cast<long>(deadline.timeINms - earliestINms) <= 0)
+        {
+          if (loco.speedPending)
+          {
+            m_speedSchedule.push(SpeedDeadline{earliestINms + 1, deadline.slot, deadline.adrZ21});
+          }
+          else
+          {
+            loco.speedScheduled = false;
+          }
+          continue;
+        }
+        loco.speedScheduled = false;
+        if (loco.speedPending)
+        {
+          sendPendingLocoSpeed(loco, currentTimeINms);
+        }
+      }
+    }
+  }
+}
+
 //--------------------------------------------------------------------------------------------
 void z60::notifyz21InterfaceAccessory(uint16_t Adr, bool state, bool active)
 {
@@ -1327,31 +1603,44 @@ void z60::notifyz21InterfaceAccessory(uint16_t Adr, bool state, bool active)
     Serial.print(" active:");
     Serial.println(active);
   }
-  auto finding = m_turnouts.find(Adr);
-  if (finding == m_turnouts.end())
+  setTurnoutPosition(Adr, state ? 0x02 : 0x01);
+
+  if (!active)
   {
-    // delete all if buffer is to big
-    if (m_maxNumberOfTurnout < m_turnouts.size())
-    {
-      if (m_debug)
-      {
-        Serial.println(F("clear turnoutlist"));
-      }
-      m_turnouts.clear();
-    }
-    m_turnouts.insert({Adr, state ? 0x02 : 0x01});
-    if (m_debug)
+    // coil is switched off by trainbox after the switch time
+    return;
+  }
+
+  // a newer command for a turnout still waiting replaces the old one
+  for (auto &pending : m_accessoryQueue)
+  {
+    if (pending.adrZ21 == Adr)
     {
-      Serial.print(F("Turnout not found:"));
-      Serial.println(Adr);
+      pending.position = state ? 0x01 : 0x00;
+      return;
     }
   }
+  m_accessoryQueue.push_back(PendingAccessory{Adr, static_cast<uint8_t>(state ? 0x01 : 0x00)});
+  handleAccessoryQueue(millis());
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::setTurnoutSwitchTime(uint16_t adrZ21, uint16_t switchTimeIN10ms)
+{
+  if (0 == switchTimeIN10ms)
+  {
+    m_turnoutSwitchTimes.erase(adrZ21);
+  }
   else
   {
-    finding->second = state ? 0x02 : 0x01;
+    m_turnoutSwitchTimes[adrZ21] = switchTimeIN10ms;
   }
+}
 
-  uint32_t adrTurnOut = static_cast<uint32_t>(Adr);
+//--------------------------------------------------------------------------------------------
+uint32_t z60::fromZ21AdrToTrainboxAccAdr(uint16_t adr)
+{
+  uint32_t adrTurnOut = static_cast<uint32_t>(adr);
 
   // if (adrTurnOut < 256)
   // {
@@ -1370,15 +1659,169 @@ void z60::notifyz21InterfaceAccessory(uint16_t Adr, bool state, bool active)
   {
     adrTurnOut += static_cast<uint32_t>(AddrOffset::MM2Acc);
   }
-  Serial.println(adrTurnOut);
-  setAccSwitch(adrTurnOut, state ? 0x01 : 0x00, active ? 0x00 : 0x01, 0); // only execute command, no deactivation
+  return adrTurnOut;
+}
+
+//--------------------------------------------------------------------------------------------
+uint16_t z60::fromTrainboxAccAdrToZ21Adr(uint32_t adrTurnOut)
+{
+  if (static_cast<uint32_t>(AddrOffset::DCCAcc) <= adrTurnOut)
+  {
+    adrTurnOut -= static_cast<uint32_t>(AddrOffset::DCCAcc);
+    adrTurnOut += m_startAdressAccDCC;
+  }
+  else if (static_cast<uint32_t>(AddrOffset::MM2Acc) <= adrTurnOut)
+  {
+    adrTurnOut -= static_cast<uint32_t>(AddrOffset::MM2Acc);
+  }
+  return static_cast<uint16_t>(adrTurnOut);
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::handleAccessoryQueue(unsigned long currentTimeINms)
+{
+  // release coils whose switch time is over
+  for (auto coil = m_activeCoils.begin(); coil != m_activeCoils.end();)
+  {
+    if (static_cast<long>(currentTimeINms - coil->releaseTimeINms) >= 0)
+    {
+      coil = m_activeCoils.erase(coil);
+    }
+    else
+    {
+      ++coil;
+    }
+  }
+
+  for (auto entry = m_accessoryQueue.begin(); (entry != m_accessoryQueue.end()) && (m_activeCoils.size() < m_maxActiveCoils);)
+  {
+    const PendingAccessory &pending = *entry;
+    // both coils of one turnout are never powered at the same time, the turnout waits while the others go ahead
+    auto active = std::find_if(m_activeCoils.begin(), m_activeCoils.end(), [&pending](const ActiveCoil &coil)
+                               { return coil.adrZ21 == pending.adrZ21; });
+    if (active != m_activeCoils.end())
+    {
+      ++entry;
+      continue;
+    }
+    uint16_t switchTimeIN10ms = m_defaultSwitchTimeIN10ms;
+    auto switchTime = m_turnoutSwitchTimes.find(pending.adrZ21);
+    if (switchTime != m_turnoutSwitchTimes.end())
+    {
+      switchTimeIN10ms = switchTime->second;
+    }
+    uint32_t adrTurnOut = fromZ21AdrToTrainboxAccAdr(pending.adrZ21);
+    if (m_debug)
+    {
+      Serial.print(F("AccSwitch:"));
+      Serial.print(adrTurnOut);
+      Serial.print(F(" time:"));
+      Serial.println(switchTimeIN10ms);
+    }
+    setAccSwitch(adrTurnOut, pending.position, 0x01, switchTimeIN10ms);
+    m_activeCoils.push_back(ActiveCoil{pending.adrZ21, currentTimeINms + static_cast<unsigned long>(switchTimeIN10ms) * 10 + m_coilReleaseMarginINms});
+    entry = m_accessoryQueue.erase(entry);
+  }
 }
 
 //--------------------------------------------------------------------------------------------
 void z60::notifyz21InterfaceAccessoryInfo(uint16_t Adr, uint8_t &position)
 {
-  auto finding = m_turnouts.find(Adr);
-  position = finding != m_turnouts.end() ? finding->second : 0;
+  position = m_turnouts.get(Adr);
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::notifyz21InterfaceBroadcastFlags(uint8_t client, uint16_t bcFlag)
+{
+  // a new client gets all known turnout positions at once instead of asking for every turnout
+  if (0 != (bcFlag & (static_cast<uint16_t>(BcFlagShort::Z21bcAll) | static_cast<uint16_t>(BcFlagShort::Z21bcNetAll))))
+  {
+    sendTurnoutSnapshot(client);
+  }
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::setTurnoutPosition(uint16_t adr, uint8_t position)
+{
+  if (m_turnouts.get(adr) == position)
+  {
+    return;
+  }
+  if (!m_turnouts.set(adr, position))
+  {
+    if (m_debug)
+    {
+      Serial.print(F("Turnout out of range:"));
+      Serial.println(adr);
+    }
+    return;
+  }
+  if (m_turnoutPersistence)
+  {
+    unsigned long currentTimeINms = millis();
+    if (!m_turnoutsDirty)
+    {
+      m_turnoutsDirty = true;
+      m_turnoutsDirtyTimeINms = currentTimeINms;
+    }
+    m_turnoutsChangedTimeINms = currentTimeINms;
+  }
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::sendTurnoutSnapshot(uint8_t client)
+{
+  uint8_t *data = m_turnoutSnapshot;
+  uint16_t length = 0;
+  m_turnouts.forEach([this, client, data, &length](size_t adr, uint8_t position)
+                     {
+                       uint8_t info[4];
+                       info[0] = static_cast<uint8_t>(z21Interface::XHeader::LAN_X_GET_TURNOUT_INFO);
+                       info[1] = highByte(static_cast<uint16_t>(adr));
+                       info[2] = lowByte(static_cast<uint16_t>(adr));
+                       info[3] = position;
+                       EthBuild(&data[length], 0x09, z21Interface::Header::LAN_X_HEADER, info, true);
+                       length += 0x09;
+                       if ((length + 0x09) > m_turnoutSnapshotLength)
+                       {
+                         notifyz21InterfaceEthSend(client, data, length);
+                         length = 0;
+                       }
+                     });
+  if (0 != length)
+  {
+    notifyz21InterfaceEthSend(client, data, length);
+  }
+}
+
+//--------------------------------------------------------------------------------------------
+void z60::flushTurnouts()
+{
+  if (!m_turnoutsDirty)
+  {
+    return;
+  }
+  if (!m_preferences.begin(m_namespaceZ21, false))
+  {
+    Serial.println(F("Access preferences failed"));
+  }
+  else
+  {
+    if (m_preferences.putBytes(m_keyTurnouts, m_turnouts.data(), m_turnouts.byteSize()) != m_turnouts.byteSize())
+    {
+      Serial.println(F(" Failed to write turnouts"));
+    }
+    else
+    {
+      m_turnoutsDirty = false;
+    }
+    m_preferences.end();
+  }
+  // positions stay dirty after a failed write and are written again after the save delay
+  if (m_turnoutsDirty)
+  {
+    m_turnoutsDirtyTimeINms = m_turnoutsChangedTimeINms = millis();
+  }
 }
 
 //--------------------------------------------------------------------------------------------
@@ -1428,7 +1871,7 @@ void z60::notifyz21InterfaceCVWRITE(uint8_t cvAdrMSB, uint8_t cvAdrLSB, uint8_t
     m_directProgramming = true;
     // Directprogramming
     // sendWriteConfig(static_cast<uint32_t>(AddrOffset::MM2) + 80, cvAdr, value, true, false);//MM
-    sendWriteConfig(static_cast<uint32_t>(AddrOffset::DCC) + 1, cvAdr, value, true, false); // DCC
+    sendWriteConfig(static_cast<uint32_t>(AddrOffset::DCC) + 1, cvAdr, value, true, false, nackOnTimeout()); // DCC
   }
   else
   {
@@ -1446,7 +1889,7 @@ void z60::notifyz21InterfaceMMWRITE(uint8_t regAdr, uint8_t value)
   if (m_programmingActiv)
   {
     m_directProgramming = true;
-    sendWriteConfig(80, static_cast<uint8_t>(regAdr) + 1, value, true, false);
+    sendWriteConfig(80, static_cast<uint8_t>(regAdr) + 1, value, true, false, nackOnTimeout());
   }
   else
   {
@@ -1464,7 +1907,7 @@ void z60::notifyz21InterfaceDCCWRITE(uint8_t regAdr, uint8_t value)
   if (m_programmingActiv)
   {
     m_directProgramming = true;
-    sendWriteConfig(0xC001, static_cast<uint8_t>(regAdr) + 1, value, true, false);
+    sendWriteConfig(0xC001, static_cast<uint8_t>(regAdr) + 1, value, true, false, nackOnTimeout());
   }
   else
   {
@@ -1492,13 +1935,11 @@ void z60::notifyz21InterfaceCVPOMWRITEBYTE(uint16_t Adr, uint16_t cvAdr, uint8_t
   if (m_programmingActiv)
   {
     m_directProgramming = false;
-    for (auto finding = m_locos.begin(); finding != m_locos.end(); ++finding)
+    DataLoco *finding = findLoco(Adr);
+    if (nullptr != finding)
     {
-      if (finding->adrZ21 == Adr)
-      {
-        sendWriteConfig(finding->adrTrainbox, cvAdr + 1, value, false, true);
-        return;
-      }
+      sendWriteConfig(finding->adrTrainbox, cvAdr + 1, value, false, true, nackOnTimeout());
+      return;
     }
     setCVNack();
   }
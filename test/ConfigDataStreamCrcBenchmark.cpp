@@ -0,0 +1,89 @@
+/*********************************************************************
+ * Config data stream CRC benchmark
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// receives a large lokomotive.cs2 as config data stream, the crc is updated with every frame.
+// The crc with the tables alone and bit by bit over the same data are printed for comparison
+
+#include "TestHelper.h"
+#include <chrono>
+#include <cstdio>
+
+class TestConfigDataStream : public MaerklinConfigDataStream
+{
+public:
+    using MaerklinConfigDataStream::MaerklinConfigDataStream;
+    using MaerklinConfigDataStream::calculateCRC;
+
+    size_t m_received{0};
+    size_t m_failed{0};
+
+protected:
+    void m_reportResultFunc(std::string *data, uint16_t hash, bool success, bool requested) override
+    {
+        (success && (nullptr != data)) ? m_received++ : m_failed++;
+    }
+};
+
+int main()
+{
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList;
+    TestConfigDataStream receiver(canInterface, stationList);
+
+    std::string lokomotiveCs2 = makeLokomotiveCs2(500, 32);
+    ConfigDataStreamFrames stream = makeConfigDataStream(lokomotiveCs2);
+
+    const size_t repeats{20};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        sendConfigDataStream(receiver, 0x4321, stream);
+    }
+    double streamSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if ((repeats != receiver.m_received) || (0 != receiver.m_failed))
+    {
+        printf("FAIL %zu of %zu streams received\n", receiver.m_received, repeats);
+        return 1;
+    }
+
+    // sum keeps the calculations from being optimized away
+    uint32_t crcSum = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        crcSum += TestConfigDataStream::calculateCRC(lokomotiveCs2);
+    }
+    double tableSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        crcSum -= calculateReferenceCRC(lokomotiveCs2);
+    }
+    double referenceSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (0 != crcSum)
+    {
+        printf("FAIL crc differs from reference\n");
+        return 1;
+    }
+
+    double megabytes = static_cast<double>(lokomotiveCs2.size()) * repeats / 1e6;
+    printf("lokomotive.cs2 with 500 locos, %zu bytes\n", lokomotiveCs2.size());
+    printf("stream receive with crc: %.1f MB/s\n", megabytes / streamSeconds);
+    printf("crc with tables: %.1f MB/s\n", megabytes / tableSeconds);
+    printf("crc bit by bit: %.1f MB/s\n", megabytes / referenceSeconds);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*********************************************************************
+ * CS2 document test
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// every .cs2 file given as argument has to be written again byte for byte after it was parsed.
+// Edits of a document are checked against the expected text
+
+#include "TestHelper.h"
+#include "Cs2Document.h"
+#include <cstdio>
+
+static bool testRoundTrip(const std::string &name, const std::string &content)
+{
+    Cs2Document document(256);
+    if (!document.parse(content))
+    {
+        printf("FAIL %s: not parsed\n", name.c_str());
+        return false;
+    }
+    if ((document.toString() != content) || (document.getSerializedLength() != content.size()))
+    {
+        printf("FAIL %s: written text differs\n%s\n", name.c_str(), document.toString().c_str());
+        return false;
+    }
+    // serializer hands out parts of at most serializeBufferSize bytes
+    std::string parts;
+    bool partsValid = true;
+    document.serialize([&](const char *data, size_t length)
+                       {
+                           partsValid = partsValid && (length > 0) && (length <= Cs2Document::serializeBufferSize);
+                           parts.append(data, length); });
+    if (!partsValid || (parts != content))
+    {
+        printf("FAIL %s: serialized parts differ\n", name.c_str());
+        return false;
+    }
+    printf("ok %s\n", name.c_str());
+    return true;
+}
+
+static bool testEdit()
+{
+    Cs2Document document;
+    document.parse("[lokomotive]\n"
+                   "lokomotive\n .name=BR 86\n .adresse=0x5\n .funktionen\n ..nr=0\n ..typ=1\n .funktionen\n ..nr=1\n ..typ=2\n"
+                   "lokomotive\n .name=V 100\n");
+    Cs2Document::Node *root = document.getRoot();
+    Cs2Document::Node *br86 = Cs2Document::findChild(root, "lokomotive");
+    Cs2Document::Node *v100 = Cs2Document::findChild(root, "lokomotive", br86);
+    if ((nullptr == br86) || (nullptr == v100) || (nullptr != Cs2Document::findChild(root, "lokomotive", v100)))
+    {
+        printf("FAIL edit: locos not found\n");
+        return false;
+    }
+    document.setValue(Cs2Document::findChild(v100, "name"), std::string("V 100 003"));
+    document.addChild(v100, "adresse", "0x48");
+    Cs2Document::Node *function = document.addChild(v100, "funktionen");
+    document.addChild(function, "nr", "0");
+    Cs2Document::Node *firstFunction = Cs2Document::findChild(br86, "funktionen");
+    if (!Cs2Document::removeChild(br86, firstFunction) || Cs2Document::removeChild(br86, firstFunction))
+    {
+        printf("FAIL edit: function not removed once\n");
+        return false;
+    }
+    // last child is removed, following additions go behind the one before
+    Cs2Document::Node *secondFunction = Cs2Document::findChild(br86, "funktionen");
+    Cs2Document::removeChild(br86, secondFunction);
+    document.addChild(br86, "vmax", "60");
+
+    std::string expected{"[lokomotive]\n"
+                         "lokomotive\n .name=BR 86\n .adresse=0x5\n .vmax=60\n"
+                         "lokomotive\n .name=V 100 003\n .adresse=0x48\n .funktionen\n ..nr=0\n"};
+    if ((document.toString() != expected) || (document.getSerializedLength() != expected.size()))
+    {
+        printf("FAIL edit:\n%s\n", document.toString().c_str());
+        return false;
+    }
+    printf("ok edit\n");
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string content;
+        if (!readFile(argv[i], content))
+        {
+            printf("FAIL %s: file not found\n", argv[i]);
+            failed++;
+            continue;
+        }
+        failed += testRoundTrip(argv[i], content) ? 0 : 1;
+    }
+    failed += testRoundTrip("lokomotive.cs2 with 50 locos", makeLokomotiveCs2(50, 32)) ? 0 : 1;
+    failed += testEdit() ? 0 : 1;
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/*********************************************************************
+ * CS2 loco parser benchmark
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// indexes a lokomotive.cs2 with 500 locos of 32 functions each and parses every loco of it
+
+#include "TestHelper.h"
+#include <chrono>
+#include <cstdio>
+
+int main()
+{
+    const size_t locoCount{500};
+    std::string lokomotiveCs2 = makeLokomotiveCs2(locoCount, 32);
+
+    const size_t repeats{20};
+    std::vector<Cs2DataParser::LocoRange> locos;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        Cs2DataParser::indexLocos(lokomotiveCs2.data(), lokomotiveCs2.size(), locos);
+    }
+    double indexSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+    if (locoCount != locos.size())
+    {
+        printf("FAIL %zu of %zu locos found\n", locos.size(), locoCount);
+        return 1;
+    }
+
+    // every loco is parsed on its own like a loco of the sync
+    std::vector<std::string> locoTexts;
+    for (const Cs2DataParser::LocoRange &loco : locos)
+    {
+        locoTexts.emplace_back(lokomotiveCs2, loco.offset, loco.length);
+    }
+    size_t functions = 0;
+    Cs2DataParser::LocoData locoData;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        for (std::string &locoText : locoTexts)
+        {
+            if (!Cs2DataParser::parseCs2ToLocoData(&locoText, locoData))
+            {
+                printf("FAIL loco not parsed\n");
+                return 1;
+            }
+            functions += locoData.functionData.size();
+        }
+    }
+    double parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / repeats;
+    if ((locoCount * 32 * repeats) != functions)
+    {
+        printf("FAIL %zu functions parsed\n", functions / repeats);
+        return 1;
+    }
+
+    printf("lokomotive.cs2 with %zu locos, %zu bytes\n", locoCount, lokomotiveCs2.size());
+    printf("indexLocos: %.2f ms\n", indexSeconds * 1e3);
+    printf("parseCs2ToLocoData of all locos: %.2f ms\n", parseSeconds * 1e3);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*********************************************************************
+ * Loco download test
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// downloads locos from a simulated Mobile Station 2 while other streams are on the bus
+
+#include "TestHelper.h"
+#include <cstdio>
+
+static const uint16_t ms2Hash{0x4321};
+static const uint16_t otherStationHash{0x9999};
+
+static std::vector<std::string> writtenLocos;
+static bool finished{false};
+static bool successful{false};
+
+static void writeLoco(std::string *data, bool changed)
+{
+    writtenLocos.push_back(*data);
+}
+
+static void result(bool success)
+{
+    finished = true;
+    successful = success;
+}
+
+// names of all lokinfo requests, a request is one frame "lokinfo" and two frames with the name
+static std::vector<std::string> getLocoInfoRequests(const TestCanInterface &canInterface)
+{
+    std::vector<std::string> names;
+    for (size_t frame = 0; (frame + 3) <= canInterface.m_configDataRequests.size(); frame++)
+    {
+        if (0 != memcmp(canInterface.m_configDataRequests[frame].data(), "lokinfo", 7))
+        {
+            continue;
+        }
+        std::string name;
+        for (size_t nameFrame = frame + 1; nameFrame < (frame + 3); nameFrame++)
+        {
+            for (uint8_t character : canInterface.m_configDataRequests[nameFrame])
+            {
+                if (0 != character)
+                {
+                    name += static_cast<char>(character);
+                }
+            }
+        }
+        names.push_back(name);
+        frame += 2;
+    }
+    return names;
+}
+
+static std::string makeLocoInfo(const std::string &name, const std::string &address = "0x1")
+{
+    return "[lokomotive]\nlok\n .name=" + name + "\n .adresse=" + address + "\n .typ=mm2_prg\n";
+}
+
+// a lokliste of another station must not be taken as answer to the own request
+static bool testStreamOfOtherStation()
+{
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList{MaerklinStationConfig{ms2Hash, 0, 0, 0}};
+    TestLocoManagment locoManagment(0, canInterface, stationList, 15000, 3);
+    writtenLocos.clear();
+    finished = false;
+    setMillis(0);
+
+    locoManagment.getLokomotiveConfig(writeLoco, result);
+    sendConfigDataStream(locoManagment, otherStationHash, "[lokliste]\nlok\n .name=Other\n");
+    sendConfigDataStream(locoManagment, ms2Hash, "[lokliste]\nlok\n .name=Own\n");
+    std::vector<std::string> requests = getLocoInfoRequests(canInterface);
+    if ((1 != requests.size()) || ("Own" != requests.front()))
+    {
+        printf("FAIL stream of other station: %zu lokinfo requests\n", requests.size());
+        return false;
+    }
+    sendConfigDataStream(locoManagment, ms2Hash, makeLocoInfo("Own"));
+    if (!finished || !successful || (2 != writtenLocos.size()) || (std::string::npos == writtenLocos[1].find(" .name=Own\n")))
+    {
+        printf("FAIL stream of other station: loco not written\n");
+        return false;
+    }
+    printf("ok stream of other station\n");
+    return true;
+}
+
+// the late answer to a reissued request takes the buffer of the next open request
+static bool testLateAnswerToReissuedRequest()
+{
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList{MaerklinStationConfig{ms2Hash, 0, 0, 0}};
+    const unsigned long timeoutINms{1000};
+    TestLocoManagment locoManagment(0, canInterface, stationList, timeoutINms, 3);
+    locoManagment.setLocoInfoWindow(2);
+    writtenLocos.clear();
+    finished = false;
+    setMillis(0);
+
+    locoManagment.getLokomotiveConfig(writeLoco, result);
+    sendConfigDataStream(locoManagment, ms2Hash, "[lokliste]\nlok\n .name=A\nlok\n .name=B\nlok\n .name=C\n");
+    setMillis(100);
+    sendConfigDataStream(locoManagment, ms2Hash, makeLocoInfo("A", "0xa"));
+    // B times out and is requested again behind C
+    setMillis(timeoutINms + 1);
+    locoManagment.cyclic();
+    std::vector<std::string> requests = getLocoInfoRequests(canInterface);
+    if ((4 != requests.size()) || ("C" != requests[2]) || ("B" != requests[3]))
+    {
+        printf("FAIL late answer: %zu lokinfo requests\n", requests.size());
+        return false;
+    }
+    sendConfigDataStream(locoManagment, ms2Hash, makeLocoInfo("B", "0xb"));
+    sendConfigDataStream(locoManagment, ms2Hash, makeLocoInfo("C", "0xc"));
+    bool written = finished && successful && (4 == writtenLocos.size());
+    const char *names[] = {"A", "B", "C"};
+    for (size_t loco = 0; written && (loco < 3); loco++)
+    {
+        written = (std::string::npos != writtenLocos[loco + 1].find(std::string(" .name=") + names[loco] + "\n")) &&
+                  (std::string::npos != writtenLocos[loco + 1].find(std::string(" .adresse=0x") + static_cast<char>('a' + loco) + "\n"));
+    }
+    if (!written)
+    {
+        printf("FAIL late answer: locos missing or mixed up\n");
+        return false;
+    }
+    printf("ok late answer to reissued request\n");
+    return true;
+}
+
+int main()
+{
+    int failed = 0;
+    failed += testStreamOfOtherStation() ? 0 : 1;
+    failed += testLateAnswerToReissuedRequest() ? 0 : 1;
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+/*********************************************************************
+ * Lokinfo pipeline benchmark
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// reads 80 locos from a simulated Mobile Station 2 with different numbers of lokinfo requests in flight.
+// Time is simulated: the MS2 starts to answer a request after 200 ms and needs 100 ms per answer, one after the other
+
+#include "TestHelper.h"
+#include <cstdio>
+#include <deque>
+
+static const size_t locoCount{80};
+static const unsigned long answerDelayINms{200};
+static const unsigned long answerDurationINms{100};
+
+static std::vector<std::string> writtenLocos;
+static bool finished{false};
+static bool successful{false};
+
+static void writeLoco(std::string *data, bool changed)
+{
+    writtenLocos.push_back(*data);
+}
+
+static void result(bool success)
+{
+    finished = true;
+    successful = success;
+}
+
+struct SimulationResult
+{
+    unsigned long durationINms;
+    bool ordered;
+};
+
+static SimulationResult simulate(uint8_t window)
+{
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList;
+    TestLocoManagment locoManagment(0, canInterface, stationList, 15000, 3);
+    locoManagment.setLocoInfoWindow(window);
+    writtenLocos.clear();
+    finished = false;
+
+    unsigned long now{0};
+    setMillis(now);
+    locoManagment.getLokomotiveConfig(writeLoco, result);
+    std::string lokliste{"[lokliste]\n"};
+    for (size_t loco = 0; loco < locoCount; loco++)
+    {
+        lokliste += "lok\n .name=Loco " + std::to_string(loco) + "\n";
+    }
+    canInterface.m_configDataRequests.clear();
+    sendConfigDataStream(locoManagment, 0x1234, lokliste);
+
+    // a lokinfo request is one frame "lokinfo" and two frames with the name
+    std::deque<std::pair<std::string, unsigned long>> requests;
+    size_t requestFrame{0};
+    unsigned long busyUntil{0};
+    while (!finished && (now < 3600000))
+    {
+        while ((requestFrame + 3) <= canInterface.m_configDataRequests.size())
+        {
+            std::string name;
+            for (size_t frame = requestFrame + 1; frame < (requestFrame + 3); frame++)
+            {
+                for (uint8_t character : canInterface.m_configDataRequests[frame])
+                {
+                    if (0 != character)
+                    {
+                        name += static_cast<char>(character);
+                    }
+                }
+            }
+            requests.emplace_back(name, now + answerDelayINms);
+            requestFrame += 3;
+        }
+        if (!requests.empty() && (now >= busyUntil) && (now >= requests.front().second))
+        {
+            std::string name = requests.front().first;
+            requests.pop_front();
+            now += answerDurationINms;
+            setMillis(now);
+            sendConfigDataStream(locoManagment, 0x4321, "[lokomotive]\nlok\n .name=" + name + "\n .adresse=0x1\n .typ=mm2_prg\n");
+            busyUntil = now;
+        }
+        else
+        {
+            now += 10;
+            setMillis(now);
+        }
+        locoManagment.cyclic();
+    }
+
+    // file header first, then the locos in the order of lokliste
+    bool ordered = successful && (writtenLocos.size() == (locoCount + 1));
+    for (size_t loco = 0; ordered && (loco < locoCount); loco++)
+    {
+        ordered = (std::string::npos != writtenLocos[loco + 1].find(" .name=Loco " + std::to_string(loco) + "\n"));
+    }
+    return SimulationResult{now, ordered};
+}
+
+int main()
+{
+    for (uint8_t window : {1, 2, 4, 8})
+    {
+        SimulationResult result = simulate(window);
+        printf("window %u: %zu locos in %.1f s simulated time%s\n", window, locoCount, result.durationINms / 1000.0,
+               result.ordered ? "" : ", FAIL locos missing or out of order");
+        if (!result.ordered)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
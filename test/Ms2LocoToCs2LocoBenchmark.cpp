@@ -0,0 +1,49 @@
+/*********************************************************************
+ * Ms2LocoToCs2Loco benchmark
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// translates the lokinfo of a loco with 32 functions, like a full MS2 loco
+
+#include "TestHelper.h"
+#include <chrono>
+#include <cstdio>
+
+int main(int argc, char **argv)
+{
+    std::string ms2Data;
+    if ((argc < 2) || !readFile(std::string(argv[1]) + "/br218_mfx_32_functions.ms2", ms2Data))
+    {
+        printf("usage: %s <golden file directory>\n", argv[0]);
+        return 1;
+    }
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList;
+    TestLocoManagment locoManagment(0, canInterface, stationList, 1000, 1);
+
+    const size_t repeats{20000};
+    std::string locoName{"BR 218 001"};
+    std::string cs2Data;
+    size_t outputBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repeats; i++)
+    {
+        locoManagment.Ms2LocoToCs2Loco(locoName, &ms2Data, &cs2Data);
+        outputBytes += cs2Data.size();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Ms2LocoToCs2Loco, 32 functions, %zu bytes: %.2f us per loco, %.1f MB/s output\n",
+           ms2Data.size(), seconds * 1e6 / repeats, outputBytes / seconds / 1e6);
+    return 0;
+}
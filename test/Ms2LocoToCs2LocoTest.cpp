@@ -0,0 +1,81 @@
+/*********************************************************************
+ * Ms2LocoToCs2Loco golden file test
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// every <file>.ms2 is a lokinfo of a Mobile Station 2 and <file>.cs2 is what Ms2LocoToCs2Loco has to make of it.
+// The .cs2 files were written by the translation before it became single pass, so old and new output are the same
+
+#include "TestHelper.h"
+#include <cstdio>
+
+struct GoldenFile
+{
+    const char *file;
+    const char *locoName;
+};
+
+static const GoldenFile goldenFiles[] = {
+    {"br86_mm", "BR 86"},
+    // lines end with "\r\n"
+    {"v100_dcc_cr", "V 100"},
+    // .fkt and .fkt2 with the keys of .fkt2 renamed
+    {"br218_mfx_32_functions", "BR 218 001"},
+};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <golden file directory>\n", argv[0]);
+        return 1;
+    }
+    std::string directory = std::string(argv[1]) + "/";
+    TestCanInterface canInterface;
+    std::vector<MaerklinStationConfig> stationList;
+    TestLocoManagment locoManagment(0, canInterface, stationList, 1000, 1);
+
+    int failed = 0;
+    for (const GoldenFile &golden : goldenFiles)
+    {
+        std::string ms2Data;
+        std::string expected;
+        if (!readFile(directory + golden.file + ".ms2", ms2Data) || !readFile(directory + golden.file + ".cs2", expected))
+        {
+            printf("FAIL %s: files not found\n", golden.file);
+            failed++;
+            continue;
+        }
+        std::string locoName{golden.locoName};
+        std::string cs2Data;
+        if (!locoManagment.Ms2LocoToCs2Loco(locoName, &ms2Data, &cs2Data) || (cs2Data != expected))
+        {
+            printf("FAIL %s:\n%s\n", golden.file, cs2Data.c_str());
+            failed++;
+            continue;
+        }
+        printf("ok %s\n", golden.file);
+    }
+
+    // data without "lok" is no lokinfo
+    std::string locoName{"none"};
+    std::string noLoco{"[lokomotive]\n"};
+    std::string cs2Data;
+    if (locoManagment.Ms2LocoToCs2Loco(locoName, &noLoco, &cs2Data))
+    {
+        printf("FAIL lokinfo without lok was translated\n");
+        failed++;
+    }
+    return (0 == failed) ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*********************************************************************
+ * TrainBox Maerklin test helpers
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <array>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "trainBoxMaerklin/MaerklinLocoManagment.h"
+
+// can interface without bus, config data requests are recorded
+class TestCanInterface : public MaerklinCanInterface
+{
+public:
+    TestCanInterface() : MaerklinCanInterface(0x0300, false) {}
+
+    bool sendMessage(TrackMessage &message) override
+    {
+        if (static_cast<uint8_t>(Cmd::requestConfigData) == message.command)
+        {
+            std::array<uint8_t, 8> request;
+            for (size_t i = 0; i < request.size(); i++)
+            {
+                request[i] = message.data[i];
+            }
+            m_configDataRequests.push_back(request);
+        }
+        return true;
+    }
+
+    bool receiveMessage(TrackMessage &message) override { return false; }
+
+    void end() override {}
+
+    std::vector<std::array<uint8_t, 8>> m_configDataRequests;
+};
+
+// makes the protected parts of the loco managment available to tests
+class TestLocoManagment : public MaerklinLocoManagment
+{
+public:
+    using MaerklinLocoManagment::MaerklinLocoManagment;
+    using MaerklinLocoManagment::Ms2LocoToCs2Loco;
+};
+
+// crc of a config data stream, calculated bit by bit as reference
+inline uint16_t calculateReferenceCRC(const std::string &data)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint8_t byte : data)
+    {
+        crc ^= byte << 8;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+// stream as it is sent by a Mobile Station, prepared once so sending does not include the crc calculation
+struct ConfigDataStreamFrames
+{
+    uint32_t length;
+    uint16_t crc;
+    std::vector<std::array<uint8_t, 8>> frames;
+};
+
+inline ConfigDataStreamFrames makeConfigDataStream(std::string data)
+{
+    ConfigDataStreamFrames stream;
+    stream.length = data.size();
+    // stream is filled up to whole frames
+    data.resize((data.size() + 7) / 8 * 8, '\0');
+    stream.crc = calculateReferenceCRC(data);
+    for (size_t i = 0; i < data.size(); i += 8)
+    {
+        std::array<uint8_t, 8> frame;
+        for (size_t j = 0; j < frame.size(); j++)
+        {
+            frame[j] = data[i + j];
+        }
+        stream.frames.push_back(frame);
+    }
+    return stream;
+}
+
+inline void sendConfigDataStream(MaerklinConfigDataStream &receiver, uint16_t hash, ConfigDataStreamFrames &stream)
+{
+    receiver.onConfigDataStream(hash, stream.length, stream.crc);
+    for (std::array<uint8_t, 8> &frame : stream.frames)
+    {
+        receiver.onConfigDataStream(hash, frame);
+    }
+}
+
+// sends data as config data stream like a Mobile Station answers a request
+inline void sendConfigDataStream(MaerklinConfigDataStream &receiver, uint16_t hash, const std::string &data)
+{
+    ConfigDataStreamFrames stream = makeConfigDataStream(data);
+    sendConfigDataStream(receiver, hash, stream);
+}
+
+// lokomotive.cs2 of a Central Station with locoCount locos with functionCount used functions each
+inline std::string makeLokomotiveCs2(size_t locoCount, uint8_t functionCount)
+{
+    std::string file{"[lokomotive]\nversion\n .minor=3\nsession\n .id=1\n"};
+    char line[64];
+    for (size_t loco = 0; loco < locoCount; loco++)
+    {
+        snprintf(line, sizeof(line), "lokomotive\n .name=Loco %zu\n .uid=0x%zx\n", loco, 0x4000 + loco);
+        file += line;
+        snprintf(line, sizeof(line), " .adresse=0x%zx\n .typ=%s\n", loco % 80 + 1, (0 == loco % 3) ? "mfx" : ((1 == loco % 3) ? "mm2_prg" : "dcc"));
+        file += line;
+        file += " .icon=loco\n .av=6\n .bv=3\n .volume=25\n .velocity=0\n .richtung=0\n .vmax=60\n .vmin=3\n";
+        for (uint8_t function = 0; function < functionCount; function++)
+        {
+            snprintf(line, sizeof(line), " .funktionen\n ..nr=%u\n ..typ=%u\n ..dauer=%u\n ..wert=0\n", function, function % 9 + 1, function % 3);
+            file += line;
+        }
+    }
+    return file;
+}
+
+inline bool readFile(const std::string &path, std::string &content)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
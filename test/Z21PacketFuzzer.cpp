@@ -0,0 +1,99 @@
+/*********************************************************************
+ * z21 datagram fuzzer
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// feeds datagrams through UdpInterfaceLinux::handlePacket into a z21 central.
+// The first byte selects the client, the rest is the datagram.
+// Built with clang it is a libFuzzer target, otherwise main() replays the given files
+// or, without arguments, random and length biased datagrams
+
+#include "Z21TestHelper.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+static const uint16_t maxNumberOfClients{4};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static Z21TestStation station(maxNumberOfClients);
+    if (0 == size)
+    {
+        return 0;
+    }
+    uint8_t client = 1 + data[0] % maxNumberOfClients;
+    // own copy, so reading behind the datagram is found by the address sanitizer
+    std::vector<uint8_t> datagram(data + 1, data + size);
+    UdpInterfaceLinux::Statistics before = station.udpInterface->getStatistics();
+    station.udpInterface->handlePacket(client, datagram.data(), datagram.size(), millis());
+    const UdpInterfaceLinux::Statistics &after = station.udpInterface->getStatistics();
+    // every dataset has at least length and header
+    if ((after.datasets - before.datasets) * 4 > datagram.size())
+    {
+        abort();
+    }
+    return 0;
+}
+
+#ifndef Z21_LIBFUZZER
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+        }
+        printf("%d inputs replayed\n", argc - 1);
+        return 0;
+    }
+
+    const size_t runs{200000};
+    std::mt19937 generator(29);
+    std::vector<uint8_t> input;
+    for (size_t run = 0; run < runs; run++)
+    {
+        input.clear();
+        input.push_back(static_cast<uint8_t>(generator()));
+        size_t datasets = generator() % 4;
+        for (size_t dataset = 0; dataset < datasets; dataset++)
+        {
+            // mostly plausible lengths with known headers, sometimes anything
+            uint16_t length = (0 == generator() % 4) ? static_cast<uint16_t>(generator()) : static_cast<uint16_t>(generator() % 24);
+            input.push_back(lowByte(length));
+            input.push_back(highByte(length));
+            input.push_back((0 == generator() % 2) ? 0x40 : static_cast<uint8_t>(generator()));
+            input.push_back((0 == generator() % 8) ? static_cast<uint8_t>(generator()) : 0x00);
+            size_t payload = (length >= 4) ? (length - 4) : 0;
+            if (0 == generator() % 8)
+            {
+                // cut off
+                payload = generator() % (payload + 1);
+            }
+            for (size_t i = 0; (i < payload) && (i < 64); i++)
+            {
+                input.push_back(static_cast<uint8_t>(generator()));
+            }
+        }
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    printf("%zu random datagrams handled\n", runs);
+    return 0;
+}
+#endif
@@ -0,0 +1,145 @@
+/*********************************************************************
+ * z21 datagram replay benchmark
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+// replays the traffic of four z21 apps through UdpInterfaceLinux::handlePacket into a z21 central:
+// broadcast flags, loco drive and function, loco info, turnouts and datagrams with several datasets.
+// Packet rate and heap allocations per packet are printed
+
+#include "Z21TestHelper.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static bool countAllocations{false};
+static size_t allocations{0};
+
+void *operator new(size_t size)
+{
+    if (countAllocations)
+    {
+        allocations++;
+    }
+    void *memory = malloc(size);
+    if (nullptr == memory)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+struct Datagram
+{
+    uint8_t client;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<Datagram> makeTraffic(uint8_t numberOfClients, size_t numberOfDatagrams)
+{
+    std::vector<Datagram> traffic;
+    for (uint8_t client = 1; client <= numberOfClients; client++)
+    {
+        Datagram datagram{client, {}};
+        // Z21bcAll | Z21bcNetAll
+        appendZ21Dataset(datagram.data, 0x50, {0x01, 0x00, 0x01, 0x00}, false);
+        traffic.push_back(datagram);
+    }
+    for (size_t i = 0; traffic.size() < numberOfDatagrams; i++)
+    {
+        uint8_t client = 1 + i % numberOfClients;
+        uint16_t locoAdr = 1 + i % 40;
+        uint16_t turnoutAdr = i % 64;
+        Datagram datagram{client, {}};
+        switch (i % 8)
+        {
+        case 0:
+        case 1:
+        case 2:
+            // LAN_X_SET_LOCO_DRIVE 128 steps
+            appendZ21Dataset(datagram.data, 0x40, {0xE4, 0x13, highByte(locoAdr), lowByte(locoAdr), static_cast<uint8_t>(i % 128)}, true);
+            break;
+        case 3:
+            // LAN_X_SET_LOCO_FUNCTION toggle
+            appendZ21Dataset(datagram.data, 0x40, {0xE4, 0xF8, highByte(locoAdr), lowByte(locoAdr), static_cast<uint8_t>(0x80 | (i % 29))}, true);
+            break;
+        case 4:
+            // LAN_X_GET_LOCO_INFO
+            appendZ21Dataset(datagram.data, 0x40, {0xE3, 0xF0, highByte(locoAdr), lowByte(locoAdr)}, true);
+            break;
+        case 5:
+            // LAN_X_SET_TURNOUT coil on, then off in the same datagram
+            appendZ21Dataset(datagram.data, 0x40, {0x53, highByte(turnoutAdr), lowByte(turnoutAdr), static_cast<uint8_t>(0xA8 | (i & 0x01))}, true);
+            appendZ21Dataset(datagram.data, 0x40, {0x53, highByte(turnoutAdr), lowByte(turnoutAdr), static_cast<uint8_t>(0xA0 | (i & 0x01))}, true);
+            break;
+        case 6:
+            // LAN_X_GET_TURNOUT_INFO
+            appendZ21Dataset(datagram.data, 0x40, {0x43, highByte(turnoutAdr), lowByte(turnoutAdr)}, true);
+            break;
+        default:
+            // LAN_SYSTEMSTATE_GETDATA and LAN_GET_BROADCASTFLAGS
+            appendZ21Dataset(datagram.data, 0x85, {}, false);
+            appendZ21Dataset(datagram.data, 0x51, {}, false);
+            break;
+        }
+        traffic.push_back(datagram);
+    }
+    return traffic;
+}
+
+int main()
+{
+    const uint8_t numberOfClients{4};
+    Z21TestStation station(numberOfClients);
+    std::vector<Datagram> traffic = makeTraffic(numberOfClients, 10000);
+
+    const size_t repeats{50};
+    allocations = 0;
+    countAllocations = true;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t repeat = 0; repeat < repeats; repeat++)
+    {
+        for (const Datagram &datagram : traffic)
+        {
+            station.udpInterface->handlePacket(datagram.client, datagram.data.data(), datagram.data.size(), millis());
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    countAllocations = false;
+
+    const UdpInterfaceLinux::Statistics &statistics = station.udpInterface->getStatistics();
+    if ((0 != statistics.malformedDatasets) || (0 == station.central.m_locoSpeeds) || (0 == station.central.m_accessories))
+    {
+        printf("FAIL %u malformed datasets, %zu drive and %zu turnout commands\n", statistics.malformedDatasets, station.central.m_locoSpeeds, station.central.m_accessories);
+        return 1;
+    }
+    double packets = static_cast<double>(statistics.packets);
+    printf("%zu datagrams from %u clients replayed %zu times\n", traffic.size(), numberOfClients, repeats);
+    printf("packets/s: %.0f\n", packets / seconds);
+    printf("datasets/s: %.0f\n", statistics.datasets / seconds);
+    printf("answers per packet: %.2f\n", station.udpInterface->m_transmitted / packets);
+    printf("allocations per packet: %.2f\n", allocations / packets);
+    return 0;
+}
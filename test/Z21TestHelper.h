@@ -0,0 +1,111 @@
+/*********************************************************************
+ * z21 test helpers
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+#include "z21/UdpInterfaceLinux.h"
+#include "z21/z21InterfaceObserver.h"
+
+// udp interface without socket, datagrams are handed to handlePacket directly and answers are counted
+class TestUdpInterface : public UdpInterfaceLinux
+{
+public:
+    explicit TestUdpInterface(uint16_t maxNumberOfClients) : UdpInterfaceLinux(maxNumberOfClients, 21105, false) {}
+
+    using UdpInterfaceLinux::handlePacket;
+
+    bool transmit(Udp::Message &message) override
+    {
+        m_transmitted++;
+        return UdpInterfaceLinux::transmit(message);
+    }
+
+    bool transmit(Udp::Message &message, const uint8_t *clients, uint8_t numberOfClients) override
+    {
+        m_transmitted += numberOfClients;
+        return UdpInterfaceLinux::transmit(message, clients, numberOfClients);
+    }
+
+    size_t m_transmitted{0};
+};
+
+// z21 central without trainbox, the commands of the clients are only counted
+class TestZ21Observer : public z21InterfaceObserver
+{
+public:
+    TestZ21Observer() : z21InterfaceObserver(z21Interface::HwType::Z21_NEW, 0x0140, false) {}
+
+    size_t m_locoSpeeds{0};
+    size_t m_locoFunctions{0};
+    size_t m_accessories{0};
+    size_t m_broadcastFlags{0};
+
+protected:
+    uint16_t getSerialNumber() override { return 0x1234; }
+
+    void notifyz21InterfaceLocoState(uint16_t Adr, uint8_t data[]) override
+    {
+        // 128 steps, everything else off
+        data[0] = 0x04;
+    }
+
+    void notifyz21InterfaceLocoSpeed(uint16_t Adr, uint8_t speed, uint8_t stepConfig) override { m_locoSpeeds++; }
+
+    void notifyz21InterfaceLocoFkt(uint16_t Adr, uint8_t type, uint8_t fkt) override { m_locoFunctions++; }
+
+    void notifyz21InterfaceAccessory(uint16_t Adr, bool state, bool active) override { m_accessories++; }
+
+    void notifyz21InterfaceAccessoryInfo(uint16_t Adr, uint8_t &position) override { position = 0x01; }
+
+    void notifyz21InterfaceBroadcastFlags(uint8_t client, uint16_t bcFlag) override { m_broadcastFlags++; }
+};
+
+// z21 central listening on a test udp interface
+struct Z21TestStation
+{
+    explicit Z21TestStation(uint16_t maxNumberOfClients)
+        : udpInterface(std::make_shared<TestUdpInterface>(maxNumberOfClients))
+    {
+        central.setUdpObserver(udpInterface);
+        central.begin();
+    }
+
+    std::shared_ptr<TestUdpInterface> udpInterface;
+    TestZ21Observer central;
+};
+
+// dataset with length, header, data and the xor over data for LAN_X commands
+inline void appendZ21Dataset(std::vector<uint8_t> &datagram, uint16_t header, const std::vector<uint8_t> &data, bool withXOR)
+{
+    uint16_t length = static_cast<uint16_t>(4 + data.size() + (withXOR ? 1 : 0));
+    datagram.push_back(lowByte(length));
+    datagram.push_back(highByte(length));
+    datagram.push_back(lowByte(header));
+    datagram.push_back(highByte(header));
+    uint8_t xorValue = 0;
+    for (uint8_t value : data)
+    {
+        datagram.push_back(value);
+        xorValue ^= value;
+    }
+    if (withXOR)
+    {
+        datagram.push_back(xorValue);
+    }
+}
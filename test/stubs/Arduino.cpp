@@ -0,0 +1,71 @@
+/*********************************************************************
+ * Arduino stubs for host tests
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+static bool fixedTime{false};
+static unsigned long fixedMillis{0};
+
+String::String(unsigned long value, int base)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), (HEX == base) ? "%lx" : "%lu", value);
+    assign(buffer);
+}
+
+void setMillis(unsigned long ms)
+{
+    fixedTime = true;
+    fixedMillis = ms;
+}
+
+unsigned long millis()
+{
+    if (fixedTime)
+    {
+        return fixedMillis;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+long random(long max)
+{
+    return rand() % max;
+}
+
+long random(long min, long max)
+{
+    return min + rand() % (max - min);
+}
@@ -0,0 +1,98 @@
+/*********************************************************************
+ * Arduino stubs for host tests
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+// only what the tested classes use. Output to Serial is dropped
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#define HEX 16
+#define DEC 10
+#define BIN 2
+#define F(text) (text)
+
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define lowByte(w) ((uint8_t)((w)&0xff))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+// binary constants of the Arduino core, only the used ones
+#define B11 3
+#define B111 7
+#define B00111111 63
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef unsigned int word;
+
+inline uint16_t makeWord(uint8_t h, uint8_t l) { return (h << 8) | l; }
+#define word(...) makeWord(__VA_ARGS__)
+
+// real time is used until a test sets the time with setMillis
+void setMillis(unsigned long ms);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+long random(long max);
+long random(long min, long max);
+
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char *text) : std::string(text) {}
+    String(const std::string &text) : std::string(text) {}
+    String(unsigned long value, int base = DEC);
+    char charAt(size_t index) const { return (*this)[index]; }
+};
+
+class Print
+{
+public:
+    template <typename T>
+    size_t print(const T &, int = DEC) { return 0; }
+    template <typename T>
+    size_t println(const T &, int = DEC) { return 0; }
+    size_t println() { return 0; }
+    size_t printf(const char *, ...) { return 0; }
+};
+
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long) {}
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress
+{
+public:
+    IPAddress() : m_address(0) {}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+        : m_address((static_cast<uint32_t>(first) << 24) | (static_cast<uint32_t>(second) << 16) | (static_cast<uint32_t>(third) << 8) | fourth)
+    {
+    }
+    bool operator==(const IPAddress &other) const { return m_address == other.m_address; }
+
+private:
+    uint32_t m_address;
+};
@@ -0,0 +1,64 @@
+/*********************************************************************
+ * AsyncUDP stubs for host tests
+ *
+ * Copyright (C) 2022 Marcel Maage
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * LICENSE file for more details.
+ */
+
+#pragma once
+
+// no socket is opened, datagrams are fed in by the tests. Sent datagrams are only counted
+#include <Arduino.h>
+#include <functional>
+
+typedef enum
+{
+    TCPIP_ADAPTER_IF_STA = 0,
+    TCPIP_ADAPTER_IF_AP,
+    TCPIP_ADAPTER_IF_MAX
+} tcpip_adapter_if_t;
+
+class AsyncUDPPacket
+{
+public:
+    AsyncUDPPacket(uint8_t *data, size_t length, IPAddress remoteIP) : m_data(data), m_length(length), m_remoteIP(remoteIP) {}
+
+    uint8_t *data() { return m_data; }
+    size_t length() { return m_length; }
+    IPAddress remoteIP() { return m_remoteIP; }
+
+private:
+    uint8_t *m_data;
+    size_t m_length;
+    IPAddress m_remoteIP;
+};
+
+class AsyncUDP
+{
+public:
+    typedef std::function<void(AsyncUDPPacket packet)> AuPacketHandlerFunction;
+
+    bool listen(uint16_t port) { return true; }
+
+    void onPacket(AuPacketHandlerFunction callback) { m_callback = callback; }
+
+    size_t writeTo(const uint8_t *data, size_t length, const IPAddress addr, uint16_t port, tcpip_adapter_if_t tcpipIf = TCPIP_ADAPTER_IF_MAX)
+    {
+        m_sentDatagrams++;
+        return length;
+    }
+
+    size_t m_sentDatagrams{0};
+
+private:
+    AuPacketHandlerFunction m_callback;
+};